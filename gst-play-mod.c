@@ -21,16 +21,12 @@
  * Boston, MA 02110-1301, USA.
  */
 
-#include <gst/audio/audio.h>
-#include <gst/video/video.h>
-#include <gst/math-compat.h>
-#include <xcb/xcb.h>
+#include "gstplaymod.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#include <glib/gprintf.h>
+#include <unistd.h>
 
 #include <dbus/dbus.h>
 #include <dbus/dbus-glib-lowlevel.h>
@@ -38,830 +34,646 @@
 #define PROGRAM_NAME "gst-play-mod"
 #define VERSION_STRING "1.0"
 
-#define VOLUME_STEPS 20
-
-GST_DEBUG_CATEGORY (play_debug);
-#define GST_CAT_DEFAULT play_debug
-
 #define INTERFACE_NAME "com.noisolation.MediaPlayer"
 #define OBJECT_PATH "/com/noisolation/MediaPlayer"
 
-typedef enum
-{
-  GST_PLAY_TRICK_MODE_NONE = 0,
-  GST_PLAY_TRICK_MODE_DEFAULT,
-  GST_PLAY_TRICK_MODE_DEFAULT_NO_AUDIO,
-  GST_PLAY_TRICK_MODE_KEY_UNITS,
-  GST_PLAY_TRICK_MODE_KEY_UNITS_NO_AUDIO,
-  GST_PLAY_TRICK_MODE_LAST
-} GstPlayTrickMode;
-
-typedef enum
-{
-  GST_PLAY_TRACK_TYPE_INVALID = 0,
-  GST_PLAY_TRACK_TYPE_AUDIO,
-  GST_PLAY_TRACK_TYPE_VIDEO,
-  GST_PLAY_TRACK_TYPE_SUBTITLE
-} GstPlayTrackType;
+GST_DEBUG_CATEGORY_STATIC (cli_debug);
+#define GST_CAT_DEFAULT cli_debug
+
+static gboolean quiet = FALSE;
 
+/* one player per output, player N answers on OBJECT_PATH/N and all of
+ * them on OBJECT_PATH */
+static GstPlayMod **players;
+static guint num_players;
+static guint players_running;
+static GMainLoop *main_loop;
+
+/* D-Bus and stdin are read on the I/O thread, which only queues the
+ * commands for the players */
+static GMainContext *io_context;
+static GMainLoop *io_loop;
+static GThread *io_thread;
+static DBusConnection *server_connection;
+
+/* what changed since the last Changed signal of a player */
+enum
+{
+  NOTIFY_STATE = 1 << 0,
+  NOTIFY_ITEM = 1 << 1,
+  NOTIFY_RATE = 1 << 2,
+  NOTIFY_VOLUME = 1 << 3,
+  NOTIFY_TRACKS = 1 << 4,
+  NOTIFY_BUFFERING = 1 << 5,
+  NOTIFY_POSITION = 1 << 6
+};
+
+/* the players' events update these on the main thread, the I/O thread
+ * sends them out at most every notify_interval ms per player */
 typedef struct
 {
-  gchar **uris;
-  guint num_uris;
-  gint cur_idx;
-
-  GstElement *playbin;
-
-  GstStreamCollection *collection;
-  gchar *cur_audio_sid;
-  gchar *cur_video_sid;
-  gchar *cur_text_sid;
-  GMutex selection_lock;
-
-  GMainLoop *loop;
-  guint bus_watch;
-  guint timeout;
-
-  gboolean buffering;
-  gboolean is_live;
-
-  GstState desired_state;
-
-  gulong deep_notify_id;
-
-  /* configuration */
-  gboolean gapless;
-
-  GstPlayTrickMode trick_mode;
+  guint dirty;
+  gboolean scheduled;
+  GstState state;
+  gint index;
+  gchar *uri;
   gdouble rate;
-} GstPlay;
-
-static gboolean quiet = FALSE;
+  gint trick_mode;
+  gdouble volume;
+  gboolean mute;
+  gint tracks[3];               /* audio, video, subtitle */
+  gint buffering;
+  gint64 position;
+  gint64 duration;
+} PlayerNotify;
 
-static gboolean play_bus_msg (GstBus * bus, GstMessage * msg, gpointer data);
-static gboolean play_next (GstPlay * play);
-static gboolean play_prev (GstPlay * play);
-static gboolean play_timeout (gpointer user_data);
-static void play_about_to_finish (GstElement * playbin, gpointer user_data);
-static void play_reset (GstPlay * play);
-static void play_set_relative_volume (GstPlay * play, gdouble volume_step);
-static void play_set_playback_rate (GstPlay * play, gdouble rate);
-static void play_set_relative_playback_rate (GstPlay * play, gdouble rate_step, gboolean reverse_direction);
-static void play_switch_trick_mode (GstPlay * play);
-static void play_cycle_track_selection (GstPlay * play, GstPlayTrackType track_type);
-static void play_toggle_audio_mute (GstPlay * play);
-static gboolean play_do_seek (GstPlay * play, gint64 pos, gdouble rate, GstPlayTrickMode mode);
-static void toggle_paused (GstPlay * play);
-static void relative_seek (GstPlay * play, gdouble percent);
-
-/* *INDENT-OFF* */
-static void gst_play_printf (const gchar * format, ...) G_GNUC_PRINTF (1, 2);
-/* *INDENT-ON* */
+static PlayerNotify *notify;
+static GMutex notify_lock;
+static gint notify_interval = 250;
 
-static DBusHandlerResult
-server_message_handler (DBusConnection *conn, DBusMessage *message, void *user_data)
+/* @player -1 means all of them, @arg is NULL for most commands */
+static void
+server_push_command (gint player, GstPlayModCommandType type, const gchar * arg)
 {
-  DBusError err;
-  GstPlay *play = (GstPlay *) user_data;
-  gboolean quit = FALSE;
-
-  gst_printerr ("Got D-Bus request: %s.%s on %s\n",
-    dbus_message_get_interface (message),
-    dbus_message_get_member (message),
-    dbus_message_get_path (message));
+  guint i;
 
-  dbus_error_init (&err);
-
-  if (dbus_message_is_signal (message, INTERFACE_NAME, "Quit")) {
-    quit = TRUE;
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "TogglePaused")) {
-    toggle_paused (play);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "PlayNext")) {
-    if (!play_next (play)) {
-      gst_print ("\n%s\n", "Reached end of play list.");
-      quit = TRUE;
-    }
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "PlayPrevious")) {
-    play_prev (play);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "IncreasePlaybackRate")) {
-    if (play->rate > -0.2 && play->rate < 0.0)
-      play_set_relative_playback_rate (play, 0.0, TRUE);
-    else if (ABS (play->rate) < 2.0)
-      play_set_relative_playback_rate (play, 0.1, FALSE);
-    else if (ABS (play->rate) < 4.0)
-      play_set_relative_playback_rate (play, 0.5, FALSE);
-    else
-      play_set_relative_playback_rate (play, 1.0, FALSE);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "DecreasePlaybackRate")) {
-    if (play->rate > 0.0 && play->rate < 0.20)
-      play_set_relative_playback_rate (play, 0.0, TRUE);
-    else if (ABS (play->rate) <= 2.0)
-      play_set_relative_playback_rate (play, -0.1, FALSE);
-    else if (ABS (play->rate) <= 4.0)
-      play_set_relative_playback_rate (play, -0.5, FALSE);
-    else
-      play_set_relative_playback_rate (play, -1.0, FALSE);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "ChangePlaybackDirection")) {
-    play_set_relative_playback_rate (play, 0.0, TRUE);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "ToggleTrickMode")) {
-    play_switch_trick_mode (play);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "ChangeAudioTrack")) {
-    play_cycle_track_selection (play, GST_PLAY_TRACK_TYPE_AUDIO);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "ChangeVideoTrack")) {
-    play_cycle_track_selection (play, GST_PLAY_TRACK_TYPE_VIDEO);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "ChangeSubtitleTrack")) {
-    play_cycle_track_selection (play, GST_PLAY_TRACK_TYPE_SUBTITLE);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "SeekToBeginning")) {
-    play_do_seek (play, 0, play->rate, play->trick_mode);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "ToggleAudioMute")) {
-    play_toggle_audio_mute (play);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "IncreaseAudioVolume")) {
-    play_set_relative_volume (play, +1.0 / VOLUME_STEPS);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "DecreaseAudioVolume")) {
-    play_set_relative_volume (play, -1.0 / VOLUME_STEPS);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "SeekRight")) {
-    relative_seek (play, +0.08);
-  } else if (dbus_message_is_signal (message, INTERFACE_NAME, "SeekLeft")) {
-    relative_seek (play, +0.08);
-	} else {
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-  }
-
-  if (dbus_error_is_set (&err)) {
-    dbus_error_free (&err);
+  if (player >= (gint) num_players) {
+    gst_printerr ("No player %d\n", player);
+    return;
   }
 
-  if (quit) {
-      gst_printerr ("Server exiting...\n");
-      g_main_loop_quit (play->loop);
+  for (i = 0; i < num_players; i++) {
+    if (player < 0 || player == (gint) i)
+      gst_play_mod_command_push_full (players[i], type, arg);
   }
-
-  return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/* D-Bus signals arrive on the I/O thread and are only queued here */
+/* OBJECT_PATH is -1 for all players, OBJECT_PATH/N is player N */
 static gboolean
-server_setup(GstPlay *play)
+server_parse_path (const gchar * path, gint * player)
 {
-  DBusConnection *connection;
-  DBusError error;
-  int rv;
-
-  dbus_error_init (&error);
+  gchar *end;
 
-  connection = dbus_bus_get(DBUS_BUS_SESSION, &error);
-  if (!connection) {
-    gst_printerr ("Failed to get a session DBus connection: %s\n", error.message);
-    dbus_error_free (&error);
-    return FALSE;
-  }
-
-  rv = dbus_bus_request_name(connection, INTERFACE_NAME, DBUS_NAME_FLAG_REPLACE_EXISTING , &error);
-  if (rv != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
-    gst_printerr ("Failed to request name on bus: %s\n", error.message);
-    dbus_error_free (&error);
-    return FALSE;
+  *player = -1;
+  if (g_str_has_prefix (path, OBJECT_PATH "/")) {
+    *player = strtol (path + strlen (OBJECT_PATH "/"), &end, 10);
+    return *end == '\0' && *player >= 0;
   }
-
-  dbus_bus_add_match (connection, "type='signal',interface='com.noisolation.MediaPlayer'", &error);
-  if (dbus_error_is_set (&error)) {
-    gst_printerr ("Failed to add match: %s\n", error.message);
-    dbus_error_free (&error);
-    return FALSE;
-  }
-
-  if (!dbus_connection_add_filter (connection, server_message_handler, play, NULL)) {
-    gst_printerr ("Failed to add filter: %s\n", error.message);
-    dbus_error_free (&error);
-    return FALSE;
-  }
-
-  dbus_connection_setup_with_g_main (connection, NULL);
-
-  return TRUE;
+  return g_str_equal (path, OBJECT_PATH);
 }
 
+/* answers a Snapshot call, from the encoder thread */
 static void
-client_send_signal(const char * signal)
+server_snapshot_done (GstPlayMod * play, const gchar * path, const GError * err,
+    gpointer user_data)
 {
-  DBusConnection *connection;
-  DBusMessage *message;
-  DBusError error;
-
-  dbus_error_init (&error);
+  DBusMessage *message = user_data;
+  DBusMessage *reply;
 
-  connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
-
-  if (!connection) {
-    gst_printerr (" Failed to connect to the D-BUS daemon: %s", error.message);
-    dbus_error_free (&error);
-    return;
-  }
-
-  message = dbus_message_new_signal (OBJECT_PATH, INTERFACE_NAME, signal);
-  if (!message) {
-    gst_printerr("Error creating DBus message\n");
-    dbus_connection_unref(connection);
-    return;
-  }
-
-  if (!dbus_connection_send (connection, message, NULL)) {
-    gst_printerr (" Failed to send signal");
-    dbus_error_free (&error);
-    dbus_message_unref (message);
-    dbus_connection_unref (connection);
-    return;
+  if (err != NULL) {
+    reply = dbus_message_new_error (message, DBUS_ERROR_FAILED, err->message);
+  } else {
+    reply = dbus_message_new_method_return (message);
+    dbus_message_append_args (reply, DBUS_TYPE_STRING, &path,
+        DBUS_TYPE_INVALID);
   }
 
-  dbus_connection_flush (connection);
+  dbus_connection_send (server_connection, reply, NULL);
+  dbus_message_unref (reply);
   dbus_message_unref (message);
-  dbus_connection_unref (connection);
-
-  gst_print (" Signal sendt: %s\n", signal);
 }
 
-static void
-create_window (GstBus * bus, GstMessage * message, GstPipeline * pipeline)
+/* Snapshot and GetThumbnails are about what's on one screen, so with
+ * several players they need to be called on OBJECT_PATH/N */
+static DBusMessage *
+server_player_call (DBusMessage *message, gint player)
 {
-  xcb_connection_t *connection;
-  xcb_screen_t     *screen;
-  xcb_window_t     window;
-  uint32_t         values[2];
-
-  connection = xcb_connect (NULL, NULL);
-  screen = xcb_setup_roots_iterator (xcb_get_setup (connection)).data;
-  window = xcb_generate_id(connection);
-
-  values[0] = screen->black_pixel;
-  values[1] = XCB_EVENT_MASK_EXPOSURE;
-
-  xcb_create_window (connection, XCB_COPY_FROM_PARENT, window, screen->root,
-    0, 0, screen->width_in_pixels, screen->height_in_pixels, 0,
-    XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
-    XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values);
+  DBusMessage *reply;
+  const char *path = NULL;
+  gchar *report;
+
+  if (player < 0 && num_players > 1)
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS,
+        "Call this on the object of one player");
+  if (player < 0)
+    player = 0;
+
+  if (dbus_message_has_member (message, "Snapshot")) {
+    dbus_message_get_args (message, NULL, DBUS_TYPE_STRING, &path,
+        DBUS_TYPE_INVALID);
+    gst_play_mod_snapshot (players[player], path, server_snapshot_done,
+        dbus_message_ref (message));
+    return NULL;
+  }
 
-  xcb_map_window (connection, window);
-  xcb_flush (connection);
+  report = gst_play_mod_thumbnails_report (players[player]);
+  if (report == NULL)
+    return dbus_message_new_error (message, DBUS_ERROR_FAILED,
+        "No thumbnails for this item (yet)");
 
-  gst_video_overlay_set_window_handle (
-    GST_VIDEO_OVERLAY (GST_MESSAGE_SRC (message)), window);
+  reply = dbus_message_new_method_return (message);
+  dbus_message_append_args (reply, DBUS_TYPE_STRING, &report,
+      DBUS_TYPE_INVALID);
+  g_free (report);
+  return reply;
 }
 
-static void
-gst_play_printf (const gchar * format, ...)
+/* methods answer with a report, straight from the I/O thread, apart from
+ * Snapshot, which answers once the image is written */
+static DBusHandlerResult
+server_method_call (DBusConnection *conn, DBusMessage *message)
 {
-  gchar *str = NULL;
-  va_list args;
-  int len;
-
-  if (quiet)
-    return;
-
-  va_start (args, format);
-
-  len = g_vasprintf (&str, format, args);
-
-  va_end (args);
+  DBusMessage *reply;
+  GString *report;
+  gint player;
+  guint i;
+
+  if (!server_parse_path (dbus_message_get_path (message), &player))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  if (player >= (gint) num_players) {
+    reply = dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS,
+        "No such player");
+  } else if (dbus_message_has_member (message, "Snapshot") ||
+      dbus_message_has_member (message, "GetThumbnails")) {
+    reply = server_player_call (message, player);
+    if (reply == NULL)
+      return DBUS_HANDLER_RESULT_HANDLED;
+  } else if (!dbus_message_has_member (message, "GetFramePacing")) {
+    reply = dbus_message_new_error (message, DBUS_ERROR_UNKNOWN_METHOD,
+        dbus_message_get_member (message));
+  } else {
+    report = g_string_new (NULL);
+    for (i = 0; i < num_players; i++) {
+      gchar *str;
+
+      if (player >= 0 && player != (gint) i)
+        continue;
+      if (player < 0 && num_players > 1)
+        g_string_append_printf (report, "Player %u:\n", i);
+      str = gst_play_mod_frame_pacing_report (players[i]);
+      g_string_append (report, str);
+      g_free (str);
+    }
+    reply = dbus_message_new_method_return (message);
+    dbus_message_append_args (reply, DBUS_TYPE_STRING, &report->str,
+        DBUS_TYPE_INVALID);
+    g_string_free (report, TRUE);
+  }
 
-  if (len > 0 && str != NULL)
-    gst_print ("%s", str);
+  dbus_connection_send (conn, reply, NULL);
+  dbus_message_unref (reply);
 
-  g_free (str);
+  return DBUS_HANDLER_RESULT_HANDLED;
 }
 
-#define gst_print gst_play_printf
-
-static GstPlay *
-play_new (gchar ** uris, const gchar * audio_sink, const gchar * video_sink,
-    gboolean gapless, gdouble initial_volume, gdouble initial_rate, gboolean verbose,
-    const gchar * flags_string)
+static DBusHandlerResult
+server_message_handler (DBusConnection *conn, DBusMessage *message, void *user_data)
 {
-  GstElement *sink, *playbin;
-  GstPlay *play;
+  GstPlayModCommandType type;
+  DBusMessageIter iter;
+  GString *arg = NULL;
+  gint player = -1;
 
-  playbin = gst_element_factory_make ("playbin", "playbin");
-
-  if (playbin == NULL)
-    return NULL;
+  if (!dbus_message_has_interface (message, INTERFACE_NAME))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-  play = g_new0 (GstPlay, 1);
+  if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    return server_method_call (conn, message);
 
-  play->uris = uris;
-  play->num_uris = g_strv_length (uris);
-  play->cur_idx = -1;
+  if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_SIGNAL)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-  play->playbin = playbin;
-
-  g_mutex_init (&play->selection_lock);
-
-  if (audio_sink != NULL) {
-    if (strchr (audio_sink, ' ') != NULL)
-      sink = gst_parse_bin_from_description (audio_sink, TRUE, NULL);
-    else
-      sink = gst_element_factory_make (audio_sink, NULL);
-
-    if (sink != NULL)
-      g_object_set (play->playbin, "audio-sink", sink, NULL);
-    else
-      g_warning ("Couldn't create specified audio sink '%s'", audio_sink);
-  }
-  if (video_sink != NULL) {
-    if (strchr (video_sink, ' ') != NULL)
-      sink = gst_parse_bin_from_description (video_sink, TRUE, NULL);
-    else
-      sink = gst_element_factory_make (video_sink, NULL);
+  gst_printerr ("Got D-Bus request: %s.%s on %s\n",
+    dbus_message_get_interface (message),
+    dbus_message_get_member (message),
+    dbus_message_get_path (message));
 
-    if (sink != NULL)
-      g_object_set (play->playbin, "video-sink", sink, NULL);
-    else
-      g_warning ("Couldn't create specified video sink '%s'", video_sink);
-  }
+  if (!gst_play_mod_command_lookup (dbus_message_get_member (message), &type))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-  if (flags_string != NULL) {
-    GParamSpec *pspec;
-    GValue val = { 0, };
+  if (!server_parse_path (dbus_message_get_path (message), &player))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    pspec =
-        g_object_class_find_property (G_OBJECT_GET_CLASS (playbin), "flags");
-    g_value_init (&val, pspec->value_type);
-    if (gst_value_deserialize (&val, flags_string))
-      g_object_set_property (G_OBJECT (play->playbin), "flags", &val);
-    else
-      gst_printerr ("Couldn't convert '%s' to playbin flags!\n", flags_string);
-    g_value_unset (&val);
-  }
+  /* string arguments, e.g. SelectTrack's type and track, joined by spaces */
+  if (dbus_message_iter_init (message, &iter)) {
+    do {
+      const char *str;
 
-  if (verbose) {
-    play->deep_notify_id =
-        gst_element_add_property_deep_notify_watch (play->playbin, NULL, TRUE);
+      if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_STRING)
+        continue;
+      dbus_message_iter_get_basic (&iter, &str);
+      if (arg == NULL)
+        arg = g_string_new (str);
+      else
+        g_string_append_printf (arg, " %s", str);
+    } while (dbus_message_iter_next (&iter));
   }
 
-  play->loop = g_main_loop_new (NULL, FALSE);
-
-  play->bus_watch = gst_bus_add_watch (GST_ELEMENT_BUS (play->playbin),
-      play_bus_msg, play);
+  server_push_command (player, type, arg ? arg->str : NULL);
+  if (arg != NULL)
+    g_string_free (arg, TRUE);
 
-  /* FIXME: make configurable incl. 0 for disable */
-  play->timeout = g_timeout_add (100, play_timeout, play);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
 
-  play->buffering = FALSE;
-  play->is_live = FALSE;
+/* one command name per line, same as the D-Bus signal names, optionally
+ * preceded by the number of the player it is for */
+static gboolean
+stdin_command_watch (GIOChannel * channel, GIOCondition condition,
+    gpointer user_data)
+{
+  GstPlayModCommandType type;
+  gchar *line = NULL, *command, *arg;
+  GIOStatus status;
+  gint player = -1;
+
+  status = g_io_channel_read_line (channel, &line, NULL, NULL, NULL);
+  if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR)
+    return G_SOURCE_REMOVE;
+
+  if (line != NULL) {
+    g_strstrip (line);
+    command = line;
+    if (g_ascii_isdigit (*command)) {
+      player = strtol (command, &command, 10);
+      while (g_ascii_isspace (*command))
+        command++;
+    }
 
-  play->desired_state = GST_STATE_PLAYING;
+    /* anything after the command name is its argument */
+    arg = strchr (command, ' ');
+    if (arg != NULL) {
+      *arg++ = '\0';
+      while (g_ascii_isspace (*arg))
+        arg++;
+    }
 
-  play->gapless = gapless;
-  if (gapless) {
-    g_signal_connect (play->playbin, "about-to-finish",
-        G_CALLBACK (play_about_to_finish), play);
+    if (gst_play_mod_command_lookup (command, &type))
+      server_push_command (player, type, arg);
+    else if (line[0] != '\0')
+      gst_printerr ("Unknown command: %s\n", line);
+    g_free (line);
   }
 
-  if (initial_volume != -1)
-    play_set_relative_volume (play, initial_volume - 1.0);
-
-  play->rate = 1.0;
-  play->trick_mode = GST_PLAY_TRICK_MODE_NONE;
-
-  if (initial_rate != -1)
-    play->rate = initial_rate;
-
-  return play;
+  return G_SOURCE_CONTINUE;
 }
 
-static void
-play_free (GstPlay * play)
+static gpointer
+server_io_thread (gpointer user_data)
 {
-  /* No need to see all those pad caps going to NULL etc., it's just noise */
-  if (play->deep_notify_id != 0)
-    g_signal_handler_disconnect (play->playbin, play->deep_notify_id);
+  g_main_context_push_thread_default (io_context);
+  g_main_loop_run (io_loop);
+  g_main_context_pop_thread_default (io_context);
 
-  play_reset (play);
-
-  gst_element_set_state (play->playbin, GST_STATE_NULL);
-  gst_object_unref (play->playbin);
-
-  g_source_remove (play->bus_watch);
-  g_source_remove (play->timeout);
-  g_main_loop_unref (play->loop);
-
-  g_strfreev (play->uris);
-
-  if (play->collection)
-    gst_object_unref (play->collection);
-  g_free (play->cur_audio_sid);
-  g_free (play->cur_video_sid);
-  g_free (play->cur_text_sid);
-
-  g_mutex_clear (&play->selection_lock);
-
-  g_free (play);
+  return NULL;
 }
 
-/* reset for new file/stream */
 static void
-play_reset (GstPlay * play)
+notify_append (DBusMessageIter * dict, const char *key, int type,
+    const void *value)
 {
-  play->buffering = FALSE;
-  play->is_live = FALSE;
+  DBusMessageIter entry, variant;
+  char signature[2] = { type, '\0' };
+
+  dbus_message_iter_open_container (dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+  dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &key);
+  dbus_message_iter_open_container (&entry, DBUS_TYPE_VARIANT, signature,
+      &variant);
+  dbus_message_iter_append_basic (&variant, type, value);
+  dbus_message_iter_close_container (&entry, &variant);
+  dbus_message_iter_close_container (dict, &entry);
 }
 
-static void
-play_set_relative_volume (GstPlay * play, gdouble volume_step)
+/* sends a Changed signal with everything that changed, on the I/O thread */
+static gboolean
+notify_flush (gpointer user_data)
 {
-  gdouble volume;
+  guint i = GPOINTER_TO_UINT (user_data);
+  PlayerNotify *n = &notify[i];
+  DBusMessageIter iter, dict;
+  DBusMessage *message;
+  gchar *path;
 
-  volume = gst_stream_volume_get_volume (GST_STREAM_VOLUME (play->playbin),
-      GST_STREAM_VOLUME_FORMAT_CUBIC);
+  path = g_strdup_printf ("%s/%u", OBJECT_PATH, i);
+  message = dbus_message_new_signal (path, INTERFACE_NAME ".Events",
+      "Changed");
+  g_free (path);
 
-  volume = round ((volume + volume_step) * VOLUME_STEPS) / VOLUME_STEPS;
-  volume = CLAMP (volume, 0.0, 10.0);
+  dbus_message_iter_init_append (message, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
 
-  gst_stream_volume_set_volume (GST_STREAM_VOLUME (play->playbin),
-      GST_STREAM_VOLUME_FORMAT_CUBIC, volume);
+  g_mutex_lock (&notify_lock);
+  if (n->dirty & NOTIFY_STATE) {
+    const char *state = gst_element_state_get_name (n->state);
 
-  gst_print ("Volume: %.0f%%", volume * 100);
-  gst_print ("                  \n");
-}
+    notify_append (&dict, "State", DBUS_TYPE_STRING, &state);
+  }
+  if (n->dirty & NOTIFY_ITEM) {
+    const char *uri = n->uri ? n->uri : "";
 
-static void
-play_toggle_audio_mute (GstPlay * play)
-{
-  gboolean mute;
+    notify_append (&dict, "Index", DBUS_TYPE_INT32, &n->index);
+    notify_append (&dict, "Uri", DBUS_TYPE_STRING, &uri);
+  }
+  if (n->dirty & NOTIFY_RATE) {
+    notify_append (&dict, "Rate", DBUS_TYPE_DOUBLE, &n->rate);
+    notify_append (&dict, "TrickMode", DBUS_TYPE_INT32, &n->trick_mode);
+  }
+  if (n->dirty & NOTIFY_VOLUME) {
+    dbus_bool_t mute = n->mute;
 
-  mute = gst_stream_volume_get_mute (GST_STREAM_VOLUME (play->playbin));
+    notify_append (&dict, "Volume", DBUS_TYPE_DOUBLE, &n->volume);
+    notify_append (&dict, "Mute", DBUS_TYPE_BOOLEAN, &mute);
+  }
+  if (n->dirty & NOTIFY_TRACKS) {
+    notify_append (&dict, "AudioTrack", DBUS_TYPE_INT32, &n->tracks[0]);
+    notify_append (&dict, "VideoTrack", DBUS_TYPE_INT32, &n->tracks[1]);
+    notify_append (&dict, "SubtitleTrack", DBUS_TYPE_INT32, &n->tracks[2]);
+  }
+  if (n->dirty & NOTIFY_BUFFERING)
+    notify_append (&dict, "Buffering", DBUS_TYPE_INT32, &n->buffering);
+  if (n->dirty & NOTIFY_POSITION) {
+    notify_append (&dict, "Position", DBUS_TYPE_INT64, &n->position);
+    notify_append (&dict, "Duration", DBUS_TYPE_INT64, &n->duration);
+  }
+  n->dirty = 0;
+  n->scheduled = FALSE;
+  g_mutex_unlock (&notify_lock);
 
-  mute = !mute;
-  gst_stream_volume_set_mute (GST_STREAM_VOLUME (play->playbin), mute);
+  dbus_message_iter_close_container (&iter, &dict);
+  dbus_connection_send (server_connection, message, NULL);
+  dbus_message_unref (message);
 
-  if (mute)
-    gst_print ("Mute: on");
-  else
-    gst_print ("Mute: off");
-  gst_print ("                  \n");
+  return G_SOURCE_REMOVE;
 }
 
-static gboolean
-play_bus_msg (GstBus * bus, GstMessage * msg, gpointer user_data)
+/* called on the main thread; changes within notify_interval of the first
+ * one go out together */
+static void
+notify_update (guint i, const GstPlayModEvent * event)
 {
-  GstPlay *play = user_data;
-
-  if (gst_is_video_overlay_prepare_window_handle_message (msg))
-    create_window (bus, msg, GST_PIPELINE (play->playbin));
-
-  switch (GST_MESSAGE_TYPE (msg)) {
-    case GST_MESSAGE_ASYNC_DONE:
-
-      /* dump graph on preroll */
-      GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (play->playbin),
-          GST_DEBUG_GRAPH_SHOW_ALL, "gst-play.async-done");
-
-      gst_print ("Prerolled.\r");
-      break;
-    case GST_MESSAGE_BUFFERING:{
-      gint percent;
-
-      if (!play->buffering)
-        gst_print ("\n");
-
-      gst_message_parse_buffering (msg, &percent);
-      gst_print ("%s %d%%  \r", "Buffering...", percent);
-
-      if (percent == 100) {
-        /* a 100% message means buffering is done */
-        if (play->buffering) {
-          play->buffering = FALSE;
-          /* no state management needed for live pipelines */
-          if (!play->is_live)
-            gst_element_set_state (play->playbin, GST_STATE_PLAYING);
-        }
-      } else {
-        /* buffering... */
-        if (!play->buffering) {
-          if (!play->is_live)
-            gst_element_set_state (play->playbin, GST_STATE_PAUSED);
-          play->buffering = TRUE;
-        }
-      }
-      break;
-    }
-    case GST_MESSAGE_CLOCK_LOST:{
-      gst_print ("Clock lost, selecting a new one\n");
-      gst_element_set_state (play->playbin, GST_STATE_PAUSED);
-      gst_element_set_state (play->playbin, GST_STATE_PLAYING);
-      break;
-    }
-    case GST_MESSAGE_LATENCY:
-      gst_print ("Redistribute latency...\n");
-      gst_bin_recalculate_latency (GST_BIN (play->playbin));
-      break;
-    case GST_MESSAGE_REQUEST_STATE:{
-      GstState state;
-      gchar *name;
+  PlayerNotify *n;
+  GSource *source;
 
-      name = gst_object_get_path_string (GST_MESSAGE_SRC (msg));
-
-      gst_message_parse_request_state (msg, &state);
-
-      gst_print ("Setting state to %s as requested by %s...\n",
-          gst_element_state_get_name (state), name);
+  if (notify == NULL || io_context == NULL)
+    return;
 
-      gst_element_set_state (play->playbin, state);
-      g_free (name);
+  n = &notify[i];
+  g_mutex_lock (&notify_lock);
+  switch (event->type) {
+    case GST_PLAY_MOD_EVENT_ITEM_STARTED:
+      n->index = event->index;
+      g_free (n->uri);
+      n->uri = g_strdup (event->uri);
+      n->dirty |= NOTIFY_ITEM;
       break;
-    }
-    case GST_MESSAGE_EOS:
-      /* print final position at end */
-      play_timeout (play);
-      gst_print ("\n");
-      /* and switch to next item in list */
-      if (!play_next (play)) {
-        gst_print ("%s\n", "Reached end of play list.");
-        g_main_loop_quit (play->loop);
-      }
+    case GST_PLAY_MOD_EVENT_STATE_CHANGED:
+      n->state = event->state;
+      n->dirty |= NOTIFY_STATE;
       break;
-    case GST_MESSAGE_WARNING:{
-      GError *err;
-      gchar *dbg = NULL;
-
-      /* dump graph on warning */
-      GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (play->playbin),
-          GST_DEBUG_GRAPH_SHOW_ALL, "gst-play.warning");
-
-      gst_message_parse_warning (msg, &err, &dbg);
-      gst_printerr ("WARNING %s\n", err->message);
-      if (dbg != NULL)
-        gst_printerr ("WARNING debug information: %s\n", dbg);
-      g_clear_error (&err);
-      g_free (dbg);
+    case GST_PLAY_MOD_EVENT_BUFFERING:
+      n->buffering = event->percent;
+      n->dirty |= NOTIFY_BUFFERING;
       break;
-    }
-    case GST_MESSAGE_ERROR:{
-      GError *err;
-      gchar *dbg;
-
-      /* dump graph on error */
-      GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (play->playbin),
-          GST_DEBUG_GRAPH_SHOW_ALL, "gst-play.error");
-
-      gst_message_parse_error (msg, &err, &dbg);
-      gst_printerr ("ERROR %s for %s\n", err->message,
-          play->uris[play->cur_idx]);
-      if (dbg != NULL)
-        gst_printerr ("ERROR debug information: %s\n", dbg);
-      g_clear_error (&err);
-      g_free (dbg);
-
-      /* flush any other error messages from the bus and clean up */
-      gst_element_set_state (play->playbin, GST_STATE_NULL);
-
-      /* try next item in list then */
-      if (!play_next (play)) {
-        gst_print ("%s\n", "Reached end of play list.");
-        g_main_loop_quit (play->loop);
-      }
+    case GST_PLAY_MOD_EVENT_RATE_CHANGED:
+      n->rate = event->rate;
+      n->trick_mode = event->trick_mode;
+      n->dirty |= NOTIFY_RATE;
       break;
-    }
-
-    case GST_MESSAGE_PROPERTY_NOTIFY:{
-      const GValue *val;
-      const gchar *name;
-      GstObject *obj;
-      gchar *val_str = NULL;
-      gchar *obj_name;
-
-      gst_message_parse_property_notify (msg, &obj, &name, &val);
-
-      obj_name = gst_object_get_path_string (GST_OBJECT (obj));
-      if (val != NULL) {
-        if (G_VALUE_HOLDS_STRING (val))
-          val_str = g_value_dup_string (val);
-        else if (G_VALUE_TYPE (val) == GST_TYPE_CAPS)
-          val_str = gst_caps_to_string (g_value_get_boxed (val));
-        else if (G_VALUE_TYPE (val) == GST_TYPE_TAG_LIST)
-          val_str = gst_tag_list_to_string (g_value_get_boxed (val));
-        else
-          val_str = gst_value_serialize (val);
-      } else {
-        val_str = g_strdup ("(no value)");
-      }
-
-      gst_play_printf ("%s: %s = %s\n", obj_name, name, val_str);
-      g_free (obj_name);
-      g_free (val_str);
+    case GST_PLAY_MOD_EVENT_VOLUME_CHANGED:
+      n->volume = event->volume;
+      n->mute = event->mute;
+      n->dirty |= NOTIFY_VOLUME;
       break;
-    }
-    case GST_MESSAGE_STREAM_COLLECTION:
-    {
-      GstStreamCollection *collection = NULL;
-      gst_message_parse_stream_collection (msg, &collection);
-
-      if (collection) {
-        g_mutex_lock (&play->selection_lock);
-        gst_object_replace ((GstObject **) & play->collection,
-            (GstObject *) collection);
-        g_mutex_unlock (&play->selection_lock);
-      }
+    case GST_PLAY_MOD_EVENT_TRACKS_CHANGED:
+      n->tracks[0] = event->audio_track;
+      n->tracks[1] = event->video_track;
+      n->tracks[2] = event->subtitle_track;
+      n->dirty |= NOTIFY_TRACKS;
       break;
-    }
-    case GST_MESSAGE_STREAMS_SELECTED:
-    {
-      GstStreamCollection *collection = NULL;
-      guint i, len;
-
-      gst_message_parse_streams_selected (msg, &collection);
-      if (collection) {
-        g_mutex_lock (&play->selection_lock);
-        gst_object_replace ((GstObject **) & play->collection,
-            (GstObject *) collection);
-
-        /* Free all last stream-ids */
-        g_free (play->cur_audio_sid);
-        g_free (play->cur_video_sid);
-        g_free (play->cur_text_sid);
-        play->cur_audio_sid = NULL;
-        play->cur_video_sid = NULL;
-        play->cur_text_sid = NULL;
-
-        len = gst_message_streams_selected_get_size (msg);
-        for (i = 0; i < len; i++) {
-          GstStream *stream = gst_message_streams_selected_get_stream (msg, i);
-          if (stream) {
-            GstStreamType type = gst_stream_get_stream_type (stream);
-            const gchar *stream_id = gst_stream_get_stream_id (stream);
-
-            if (type & GST_STREAM_TYPE_AUDIO) {
-              play->cur_audio_sid = g_strdup (stream_id);
-            } else if (type & GST_STREAM_TYPE_VIDEO) {
-              play->cur_video_sid = g_strdup (stream_id);
-            } else if (type & GST_STREAM_TYPE_TEXT) {
-              play->cur_text_sid = g_strdup (stream_id);
-            } else {
-              gst_print ("Unknown stream type with stream-id %s", stream_id);
-            }
-            gst_object_unref (stream);
-          }
-        }
-
-        gst_object_unref (collection);
-        g_mutex_unlock (&play->selection_lock);
-      }
+    case GST_PLAY_MOD_EVENT_POSITION:
+      n->position = event->position;
+      n->duration = event->duration;
+      n->dirty |= NOTIFY_POSITION;
       break;
-    }
     default:
       break;
   }
 
-  return TRUE;
+  if (n->dirty != 0 && !n->scheduled) {
+    n->scheduled = TRUE;
+    source = g_timeout_source_new (MAX (notify_interval, 0));
+    g_source_set_callback (source, notify_flush, GUINT_TO_POINTER (i), NULL);
+    g_source_attach (source, io_context);
+    g_source_unref (source);
+  }
+  g_mutex_unlock (&notify_lock);
 }
 
 static gboolean
-play_timeout (gpointer user_data)
+server_setup(gboolean stdin_commands)
 {
-  GstPlay *play = user_data;
-  gint64 pos = -1, dur = -1;
-  const gchar *paused = "Paused";
-  gchar *status;
-
-  if (play->buffering)
-    return TRUE;
-
-  gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos);
-  gst_element_query_duration (play->playbin, GST_FORMAT_TIME, &dur);
-
-  gint len = g_utf8_strlen (paused, -1);
-  status = g_newa (gchar, len + 1);
-  memset (status, ' ', len);
-  status[len] = '\0';
-
-  if (pos >= 0 && dur > 0) {
-    gchar dstr[32], pstr[32];
-
-    /* FIXME: pretty print in nicer format */
-    g_snprintf (pstr, 32, "%" GST_TIME_FORMAT, GST_TIME_ARGS (pos));
-    pstr[9] = '\0';
-    g_snprintf (dstr, 32, "%" GST_TIME_FORMAT, GST_TIME_ARGS (dur));
-    dstr[9] = '\0';
-    gst_print ("%s / %s %s\r", pstr, dstr, status);
-  }
+  DBusConnection *connection;
+  DBusError error;
+  int rv;
 
-  return TRUE;
-}
+  /* the connection is set up here and used from the I/O thread */
+  dbus_threads_init_default ();
+  dbus_error_init (&error);
 
-static gchar *
-play_uri_get_display_name (GstPlay * play, const gchar * uri)
-{
-  gchar *loc;
+  connection = dbus_bus_get(DBUS_BUS_SESSION, &error);
+  if (!connection) {
+    gst_printerr ("Failed to get a session DBus connection: %s\n", error.message);
+    dbus_error_free (&error);
+    return FALSE;
+  }
 
-  if (gst_uri_has_protocol (uri, "file")) {
-    loc = g_filename_from_uri (uri, NULL, NULL);
-  } else if (gst_uri_has_protocol (uri, "pushfile")) {
-    loc = g_filename_from_uri (uri + 4, NULL, NULL);
-  } else {
-    loc = g_strdup (uri);
+  /* commands are signals, so a second instance (e.g. a sync slave on the
+   * same machine) still gets them without owning the name */
+  rv = dbus_bus_request_name(connection, INTERFACE_NAME, DBUS_NAME_FLAG_REPLACE_EXISTING , &error);
+  if (rv != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+    gst_printerr ("Could not own %s on the bus, listening anyway\n",
+        INTERFACE_NAME);
+    dbus_error_free (&error);
+    dbus_error_init (&error);
   }
 
-  /* Maybe additionally use glib's filename to display name function */
-  return loc;
-}
+  dbus_bus_add_match (connection, "type='signal',interface='com.noisolation.MediaPlayer'", &error);
+  if (dbus_error_is_set (&error)) {
+    gst_printerr ("Failed to add match: %s\n", error.message);
+    dbus_error_free (&error);
+    return FALSE;
+  }
 
-static void
-play_uri (GstPlay * play, const gchar * next_uri)
-{
-  gchar *loc;
+  if (!dbus_connection_add_filter (connection, server_message_handler, NULL, NULL)) {
+    gst_printerr ("Failed to add filter: %s\n", error.message);
+    dbus_error_free (&error);
+    return FALSE;
+  }
 
-  gst_element_set_state (play->playbin, GST_STATE_READY);
-  play_reset (play);
+  server_connection = connection;
+  notify = g_new0 (PlayerNotify, num_players);
+  io_context = g_main_context_new ();
+  io_loop = g_main_loop_new (io_context, FALSE);
 
-  loc = play_uri_get_display_name (play, next_uri);
-  gst_print ("Now playing %s\n", loc);
-  g_free (loc);
+  dbus_connection_setup_with_g_main (connection, io_context);
 
-  g_object_set (play->playbin, "uri", next_uri, NULL);
+  if (stdin_commands) {
+    GIOChannel *channel = g_io_channel_unix_new (STDIN_FILENO);
+    GSource *source = g_io_create_watch (channel, G_IO_IN | G_IO_HUP);
 
-  switch (gst_element_set_state (play->playbin, GST_STATE_PAUSED)) {
-    case GST_STATE_CHANGE_FAILURE:
-      /* ignore, we should get an error message posted on the bus */
-      break;
-    case GST_STATE_CHANGE_NO_PREROLL:
-      gst_print ("Pipeline is live.\n");
-      play->is_live = TRUE;
-      break;
-    case GST_STATE_CHANGE_ASYNC:
-      gst_print ("Prerolling...\r");
-      break;
-    default:
-      break;
+    g_source_set_callback (source, (GSourceFunc) stdin_command_watch, NULL,
+        NULL);
+    g_source_attach (source, io_context);
+    g_source_unref (source);
+    g_io_channel_unref (channel);
   }
 
-  gst_element_set_state (play->playbin, GST_STATE_PLAYING);
+  io_thread = g_thread_new ("io", server_io_thread, NULL);
 
-  gst_print ("checking state...\r");
-  GstState cur_state;
-  do {
-    gst_element_get_state (play->playbin, &cur_state, NULL, 0);
-  } while (cur_state <= GST_STATE_READY);
-  gst_print ("setting playback rate to %f...\r", play->rate);
-  play_set_playback_rate (play, play->rate);
+  return TRUE;
 }
 
-/* returns FALSE if we have reached the end of the playlist */
-static gboolean
-play_next (GstPlay * play)
+static void
+server_teardown (void)
 {
-  if ((play->cur_idx + 1) >= play->num_uris)
-    return FALSE;
+  guint i;
 
-  play_uri (play, play->uris[++play->cur_idx]);
-  return TRUE;
+  if (io_thread == NULL)
+    return;
+
+  g_main_loop_quit (io_loop);
+  g_thread_join (io_thread);
+  g_main_loop_unref (io_loop);
+  g_main_context_unref (io_context);
+  io_context = NULL;
+
+  for (i = 0; i < num_players; i++)
+    g_free (notify[i].uri);
+  g_free (notify);
+  notify = NULL;
 }
 
-/* returns FALSE if we have reached the beginning of the playlist */
+/* calls @call, a method name followed by its string arguments, on a
+ * running player and prints the report it returns */
 static gboolean
-play_prev (GstPlay * play)
+client_call_method (const gchar * call, gint player)
 {
-  if (play->cur_idx == 0 || play->num_uris <= 1)
-    return FALSE;
+  DBusConnection *connection;
+  DBusMessage *message, *reply;
+  DBusError error;
+  const char *report;
+  const gchar *method;
+  gchar **words;
+  gchar *path;
+  gboolean ret = FALSE;
+  guint i;
 
-  play_uri (play, play->uris[--play->cur_idx]);
-  return TRUE;
-}
+  dbus_error_init (&error);
 
-static void
-play_about_to_finish (GstElement * playbin, gpointer user_data)
-{
-  GstPlay *play = user_data;
-  const gchar *next_uri;
-  gchar *loc;
-  guint next_idx;
+  connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
+  if (!connection) {
+    gst_printerr ("Failed to connect to the D-BUS daemon: %s\n",
+        error.message);
+    dbus_error_free (&error);
+    return FALSE;
+  }
 
-  if (!play->gapless)
-    return;
+  if (player >= 0)
+    path = g_strdup_printf ("%s/%d", OBJECT_PATH, player);
+  else
+    path = g_strdup (OBJECT_PATH);
+
+  words = g_strsplit_set (call, " \t", -1);
+  method = words[0];
+  message = dbus_message_new_method_call (INTERFACE_NAME, path,
+      INTERFACE_NAME, method);
+  g_free (path);
+  for (i = 1; words[i] != NULL; i++) {
+    if (words[i][0] != '\0')
+      dbus_message_append_args (message, DBUS_TYPE_STRING, &words[i],
+          DBUS_TYPE_INVALID);
+  }
 
-  next_idx = play->cur_idx + 1;
-  if (next_idx >= play->num_uris)
-    return;
+  reply = dbus_connection_send_with_reply_and_block (connection, message,
+      DBUS_TIMEOUT_USE_DEFAULT, &error);
+  dbus_message_unref (message);
 
-  next_uri = play->uris[next_idx];
-  loc = play_uri_get_display_name (play, next_uri);
-  gst_print ("About to finish, preparing next title: %s", loc);
-  gst_print ("\n");
-  g_free (loc);
+  if (reply == NULL) {
+    gst_printerr ("%s failed: %s\n", method, error.message);
+    dbus_error_free (&error);
+  } else if (!dbus_message_get_args (reply, &error, DBUS_TYPE_STRING, &report,
+          DBUS_TYPE_INVALID)) {
+    gst_printerr ("Unexpected reply to %s: %s\n", method, error.message);
+    dbus_error_free (&error);
+  } else {
+    gst_print ("%s%s", report, g_str_has_suffix (report, "\n") ? "" : "\n");
+    ret = TRUE;
+  }
+
+  g_strfreev (words);
+  if (reply != NULL)
+    dbus_message_unref (reply);
+  dbus_connection_unref (connection);
 
-  g_object_set (play->playbin, "uri", next_uri, NULL);
-  play->cur_idx = next_idx;
+  return ret;
 }
 
+/* @signal is the command name, optionally followed by its arguments */
 static void
-do_play (GstPlay * play)
+client_send_signal(const char * signal, gint player)
 {
-  gint i;
+  DBusConnection *connection;
+  DBusMessage *message;
+  DBusError error;
+  gchar *path, **words;
+  guint i;
 
-  /* dump playlist */
-  for (i = 0; i < play->num_uris; ++i)
-    GST_INFO ("%4u : %s", i, play->uris[i]);
+  dbus_error_init (&error);
+
+  connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
 
-  if (!play_next (play))
+  if (!connection) {
+    gst_printerr (" Failed to connect to the D-BUS daemon: %s", error.message);
+    dbus_error_free (&error);
     return;
+  }
+
+  if (player >= 0)
+    path = g_strdup_printf ("%s/%d", OBJECT_PATH, player);
+  else
+    path = g_strdup (OBJECT_PATH);
+
+  words = g_strsplit (signal, " ", -1);
+  message = dbus_message_new_signal (path, INTERFACE_NAME, words[0]);
+  g_free (path);
+  if (!message) {
+    gst_printerr("Error creating DBus message\n");
+    g_strfreev (words);
+    dbus_connection_unref(connection);
+    return;
+  }
+  for (i = 1; words[i] != NULL; i++) {
+    if (words[i][0] != '\0')
+      dbus_message_append_args (message, DBUS_TYPE_STRING, &words[i],
+          DBUS_TYPE_INVALID);
+  }
+  g_strfreev (words);
+
+  if (!dbus_connection_send (connection, message, NULL)) {
+    gst_printerr (" Failed to send signal");
+    dbus_error_free (&error);
+    dbus_message_unref (message);
+    dbus_connection_unref (connection);
+    return;
+  }
+
+  dbus_connection_flush (connection);
+  dbus_message_unref (message);
+  dbus_connection_unref (connection);
 
-  g_main_loop_run (play->loop);
+  gst_print (" Signal sendt: %s\n", signal);
 }
 
 static gint
@@ -880,13 +692,29 @@ compare (gconstpointer a, gconstpointer b)
 }
 
 static void
-add_to_playlist (GPtrArray * playlist, const gchar * filename)
+playlist_add (GPtrArray * playlist, GPtrArray * items, gchar * uri,
+    const GstPlayModItem * item)
+{
+  GstPlayModItem *copy = NULL;
+
+  if (item != NULL) {
+    copy = g_new (GstPlayModItem, 1);
+    *copy = *item;
+  }
+
+  g_ptr_array_add (playlist, uri);
+  g_ptr_array_add (items, copy);
+}
+
+static void
+add_to_playlist (GPtrArray * playlist, GPtrArray * items,
+    const gchar * filename, const GstPlayModItem * item)
 {
   GDir *dir;
   gchar *uri;
 
   if (gst_uri_is_valid (filename)) {
-    g_ptr_array_add (playlist, g_strdup (filename));
+    playlist_add (playlist, items, g_strdup (filename), item);
     return;
   }
 
@@ -906,7 +734,7 @@ add_to_playlist (GPtrArray * playlist, const gchar * filename)
     for (l = files; l != NULL; l = l->next) {
       gchar *path = (gchar *) l->data;
 
-      add_to_playlist (playlist, path);
+      add_to_playlist (playlist, items, path, item);
       g_free (path);
     }
     g_list_free (files);
@@ -915,14 +743,39 @@ add_to_playlist (GPtrArray * playlist, const gchar * filename)
 
   uri = gst_filename_to_uri (filename, NULL);
   if (uri != NULL)
-    g_ptr_array_add (playlist, uri);
+    playlist_add (playlist, items, uri, item);
   else
     g_warning ("Could not make URI out of filename '%s'", filename);
 }
 
+/* FILE|URI, optionally followed by |in=TIME|out=TIME|loop=N */
 static void
-shuffle_uris (gchar ** uris, guint num)
+add_entry_to_playlist (GPtrArray * playlist, GPtrArray * items,
+    const gchar * entry, const GstPlayModItem * defaults)
 {
+  const gchar *options = strchr (entry, '|');
+  GstPlayModItem item = *defaults;
+  gchar *location;
+
+  if (options == NULL) {
+    add_to_playlist (playlist, items, entry, NULL);
+    return;
+  }
+
+  location = g_strndup (entry, options - entry);
+  if (gst_play_mod_item_parse (&item, options + 1)) {
+    add_to_playlist (playlist, items, location, &item);
+  } else {
+    g_warning ("Ignoring invalid options in '%s'", entry);
+    add_to_playlist (playlist, items, location, NULL);
+  }
+  g_free (location);
+}
+
+static void
+shuffle_uris (gchar ** uris, GstPlayModItem ** items, guint num)
+{
+  GstPlayModItem *tmp_item;
   gchar *tmp;
   guint i, j;
 
@@ -935,331 +788,260 @@ shuffle_uris (gchar ** uris, guint num)
     tmp = uris[j];
     uris[j] = uris[i];
     uris[i] = tmp;
+    tmp_item = items[j];
+    items[j] = items[i];
+    items[i] = tmp_item;
   }
 }
 
-static void
-toggle_paused (GstPlay * play)
+/* the entries of @playlist_file followed by @filenames, returns how
+ * many there are */
+static guint
+build_playlist (const gchar * playlist_file, gchar ** filenames,
+    const GstPlayModItem * default_item, gboolean shuffle, gchar *** uris,
+    GstPlayModItem *** item_array)
 {
-  if (play->desired_state == GST_STATE_PLAYING)
-    play->desired_state = GST_STATE_PAUSED;
-  else
-    play->desired_state = GST_STATE_PLAYING;
-
-  if (!play->buffering) {
-    gst_element_set_state (play->playbin, play->desired_state);
-  } else if (play->desired_state == GST_STATE_PLAYING) {
-    gst_print ("\nWill play as soon as buffering finishes)\n");
-  }
-}
+  GPtrArray *playlist, *items;
+  GError *err = NULL;
+  guint num, i;
 
-static void
-relative_seek (GstPlay * play, gdouble percent)
-{
-  GstQuery *query;
-  gboolean seekable = FALSE;
-  gint64 dur = -1, pos = -1, step;
+  playlist = g_ptr_array_new ();
+  items = g_ptr_array_new ();
 
-  g_return_if_fail (percent >= -1.0 && percent <= 1.0);
+  if (playlist_file != NULL) {
+    gchar *playlist_contents = NULL;
+    gchar **lines = NULL;
 
-  if (!gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
-    goto seek_failed;
+    if (g_file_get_contents (playlist_file, &playlist_contents, NULL, &err)) {
+      lines = g_strsplit (playlist_contents, "\n", 0);
+      num = g_strv_length (lines);
 
-  query = gst_query_new_seeking (GST_FORMAT_TIME);
-  if (!gst_element_query (play->playbin, query)) {
-    gst_query_unref (query);
-    goto seek_failed;
+      for (i = 0; i < num; i++) {
+        if (lines[i][0] != '\0') {
+          GST_LOG ("Playlist[%d]: %s", i + 1, lines[i]);
+          add_entry_to_playlist (playlist, items, lines[i], default_item);
+        }
+      }
+      g_strfreev (lines);
+      g_free (playlist_contents);
+    } else {
+      gst_printerr ("Could not read playlist: %s\n", err->message);
+      g_clear_error (&err);
+    }
   }
 
-  gst_query_parse_seeking (query, NULL, &seekable, NULL, &dur);
-  gst_query_unref (query);
+  for (i = 0; filenames != NULL && filenames[i] != NULL; ++i) {
+    GST_LOG ("command line argument: %s", filenames[i]);
+    add_entry_to_playlist (playlist, items, filenames[i], default_item);
+  }
 
-  if (!seekable || dur <= 0)
-    goto seek_failed;
+  num = playlist->len;
+  g_ptr_array_add (playlist, NULL);
 
-  step = dur * percent;
-  if (ABS (step) < GST_SECOND)
-    step = (percent < 0) ? -GST_SECOND : GST_SECOND;
+  *uris = (gchar **) g_ptr_array_free (playlist, FALSE);
+  *item_array = (GstPlayModItem **) g_ptr_array_free (items, FALSE);
 
-  pos = pos + step;
-  if (pos > dur) {
-    if (!play_next (play)) {
-      gst_print ("\n%s\n", "Reached end of play list.");
-      g_main_loop_quit (play->loop);
-    }
-  } else {
-    if (pos < 0)
-      pos = 0;
+  if (shuffle)
+    shuffle_uris (*uris, *item_array, num);
 
-    play_do_seek (play, pos, play->rate, play->trick_mode);
-  }
+  return num;
+}
 
-  return;
+/* Soak test: thousands of item switches, seeks, rate changes and track
+ * cycles, with the resources of the process sampled along the way. The
+ * first samples are taken as the baseline once everything is warmed up,
+ * growth beyond the limits at the end fails the run. */
+#define SOAK_SAMPLE_STEPS 100
+#define SOAK_WARMUP_SAMPLES 2
+#define SOAK_MAX_FDS_GROWTH 8
+#define SOAK_MAX_THREADS_GROWTH 8
 
-seek_failed:
-  {
-    gst_print ("\nCould not seek.\n");
-  }
-}
+static const gdouble soak_rates[] = { 1.0, 2.0, 0.5, -1.0, 4.0 };
 
-static gboolean
-play_set_rate_and_trick_mode (GstPlay * play, gdouble rate,
-    GstPlayTrickMode mode)
+typedef struct
 {
-  gint64 pos = -1;
-
-  g_return_val_if_fail (rate != 0, FALSE);
+  guint steps;
+  guint done;
+  guint interval;
+  gint64 max_rss_growth;        /* bytes */
+  GRand *rand;
+  gboolean *backwards;          /* per player, switching items */
+  guint samples;
+  GstPlayModResources baseline;
+  GstPlayModResources last;
+  GstPlayModResources peak;
+  gboolean failed;
+} Soak;
+
+static Soak soak;
 
-  if (!gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
-    return FALSE;
+static void
+soak_sample (void)
+{
+  GstPlayModResources *res = &soak.last;
+
+  gst_play_mod_get_resources (res);
+  soak.samples++;
+
+  if (soak.samples == SOAK_WARMUP_SAMPLES) {
+    soak.baseline = *res;
+    soak.peak = *res;
+  } else if (soak.samples > SOAK_WARMUP_SAMPLES) {
+    soak.peak.resident = MAX (soak.peak.resident, res->resident);
+    soak.peak.fds = MAX (soak.peak.fds, res->fds);
+    soak.peak.threads = MAX (soak.peak.threads, res->threads);
+  }
 
-  return play_do_seek (play, pos, rate, mode);
+  gst_play_mod_log (GST_PLAY_MOD_LOG_INFO,
+      "Soak: step %u/%u, RSS %.1f MB, %u fds, %u threads\n", soak.done,
+      soak.steps, (gdouble) res->resident / (1 << 20), res->fds, res->threads);
 }
 
-static gboolean
-play_do_seek (GstPlay * play, gint64 pos, gdouble rate, GstPlayTrickMode mode)
+/* Compares the last sample with the baseline, peaks are only reported:
+ * pools and caches are allowed to grow for a while as long as they give
+ * it back */
+static void
+soak_finish (void)
 {
-  GstSeekFlags seek_flags;
-  GstQuery *query;
-  GstEvent *seek;
-  gboolean seekable = FALSE;
-
-  query = gst_query_new_seeking (GST_FORMAT_TIME);
-  if (!gst_element_query (play->playbin, query)) {
-    gst_query_unref (query);
-    return FALSE;
+  GstPlayModResources *base = &soak.baseline, *last = &soak.last;
+  gint64 rss_growth;
+
+  soak_sample ();
+  rss_growth = last->resident - base->resident;
+
+  gst_play_mod_log (GST_PLAY_MOD_LOG_INFO,
+      "Soak: %u steps, RSS %+.1f MB (peak %.1f MB), "
+      "fds %+d (peak %u), threads %+d (peak %u)\n", soak.done,
+      (gdouble) rss_growth / (1 << 20),
+      (gdouble) soak.peak.resident / (1 << 20),
+      (gint) last->fds - (gint) base->fds, soak.peak.fds,
+      (gint) last->threads - (gint) base->threads, soak.peak.threads);
+
+  if (soak.samples <= SOAK_WARMUP_SAMPLES) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_ERROR,
+        "Soak: too few steps for a baseline\n");
+    soak.failed = TRUE;
   }
-
-  gst_query_parse_seeking (query, NULL, &seekable, NULL, NULL);
-  gst_query_unref (query);
-
-  if (!seekable)
-    return FALSE;
-
-  seek_flags = GST_SEEK_FLAG_FLUSH;
-
-  switch (mode) {
-    case GST_PLAY_TRICK_MODE_DEFAULT:
-      seek_flags |= GST_SEEK_FLAG_TRICKMODE;
-      break;
-    case GST_PLAY_TRICK_MODE_DEFAULT_NO_AUDIO:
-      seek_flags |= GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
-      break;
-    case GST_PLAY_TRICK_MODE_KEY_UNITS:
-      seek_flags |= GST_SEEK_FLAG_TRICKMODE_KEY_UNITS;
-      break;
-    case GST_PLAY_TRICK_MODE_KEY_UNITS_NO_AUDIO:
-      seek_flags |=
-          GST_SEEK_FLAG_TRICKMODE_KEY_UNITS | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
-      break;
-    case GST_PLAY_TRICK_MODE_NONE:
-    default:
-      break;
+  if (rss_growth > soak.max_rss_growth) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_ERROR, "Soak: RSS grew by more than %"
+        G_GINT64_FORMAT " MB\n", soak.max_rss_growth >> 20);
+    soak.failed = TRUE;
+  }
+  /* X connections the sinks leak are among them */
+  if (last->fds > base->fds + SOAK_MAX_FDS_GROWTH) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_ERROR,
+        "Soak: leaking file descriptors\n");
+    soak.failed = TRUE;
+  }
+  if (last->threads > base->threads + SOAK_MAX_THREADS_GROWTH) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_ERROR, "Soak: leaking threads\n");
+    soak.failed = TRUE;
   }
 
-  if (rate >= 0)
-    seek = gst_event_new_seek (rate, GST_FORMAT_TIME,
-        seek_flags | GST_SEEK_FLAG_ACCURATE,
-        /* start */ GST_SEEK_TYPE_SET, pos,
-        /* stop */ GST_SEEK_TYPE_SET, GST_CLOCK_TIME_NONE);
-  else
-    seek = gst_event_new_seek (rate, GST_FORMAT_TIME,
-        seek_flags | GST_SEEK_FLAG_ACCURATE,
-        /* start */ GST_SEEK_TYPE_SET, 0,
-        /* stop */ GST_SEEK_TYPE_SET, pos);
-
-  if (!gst_element_send_event (play->playbin, seek))
-    return FALSE;
-
-  play->rate = rate;
-  play->trick_mode = mode;
-  return TRUE;
+  gst_play_mod_log (GST_PLAY_MOD_LOG_INFO, "Soak: %s\n",
+      soak.failed ? "FAILED" : "passed");
+  g_main_loop_quit (main_loop);
 }
 
+/* ping-pong through the playlist, so it never ends */
 static void
-play_set_playback_rate (GstPlay * play, gdouble rate)
+soak_switch_item (guint i)
 {
-  if (play_set_rate_and_trick_mode (play, rate, play->trick_mode)) {
-    gst_print ("Playback rate: %.2f", rate);
-    gst_print ("                               \n");
-  } else {
-    gst_print ("\n");
-    gst_print ("Could not change playback rate to %.2f", rate);
-    gst_print (".\n");
+  if (soak.backwards[i] ? !gst_play_mod_prev (players[i]) :
+      !gst_play_mod_next (players[i])) {
+    soak.backwards[i] = !soak.backwards[i];
+    if (soak.backwards[i])
+      gst_play_mod_prev (players[i]);
+    else
+      gst_play_mod_next (players[i]);
   }
 }
 
-static void
-play_set_relative_playback_rate (GstPlay * play, gdouble rate_step,
-    gboolean reverse_direction)
+/* on the main thread, where the players run */
+static gboolean
+soak_step (gpointer user_data)
 {
-  gdouble new_rate = play->rate + rate_step;
+  guint i;
+
+  for (i = 0; i < num_players; i++) {
+    GstPlayMod *play = players[i];
+
+    switch (g_rand_int_range (soak.rand, 0, 8)) {
+      case 0:
+      case 1:
+        soak_switch_item (i);
+        break;
+      case 2:
+      case 3:
+        gst_play_mod_relative_seek (play,
+            g_rand_double_range (soak.rand, -0.5, 0.5));
+        break;
+      case 4:
+        gst_play_mod_set_playback_rate (play,
+            soak_rates[g_rand_int_range (soak.rand, 0,
+            G_N_ELEMENTS (soak_rates))]);
+        break;
+      case 5:
+        gst_play_mod_cycle_track_selection (play,
+            GST_PLAY_MOD_TRACK_TYPE_AUDIO);
+        break;
+      case 6:
+        gst_play_mod_cycle_track_selection (play,
+            GST_PLAY_MOD_TRACK_TYPE_SUBTITLE);
+        break;
+      case 7:
+        gst_play_mod_toggle_paused (play);
+        break;
+    }
+  }
 
-  if (reverse_direction)
-    new_rate *= -1.0;
+  soak.done++;
+  if (soak.done % SOAK_SAMPLE_STEPS == 0)
+    soak_sample ();
 
-  play_set_playback_rate (play, new_rate);
-}
+  if (soak.done < soak.steps)
+    return G_SOURCE_CONTINUE;
 
-static const gchar *
-trick_mode_get_description (GstPlayTrickMode mode)
-{
-  switch (mode) {
-    case GST_PLAY_TRICK_MODE_NONE:
-      return "normal playback, trick modes disabled";
-    case GST_PLAY_TRICK_MODE_DEFAULT:
-      return "trick mode: default";
-    case GST_PLAY_TRICK_MODE_DEFAULT_NO_AUDIO:
-      return "trick mode: default, no audio";
-    case GST_PLAY_TRICK_MODE_KEY_UNITS:
-      return "trick mode: key frames only";
-    case GST_PLAY_TRICK_MODE_KEY_UNITS_NO_AUDIO:
-      return "trick mode: key frames only, no audio";
-    default:
-      break;
-  }
-  return "unknown trick mode";
+  soak_finish ();
+  return G_SOURCE_REMOVE;
 }
 
-static GstPlayTrickMode
-play_next_trick_mode (GstPlayTrickMode trick_mode)
+static void
+soak_start (guint steps, guint interval, guint max_rss_growth)
 {
-  switch (trick_mode) {
-  case GST_PLAY_TRICK_MODE_NONE:
-    return GST_PLAY_TRICK_MODE_DEFAULT;
-  case GST_PLAY_TRICK_MODE_DEFAULT:
-    return GST_PLAY_TRICK_MODE_DEFAULT_NO_AUDIO;
-  case GST_PLAY_TRICK_MODE_DEFAULT_NO_AUDIO:
-    return GST_PLAY_TRICK_MODE_KEY_UNITS;
-  case GST_PLAY_TRICK_MODE_KEY_UNITS:
-    return GST_PLAY_TRICK_MODE_KEY_UNITS_NO_AUDIO;
-  case GST_PLAY_TRICK_MODE_KEY_UNITS_NO_AUDIO:
-    return GST_PLAY_TRICK_MODE_LAST;
-  case GST_PLAY_TRICK_MODE_LAST:
-    break;
-  }
-  return GST_PLAY_TRICK_MODE_NONE;
+  soak.steps = steps;
+  soak.interval = MAX (interval, 1);
+  soak.max_rss_growth = (gint64) max_rss_growth << 20;
+  /* the same sequence every run, to reproduce a failure */
+  soak.rand = g_rand_new_with_seed (steps);
+  soak.backwards = g_new0 (gboolean, num_players);
+
+  gst_play_mod_log (GST_PLAY_MOD_LOG_INFO, "Soak: %u steps every %u ms\n",
+      steps, soak.interval);
+  g_timeout_add (soak.interval, soak_step, NULL);
 }
 
 static void
-play_switch_trick_mode (GstPlay * play)
+soak_free (void)
 {
-  GstPlayTrickMode new_mode;
-  const gchar *mode_desc;
-
-  play->trick_mode = play_next_trick_mode( play->trick_mode );
-  new_mode = play->trick_mode;
-
-  if (new_mode == GST_PLAY_TRICK_MODE_LAST)
-    new_mode = GST_PLAY_TRICK_MODE_NONE;
-
-  mode_desc = trick_mode_get_description (new_mode);
-
-  if (play_set_rate_and_trick_mode (play, play->rate, new_mode)) {
-    gst_print ("Rate: %.2f (%s)                      \n", play->rate,
-        mode_desc);
-  } else {
-    gst_print ("\nCould not change trick mode to %s.\n", mode_desc);
-  }
+  g_clear_pointer (&soak.rand, g_rand_free);
+  g_clear_pointer (&soak.backwards, g_free);
 }
 
 static void
-play_cycle_track_selection (GstPlay * play, GstPlayTrackType track_type)
+player_event (GstPlayMod * play, const GstPlayModEvent * event,
+    gpointer user_data)
 {
-  const gchar *prop_cur, *prop_n, *prop_get, *name;
-  gint cur = -1, n = -1;
-  guint flag, cur_flags;
-
-  /* playbin3 variables */
-  GList *selected_streams = NULL;
-
-  switch (track_type) {
-    case GST_PLAY_TRACK_TYPE_AUDIO:
-      prop_get = "get-audio-tags";
-      prop_cur = "current-audio";
-      prop_n = "n-audio";
-      name = "audio";
-      flag = 0x2;
-      break;
-    case GST_PLAY_TRACK_TYPE_VIDEO:
-      prop_get = "get-video-tags";
-      prop_cur = "current-video";
-      prop_n = "n-video";
-      name = "video";
-      flag = 0x1;
-      break;
-    case GST_PLAY_TRACK_TYPE_SUBTITLE:
-      prop_get = "get-text-tags";
-      prop_cur = "current-text";
-      prop_n = "n-text";
-      name = "subtitle";
-      flag = 0x4;
-      break;
-    default:
-      return;
-  }
-
-  g_object_get (play->playbin, prop_cur, &cur, prop_n, &n, "flags",
-      &cur_flags, NULL);
+  notify_update (GPOINTER_TO_UINT (user_data), event);
 
-  if (!(cur_flags & flag))
-    cur = 0;
-  else
-    cur = (cur + 1) % (n + 1);
-
-  if (n < 1) {
-    gst_print ("No %s tracks.\n", name);
-    g_mutex_unlock (&play->selection_lock);
-  } else {
-    gchar *lcode = NULL, *lname = NULL;
-    const gchar *lang = NULL;
-    GstTagList *tags = NULL;
-
-    if (cur >= n && track_type != GST_PLAY_TRACK_TYPE_VIDEO) {
-      cur = -1;
-      gst_print ("Disabling %s.           \n", name);
-      if (cur_flags & flag) {
-        cur_flags &= ~flag;
-        g_object_set (play->playbin, "flags", cur_flags, NULL);
-      }
-    } else {
-      /* For video we only want to switch between streams, not disable it altogether */
-      if (cur >= n)
-        cur = 0;
-
-      if (!(cur_flags & flag) && track_type != GST_PLAY_TRACK_TYPE_VIDEO) {
-        cur_flags |= flag;
-        g_object_set (play->playbin, "flags", cur_flags, NULL);
-      }
-      g_signal_emit_by_name (play->playbin, prop_get, cur, &tags);
-
-      if (tags != NULL) {
-        if (gst_tag_list_get_string (tags, GST_TAG_LANGUAGE_NAME, &lname))
-          lang = lname;
-        gst_tag_list_unref (tags);
-      }
-      if (lang != NULL)
-        gst_print ("Switching to %s track %d of %d (%s).\n", name, cur + 1, n,
-            lang);
-      else
-        gst_print ("Switching to %s track %d of %d.\n", name, cur + 1, n);
-    }
-    g_free (lcode);
-    g_free (lname);
-    g_mutex_unlock (&play->selection_lock);
-
-    g_object_set (play->playbin, prop_cur, cur, NULL);
-  }
-
-  if (selected_streams)
-    g_list_free (selected_streams);
+  if (event->type == GST_PLAY_MOD_EVENT_STOPPED && --players_running == 0)
+    g_main_loop_quit (main_loop);
 }
 
 int
 main (int argc, char **argv)
 {
-  GstPlay *play;
-  GPtrArray *playlist;
+  GstPlayMod *play;
   gboolean verbose = FALSE;
   gboolean print_version = FALSE;
   gboolean gapless = FALSE;
@@ -1272,10 +1054,64 @@ main (int argc, char **argv)
   gchar **uris;
   gchar *flags = NULL;
   guint num, i;
+  gchar **outputs = NULL;
+  gint player = -1;
   GError *err = NULL;
   GOptionContext *ctx;
   gchar *playlist_file = NULL;
   gchar *emit = NULL;
+  gchar *call = NULL;
+  gchar *tuning_file = NULL;
+  gchar **set_properties = NULL;
+  gint max_threads = -1;
+  gboolean decoder_low_latency = FALSE;
+  gint queue_max_buffers = -1;
+  gint queue_max_bytes = -1;
+  gint64 queue_max_time = -1;
+  gint buffer_size = -1;
+  gint64 buffer_duration = -1;
+  gboolean dump_tuning = FALSE;
+  gboolean low_latency = FALSE;
+  gint latency_target = -1;
+  gint buffer_low = -1;
+  gint buffer_high = -1;
+  gchar *cache_dir = NULL;
+  gint cache_size = 0;
+  gint64 cache_max_age = 24 * 60 * 60;
+  gint probe_ahead = 0;
+  gboolean stdin_commands = FALSE;
+  gint timeshift_size = 0;
+  gchar *timeshift_dir = NULL;
+  gdouble catchup_rate = 1.5;
+  gchar *in_point = NULL;
+  gchar *out_point = NULL;
+  gint loops = 1;
+  gint mosaic = -1;
+  gint sync_master = 0;
+  gchar *sync_slave = NULL;
+  gint sync_delay = 1000;
+  gint position_interval = 1000;
+  gint idle_release = 0;
+  gint fade = 0;
+  gint soak_steps = 0;
+  gint soak_interval = 100;
+  gint soak_max_rss = 32;
+  gint thumbnails = 0;
+  gint thumbnail_width = 160;
+  gboolean resume = FALSE;
+  gchar *resume_file = NULL;
+  gint retries = 3;
+  gint stall_timeout = 10000;
+  gchar *when_hidden = NULL;
+  gboolean downscale = FALSE;
+  gboolean playbin3 = FALSE;
+  gboolean frame_pacing = FALSE;
+  gchar *log_level = NULL;
+  gboolean log_json = FALSE;
+  GstPlayModHiddenVideo hidden_video = GST_PLAY_MOD_HIDDEN_VIDEO_KEYFRAMES;
+  GstPlayModItem default_item;
+  GstPlayModItem **item_array;
+  GstPlayModTuning tuning;
   GOptionEntry options[] = {
     {"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
         "Output status information and property notifications", NULL},
@@ -1290,6 +1126,17 @@ main (int argc, char **argv)
         "Audio sink to use (default is autoaudiosink)", NULL},
     {"gapless", 0, 0, G_OPTION_ARG_NONE, &gapless,
         "Enable gapless playback", NULL},
+    {"fade", 0, 0, G_OPTION_ARG_INT, &fade,
+        "Fade every item in and out over this many ms (default 0 = none)",
+        "MS"},
+    {"soak", 0, 0, G_OPTION_ARG_INT, &soak_steps,
+        "Soak test: switch items, seek, change rates and tracks this many "
+        "times, then fail if resources kept growing", "STEPS"},
+    {"soak-interval", 0, 0, G_OPTION_ARG_INT, &soak_interval,
+        "Time between soak test steps in ms (default 100)", "MS"},
+    {"soak-max-rss", 0, 0, G_OPTION_ARG_INT, &soak_max_rss,
+        "How much the resident size may grow during the soak test "
+        "(default 32)", "MB"},
     {"shuffle", 0, 0, G_OPTION_ARG_NONE, &shuffle,
         "Shuffle playlist", NULL},
     {"volume", 0, 0, G_OPTION_ARG_DOUBLE, &volume,
@@ -1302,6 +1149,123 @@ main (int argc, char **argv)
         "Do not print any output (apart from errors)", NULL},
     {"emit", 0, 0, G_OPTION_ARG_STRING, &emit,
         "Emit a dbus signal (requires running player)", NULL},
+    {"call", 0, 0, G_OPTION_ARG_STRING, &call,
+        "Call a dbus method, e.g. GetFramePacing or 'Snapshot FILE', and "
+        "print the result (requires running player)", "METHOD"},
+    {"player", 0, 0, G_OPTION_ARG_INT, &player,
+        "Send the signal or method call to this player only (default all)", "N"},
+    {"output", 0, 0, G_OPTION_ARG_STRING_ARRAY, &outputs,
+        "Add a player on a RandR output or WIDTHxHEIGHT+X+Y region, playing "
+        "its own playlist file if given", "OUTPUT[=PLAYLIST]"},
+    {"tuning", 0, 0, G_OPTION_ARG_FILENAME, &tuning_file,
+        "Key file with decoder, queue and buffering tuning", "FILE"},
+    {"max-threads", 0, 0, G_OPTION_ARG_INT, &max_threads,
+        "Number of decoder threads (0 = automatic)", "N"},
+    {"decoder-low-latency", 0, 0, G_OPTION_ARG_NONE, &decoder_low_latency,
+        "Configure decoders for low latency where supported", NULL},
+    {"queue-max-buffers", 0, 0, G_OPTION_ARG_INT, &queue_max_buffers,
+        "Max. number of buffers in the decoder queues (0 = automatic)", "N"},
+    {"queue-max-bytes", 0, 0, G_OPTION_ARG_INT, &queue_max_bytes,
+        "Max. amount of data in the decoder queues (0 = automatic)", "BYTES"},
+    {"queue-max-time", 0, 0, G_OPTION_ARG_INT64, &queue_max_time,
+        "Max. amount of time in the decoder queues (0 = automatic)", "MS"},
+    {"buffer-size", 0, 0, G_OPTION_ARG_INT, &buffer_size,
+        "Network buffer size", "BYTES"},
+    {"buffer-duration", 0, 0, G_OPTION_ARG_INT64, &buffer_duration,
+        "Network buffer duration", "MS"},
+    {"buffer-low", 0, 0, G_OPTION_ARG_INT, &buffer_low,
+        "Pause for buffering below this fill level (default 10)", "PERCENT"},
+    {"buffer-high", 0, 0, G_OPTION_ARG_INT, &buffer_high,
+        "Always resume from buffering at this fill level (default 100)",
+        "PERCENT"},
+    {"cache-size", 0, 0, G_OPTION_ARG_INT, &cache_size,
+        "Cache network media on disk, up to this size (default 0 = off)",
+        "MB"},
+    {"cache-dir", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir,
+        "Directory for the media cache", "DIR"},
+    {"cache-max-age", 0, 0, G_OPTION_ARG_INT64, &cache_max_age,
+        "Re-download cached media older than this (default 86400, 0 = never)",
+        "SECONDS"},
+    {"probe-ahead", 0, 0, G_OPTION_ARG_INT, &probe_ahead,
+        "Probe this many upcoming playlist entries in the background "
+        "(default 0)", "N"},
+    {"set-property", 0, 0, G_OPTION_ARG_STRING_ARRAY, &set_properties,
+        "Set a property on elements created by a factory",
+        "FACTORY.PROPERTY=VALUE"},
+    {"dump-tuning", 0, 0, G_OPTION_ARG_NONE, &dump_tuning,
+        "Print effective tuning values per element after preroll", NULL},
+    {"low-latency", 0, 0, G_OPTION_ARG_NONE, &low_latency,
+        "Minimise latency of live streams, dropping frames to keep up", NULL},
+    {"latency-target", 0, 0, G_OPTION_ARG_INT, &latency_target,
+        "End-to-end latency to aim for in low-latency mode (default 200)",
+        "MS"},
+    {"stdin-commands", 0, 0, G_OPTION_ARG_NONE, &stdin_commands,
+        "Read commands (the D-Bus signal names) from stdin, one per line",
+        NULL},
+    {"timeshift", 0, 0, G_OPTION_ARG_INT, &timeshift_size,
+        "Keep this many MB of live streams to pause and rewind in", NULL},
+    {"timeshift-dir", 0, 0, G_OPTION_ARG_FILENAME, &timeshift_dir,
+        "Keep the time-shift buffer in this directory instead of memory",
+        NULL},
+    {"catchup-rate", 0, 0, G_OPTION_ARG_DOUBLE, &catchup_rate,
+        "Rate to catch up with live at (default 1.5, 1 or less jumps)", NULL},
+    {"in", 0, 0, G_OPTION_ARG_STRING, &in_point,
+        "Start every item at this position ([[h:]m:]s)", NULL},
+    {"out", 0, 0, G_OPTION_ARG_STRING, &out_point,
+        "End every item at this position ([[h:]m:]s)", NULL},
+    {"loop", 0, 0, G_OPTION_ARG_INT, &loops,
+        "Play every item this many times without a gap, 0 loops forever",
+        NULL},
+    {"mosaic", 0, 0, G_OPTION_ARG_INT, &mosaic,
+        "Play all items at once, tiled in this many columns (0 = square)",
+        "COLUMNS"},
+    {"sync-master", 0, 0, G_OPTION_ARG_INT, &sync_master,
+        "Serve the clock on this UDP port and sync points on the next TCP "
+        "port, for other instances to play in step", "PORT"},
+    {"sync-slave", 0, 0, G_OPTION_ARG_STRING, &sync_slave,
+        "Play in step with the sync master at HOST:PORT", "HOST:PORT"},
+    {"sync-delay", 0, 0, G_OPTION_ARG_INT, &sync_delay,
+        "How far ahead sync points are scheduled in ms (default 1000)",
+        NULL},
+    {"idle-release", 0, 0, G_OPTION_ARG_INT, &idle_release,
+        "Free decoders and buffers after being paused this long, and "
+        "restore everything on resume (default 0 = never)", "SECONDS"},
+    {"thumbnails", 0, 0, G_OPTION_ARG_INT, &thumbnails,
+        "Make a strip of thumbnails of every local item in the background, "
+        "one every this many ms", "MS"},
+    {"thumbnail-width", 0, 0, G_OPTION_ARG_INT, &thumbnail_width,
+        "Width of the thumbnails (default 160)", "PIXELS"},
+    {"resume", 0, 0, G_OPTION_ARG_NONE, &resume,
+        "Start every item where it was left off last time", NULL},
+    {"resume-file", 0, 0, G_OPTION_ARG_FILENAME, &resume_file,
+        "Remember positions in this file instead of the cache directory",
+        "FILE"},
+    {"retries", 0, 0, G_OPTION_ARG_INT, &retries,
+        "Retry a failing network item this often before skipping it for a "
+        "while (default 3)", "N"},
+    {"stall-timeout", 0, 0, G_OPTION_ARG_INT, &stall_timeout,
+        "Restart an item that made no progress while playing for this long "
+        "(default 10000, 0 = never)", "MS"},
+    {"notify-interval", 0, 0, G_OPTION_ARG_INT, &notify_interval,
+        "Send Changed signals at most this often per player (default 250)",
+        "MS"},
+    {"position-interval", 0, 0, G_OPTION_ARG_INT, &position_interval,
+        "Include the position in Changed signals this often (default 1000, "
+        "0 = never)", "MS"},
+    {"when-hidden", 0, 0, G_OPTION_ARG_STRING, &when_hidden,
+        "Video decoding while the window is covered: decode, keyframes "
+        "(default) or off", "MODE"},
+    {"downscale", 0, 0, G_OPTION_ARG_NONE, &downscale,
+        "Scale video down to the window size right after decoding", NULL},
+    {"log-level", 0, 0, G_OPTION_ARG_STRING, &log_level,
+        "Print messages up to this level: error, warning, info, status "
+        "(default) or debug", "LEVEL"},
+    {"log-json", 0, 0, G_OPTION_ARG_NONE, &log_json,
+        "Print messages as JSON objects, one per line", NULL},
+    {"frame-pacing", 0, 0, G_OPTION_ARG_NONE, &frame_pacing,
+        "Collect render timing statistics at the video sink", NULL},
+    {"playbin3", 0, 0, G_OPTION_ARG_NONE, &playbin3,
+        "Use playbin3, which switches tracks without reconfiguring", NULL},
     {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL},
     {NULL}
   };
@@ -1321,7 +1285,25 @@ main (int argc, char **argv)
   }
   g_option_context_free (ctx);
 
-  GST_DEBUG_CATEGORY_INIT (play_debug, "play", 0, g_get_prgname ());
+  GST_DEBUG_CATEGORY_INIT (cli_debug, "play-cli", 0, g_get_prgname ());
+  gst_play_mod_set_quiet (quiet);
+  if (verbose)
+    gst_play_mod_log_set_level (GST_PLAY_MOD_LOG_DEBUG);
+  if (log_level != NULL) {
+    static const gchar *levels[] =
+        { "error", "warning", "info", "status", "debug", NULL };
+
+    for (i = 0; levels[i] != NULL; i++) {
+      if (g_str_equal (log_level, levels[i]))
+        break;
+    }
+    if (levels[i] != NULL)
+      gst_play_mod_log_set_level ((GstPlayModLogLevel) i);
+    else
+      gst_printerr ("Unknown log level '%s'\n", log_level);
+    g_free (log_level);
+  }
+  gst_play_mod_log_set_json (log_json);
 
   if (print_version) {
     gchar *version_str;
@@ -1341,93 +1323,271 @@ main (int argc, char **argv)
 
   /* DBus client */
   if (emit != NULL) {
-    client_send_signal(emit);
+    client_send_signal(emit, player);
     return 0;
   }
+  if (call != NULL)
+    return client_call_method (call, player) ? 0 : 1;
 
-  playlist = g_ptr_array_new ();
+  gst_play_mod_tuning_init (&tuning);
 
-  if (playlist_file != NULL) {
-    gchar *playlist_contents = NULL;
-    gchar **lines = NULL;
+  if (tuning_file != NULL) {
+    if (!gst_play_mod_tuning_load (&tuning, tuning_file, &err)) {
+      gst_printerr ("Could not read tuning file: %s\n", err->message);
+      g_clear_error (&err);
+    }
+    g_free (tuning_file);
+  }
 
-    if (g_file_get_contents (playlist_file, &playlist_contents, NULL, &err)) {
-      lines = g_strsplit (playlist_contents, "\n", 0);
-      num = g_strv_length (lines);
+  /* command line takes precedence over the tuning file */
+  if (max_threads >= 0)
+    tuning.decoder_max_threads = max_threads;
+  if (decoder_low_latency)
+    tuning.decoder_low_latency = TRUE;
+  if (queue_max_buffers >= 0)
+    tuning.queue_max_buffers = queue_max_buffers;
+  if (queue_max_bytes >= 0)
+    tuning.queue_max_bytes = queue_max_bytes;
+  if (queue_max_time >= 0)
+    tuning.queue_max_time = queue_max_time * GST_MSECOND;
+  if (buffer_size >= 0)
+    tuning.buffer_size = buffer_size;
+  if (buffer_duration >= 0)
+    tuning.buffer_duration = buffer_duration * GST_MSECOND;
+  if (buffer_low >= 0)
+    tuning.buffer_low_percent = buffer_low;
+  if (buffer_high >= 0)
+    tuning.buffer_high_percent = buffer_high;
+  /* both are fill levels, and we never wait for more than we resume at */
+  tuning.buffer_low_percent = CLAMP (tuning.buffer_low_percent, 0, 100);
+  tuning.buffer_high_percent = CLAMP (tuning.buffer_high_percent,
+      tuning.buffer_low_percent, 100);
+  for (i = 0; set_properties != NULL && set_properties[i] != NULL; i++)
+    gst_play_mod_tuning_add_property (&tuning, set_properties[i]);
+  g_strfreev (set_properties);
+  tuning.dump = dump_tuning;
+  if (low_latency) {
+    tuning.low_latency = TRUE;
+    tuning.decoder_low_latency = TRUE;
+  }
+  if (latency_target > 0)
+    tuning.latency_target = latency_target * GST_MSECOND;
+
+  default_item.in = GST_CLOCK_TIME_NONE;
+  default_item.out = GST_CLOCK_TIME_NONE;
+  default_item.loops = loops;
+  if (loops < 0) {
+    gst_printerr ("Invalid loop count %d, playing every item once\n", loops);
+    default_item.loops = 1;
+  }
+  /* the soak test decides when items change */
+  if (soak_steps > 0)
+    default_item.loops = 0;
+  if (in_point != NULL && !gst_play_mod_parse_time (in_point, &default_item.in))
+    gst_printerr ("Invalid in point '%s'\n", in_point);
+  if (out_point != NULL && !gst_play_mod_parse_time (out_point,
+      &default_item.out))
+    gst_printerr ("Invalid out point '%s'\n", out_point);
+  g_free (in_point);
+  g_free (out_point);
+
+  if (g_strcmp0 (when_hidden, "decode") == 0)
+    hidden_video = GST_PLAY_MOD_HIDDEN_VIDEO_DECODE;
+  else if (g_strcmp0 (when_hidden, "off") == 0)
+    hidden_video = GST_PLAY_MOD_HIDDEN_VIDEO_OFF;
+  else if (when_hidden != NULL && !g_str_equal (when_hidden, "keyframes"))
+    gst_printerr ("Unknown --when-hidden mode '%s'\n", when_hidden);
+  g_free (when_hidden);
+
+  if (playbin3)
+    g_setenv ("USE_PLAYBIN3", "1", TRUE);
+
+  num_players = outputs != NULL ? g_strv_length (outputs) : 1;
+  players = g_new0 (GstPlayMod *, num_players);
+  main_loop = g_main_loop_new (NULL, FALSE);
+
+  for (i = 0; i < num_players; i++) {
+    GstPlayModRegion region = { 0, };
+    const gchar *own_playlist = NULL;
+
+    if (outputs != NULL) {
+      gchar *sep = strchr (outputs[i], '=');
+      gchar *name;
 
-      for (i = 0; i < num; i++) {
-        if (lines[i][0] != '\0') {
-          GST_LOG ("Playlist[%d]: %s", i + 1, lines[i]);
-          add_to_playlist (playlist, lines[i]);
-        }
+      if (sep != NULL)
+        own_playlist = sep + 1;
+      name = g_strndup (outputs[i], sep ? sep - outputs[i] : -1);
+      if (!gst_play_mod_parse_region (name, &region)) {
+        gst_printerr ("Unknown output '%s'\n", name);
+        g_free (name);
+        return EXIT_FAILURE;
       }
-      g_strfreev (lines);
-      g_free (playlist_contents);
-    } else {
-      gst_printerr ("Could not read playlist: %s\n", err->message);
-      g_clear_error (&err);
+      g_free (name);
     }
-    g_free (playlist_file);
-    playlist_file = NULL;
-  }
 
-  if (playlist->len == 0 && (filenames == NULL || *filenames == NULL)) {
-    gst_printerr ("Usage: %s FILE1|URI1 [FILE2|URI2] [FILE3|URI3] ...",
-    g_get_prgname ());
-    gst_printerr ("\n\n"),
-    gst_printerr ("%s\n\n",
-        "You must provide at least one filename or URI to play.");
-    /* No input provided. Free array */
-    g_ptr_array_free (playlist, TRUE);
+    if (own_playlist != NULL)
+      num = build_playlist (own_playlist, NULL, &default_item, shuffle, &uris,
+          &item_array);
+    else
+      num = build_playlist (playlist_file, filenames, &default_item, shuffle,
+          &uris, &item_array);
 
-    g_free (audio_sink);
-    g_free (video_sink);
+    if (num == 0) {
+      g_strfreev (uris);
+      g_free (item_array);
 
-    return 1;
-  }
+      if (outputs != NULL) {
+        gst_printerr ("Nothing to play on output '%s'\n", outputs[i]);
+        return 1;
+      }
+
+      gst_printerr ("Usage: %s FILE1|URI1 [FILE2|URI2] [FILE3|URI3] ...",
+      g_get_prgname ());
+      gst_printerr ("\n\n"),
+      gst_printerr ("%s\n\n",
+          "You must provide at least one filename or URI to play.");
+
+      g_free (audio_sink);
+      g_free (video_sink);
 
-  /* fill playlist */
-  if (filenames != NULL && *filenames != NULL) {
-    num = g_strv_length (filenames);
-    for (i = 0; i < num; ++i) {
-      GST_LOG ("command line argument: %s", filenames[i]);
-      add_to_playlist (playlist, filenames[i]);
+      return 1;
     }
-    g_strfreev (filenames);
-  }
 
-  num = playlist->len;
-  g_ptr_array_add (playlist, NULL);
+    /* prepare */
+    play = gst_play_mod_new (uris, audio_sink, video_sink, gapless, volume,
+        rate, verbose, flags, &tuning);
+
+    if (play == NULL) {
+      gst_printerr ("Failed to create 'playbin' element. Check your GStreamer installation.\n");
+      return EXIT_FAILURE;
+    }
+
+    gst_play_mod_set_items (play, item_array, &default_item);
+    gst_play_mod_set_region (play, &region);
+    gst_play_mod_set_hidden_video (play, hidden_video);
+    gst_play_mod_set_event_callback (play, player_event, GUINT_TO_POINTER (i),
+        NULL);
+    gst_play_mod_set_position_interval (play, MAX (position_interval, 0));
+    gst_play_mod_set_recovery (play, MAX (retries, 0), MAX (stall_timeout, 0));
+    gst_play_mod_set_idle_release (play, MAX (idle_release, 0) * 1000);
+    gst_play_mod_set_fade (play, MAX (fade, 0));
+
+    /* the cache index isn't shared, so give every player its own */
+    if (cache_size > 0 && num_players > 1) {
+      gchar *subdir = g_strdup_printf ("output-%u", i);
+      gchar *dir = cache_dir ? g_build_filename (cache_dir, subdir, NULL) :
+          g_build_filename (g_get_user_cache_dir (), PROGRAM_NAME, subdir,
+          NULL);
+
+      gst_play_mod_enable_cache (play, dir, (guint64) cache_size << 20,
+          cache_max_age);
+      g_free (dir);
+      g_free (subdir);
+    } else if (cache_size > 0) {
+      gst_play_mod_enable_cache (play, cache_dir, (guint64) cache_size << 20,
+          cache_max_age);
+    }
 
-  uris = (gchar **) g_ptr_array_free (playlist, FALSE);
+    if (probe_ahead > 0)
+      gst_play_mod_enable_probing (play, probe_ahead);
 
-  if (shuffle)
-    shuffle_uris (uris, num);
+    if (timeshift_size > 0)
+      gst_play_mod_enable_timeshift (play, (guint64) timeshift_size << 20,
+          timeshift_dir, catchup_rate);
 
-  /* prepare */
-  play = play_new (uris, audio_sink, video_sink, gapless, volume, rate, verbose, flags);
+    if (mosaic >= 0)
+      gst_play_mod_enable_mosaic (play, mosaic);
 
-  if (play == NULL) {
-    gst_printerr ("Failed to create 'playbin' element. Check your GStreamer installation.\n");
-    return EXIT_FAILURE;
+    if (downscale)
+      gst_play_mod_enable_downscale (play);
+
+    if (frame_pacing)
+      gst_play_mod_enable_frame_pacing (play);
+
+    if (thumbnails > 0)
+      gst_play_mod_enable_thumbnails (play, thumbnails,
+          MAX (thumbnail_width, 0));
+
+    if ((resume || resume_file != NULL) &&
+        !gst_play_mod_enable_resume (play, resume_file, &err)) {
+      gst_printerr ("Could not enable resume: %s\n", err->message);
+      g_clear_error (&err);
+    }
+
+    /* with several outputs, player N uses the ports after player N - 1 */
+    if (sync_master > 0 && !gst_play_mod_enable_sync_master (play,
+        sync_master + 2 * i, MAX (sync_delay, 0) * GST_MSECOND, &err)) {
+      gst_printerr ("Could not become sync master: %s\n", err->message);
+      return EXIT_FAILURE;
+    }
+    if (sync_slave != NULL) {
+      gchar *sep = strrchr (sync_slave, ':');
+      gchar *host;
+
+      if (sep == NULL) {
+        gst_printerr ("Sync master must be given as HOST:PORT\n");
+        return EXIT_FAILURE;
+      }
+      host = g_strndup (sync_slave, sep - sync_slave);
+      if (!gst_play_mod_enable_sync_slave (play, host, atoi (sep + 1) + 2 * i,
+              &err)) {
+        gst_printerr ("Could not reach the sync master: %s\n", err->message);
+        g_free (host);
+        return EXIT_FAILURE;
+      }
+      g_free (host);
+    }
+
+    players[i] = play;
   }
+  g_strfreev (tuning.properties);
+  g_strfreev (outputs);
+  g_strfreev (filenames);
+  g_free (playlist_file);
+  g_free (cache_dir);
+  g_free (timeshift_dir);
+  g_free (sync_slave);
+  g_free (resume_file);
 
   /* Set up the DBus server */
-  if (!server_setup (play)) {
+  if (!server_setup (stdin_commands)) {
 	  gst_printerr ("Failed to set up the DBus server.\n");
 	  return EXIT_FAILURE;
   }
 
-  /* play */
-  do_play (play);
+  /* play, all players share the main context */
+  for (i = 0; i < num_players; i++) {
+    if (gst_play_mod_start (players[i]))
+      players_running++;
+  }
+  if (players_running > 0 && soak_steps > 0)
+    soak_start (soak_steps, MAX (soak_interval, 0), MAX (soak_max_rss, 0));
+  if (players_running > 0)
+    g_main_loop_run (main_loop);
+
+  if (soak_steps > 0 && soak.done < soak.steps) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_ERROR,
+        "Soak: stopped after %u of %u steps\n", soak.done, soak.steps);
+    soak.failed = TRUE;
+  }
 
   /* clean up */
-  play_free (play);
+  server_teardown ();
+  for (i = 0; i < num_players; i++) {
+    if (num_players > 1)
+      gst_play_mod_log (GST_PLAY_MOD_LOG_INFO, "\nPlayer %u:\n", i);
+    gst_play_mod_print_stats (players[i]);
+    gst_play_mod_free (players[i]);
+  }
+  g_free (players);
+  g_main_loop_unref (main_loop);
+  soak_free ();
 
   g_free (audio_sink);
   g_free (video_sink);
 
-  gst_print ("\n");
+  gst_play_mod_log (GST_PLAY_MOD_LOG_INFO, "\n");
+  gst_play_mod_log_flush ();
   gst_deinit ();
-  return 0;
+  return soak.failed ? EXIT_FAILURE : 0;
 }
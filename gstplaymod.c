@@ -0,0 +1,9269 @@
+/* libgstplaymod: playbin based player core of gst-play-mod,
+ * based on the GStreamer command line playback testing utility
+ *
+ * Copyright (C) 2013-2014 Tim-Philipp Müller <tim centricular net>
+ * Copyright (C) 2013 Collabora Ltd.
+ * Copyright (C) 2015 Centricular Ltd
+ * Copyright (C) 2021 No Isolation AS
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "gstplaymod.h"
+
+#include <gst/audio/audio.h>
+#include <gst/video/video.h>
+#include <gst/pbutils/pbutils.h>
+#include <gst/net/net.h>
+#include <gst/math-compat.h>
+#include <xcb/xcb.h>
+#include <xcb/randr.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <glib/gprintf.h>
+
+#define PROGRAM_NAME "gst-play-mod"
+
+#define VOLUME_STEPS 20
+
+/* playbin 'flags' */
+#define PLAY_FLAG_BUFFERING 0x100
+
+/* never shrink a jitterbuffer below this while chasing the latency target */
+#define LOW_LATENCY_MIN_JITTERBUFFER_MS 10
+
+/* how much of an upcoming local file to pull into the page cache */
+#define PROBE_WARM_BYTES (2 * 1024 * 1024)
+/* how long a probe that failed for a reason that may go away counts */
+#define PROBE_RETRY_TIME (60 * G_USEC_PER_SEC)
+
+/* keyframe index sidecar files */
+#define INDEX_MAGIC "GPMKIDX1"
+/* stepping back from just after a keyframe goes to the one before it */
+#define INDEX_STEP_BACK_MARGIN (500 * GST_MSECOND)
+
+/* retries of a failing item back off from RECOVERY_BACKOFF_MIN up to
+ * RECOVERY_BACKOFF_MAX; after the last one it's skipped for
+ * RECOVERY_BAD_TIME */
+#define RECOVERY_BACKOFF_MIN (500 * GST_MSECOND)
+#define RECOVERY_BACKOFF_MAX (30 * GST_SECOND)
+#define RECOVERY_BAD_TIME (5 * 60 * GST_SECOND)
+
+/* resume position store: a fixed table in a shared file mapping, looked
+ * up by hashing the URI into a window of RESUME_PROBE slots. Positions
+ * too close to either end of an item aren't worth resuming. */
+#define RESUME_MAGIC "GPMKPOS1"
+#define RESUME_SLOTS 4096
+#define RESUME_PROBE 32
+#define RESUME_SAVE_INTERVAL (5 * G_USEC_PER_SEC)
+#define RESUME_MARGIN (10 * GST_SECOND)
+
+/* lines a sync peer may fall behind on before it's dropped */
+#define SYNC_MAX_QUEUED 64
+
+/* scrub thumbnails: at most this many tiles per item, and how long a
+ * single seek may take before we give up on the item */
+#define THUMBNAIL_MAX_TILES 360
+#define THUMBNAIL_TIMEOUT (10 * GST_SECOND)
+/* the nice value thumbnails are made at */
+#define THUMBNAIL_NICE 10
+
+/* the log ring, allocated once; longer messages are cut */
+#define LOG_ENTRIES 256
+#define LOG_ENTRY_SIZE 512
+
+GST_DEBUG_CATEGORY_STATIC (play_debug);
+#define GST_CAT_DEFAULT play_debug
+
+/* all output goes through the log writer thread, see gst_play_mod_log() */
+#define gst_print(...) gst_play_mod_log (GST_PLAY_MOD_LOG_INFO, __VA_ARGS__)
+#define gst_printerr(...) gst_play_mod_log (GST_PLAY_MOD_LOG_ERROR, __VA_ARGS__)
+
+typedef struct
+{
+  /* download rate in bytes/s, smoothed over buffering messages */
+  gint64 download_rate;
+  gint percent;
+
+  guint stalls;
+  GstClockTime stall_time;
+  gint64 stall_start;
+
+  /* the item played already; until then it prerolls up to the high
+   * watermark like it always did */
+  gboolean started;
+} GstPlayModBufferingStats;
+
+/* Size-bounded on-disk cache of network media. The index is a key file
+ * with one group per entry, named after the SHA-1 of the URI, which is
+ * also the name of the data file. */
+typedef struct
+{
+  gchar *dir;
+  guint64 max_size;
+  gint64 max_age;
+
+  /* protects index, size and fetch_key */
+  GMutex lock;
+  GKeyFile *index;
+  guint64 size;
+
+  /* background prefetch, one at a time */
+  GstElement *fetch;
+  guint fetch_watch;
+  gchar *fetch_key;
+  GQueue fetch_queue;
+
+  guint hits;
+  guint misses;
+  guint64 bytes_saved;
+} GstPlayModCache;
+
+/* what we learnt about an upcoming playlist entry */
+typedef struct
+{
+  gboolean playable;
+  gint64 expires;               /* monotonic, 0 for never */
+  gboolean seekable;
+  GstClockTime duration;
+  gchar *container;
+  gchar *video_codec;
+  gchar *audio_codec;
+  gchar *video_decoder;
+  gchar *audio_decoder;
+} GstPlayModProbeInfo;
+
+typedef struct
+{
+  guint depth;
+  GstDiscoverer *discoverer;
+  GThreadPool *warm_pool;
+
+  /* protects results and pending, results are also read from the
+   * about-to-finish streaming thread */
+  GMutex lock;
+  GHashTable *results;
+  GHashTable *pending;
+} GstPlayModProber;
+
+typedef struct
+{
+  gint refcount;
+  gchar *path;                  /* sidecar file, NULL if not persisted */
+
+  /* sorted stream times of video keyframes, appended from the decoder's
+   * streaming thread */
+  GMutex lock;
+  GArray *keyframes;
+  gboolean dirty;
+} GstPlayModIndex;
+
+typedef struct
+{
+  guint64 size;
+  gchar *dir;                   /* NULL keeps the ring buffer in memory */
+  gdouble catchup_rate;
+
+  gint available;               /* set when playbin created our queue2 */
+  gboolean active;
+  gboolean catching_up;
+
+  /* position and time we started tracking the live edge at */
+  GstClockTime start_pos;
+  gint64 start_time;
+  GstClockTime delay;
+} GstPlayModTimeshift;
+
+typedef struct _GstPlayModMosaic GstPlayModMosaic;
+
+typedef struct
+{
+  GstPlayModMosaic *mosaic;
+  guint index;
+
+  GstElement *decodebin;
+  /* protected by the decodebin's object lock, written in the streaming
+   * thread */
+  gboolean claimed;             /* a video stream is being linked */
+  GstPad *pad;                  /* compositor pad, once the video is linked */
+  gint frames;                  /* counted in the streaming thread */
+  gint last_frames;
+  gdouble fps;
+} GstPlayModMosaicTile;
+
+struct _GstPlayModMosaic
+{
+  guint columns;
+  guint rows;
+  guint tile_width;
+  guint tile_height;
+
+  GstElement *pipeline;
+  GstElement *compositor;
+  guint bus_watch;
+
+  GstPlayModMosaicTile *tiles;
+  guint num_tiles;
+
+  /* for the frame rates and the CPU load, updated every second */
+  gint64 last_update;
+  gint64 last_cpu;
+  gdouble cpu;
+  gdouble cpu_max;
+};
+
+/* a moment all instances agree on: item @idx at @pos shows at @base on
+ * the shared clock */
+typedef struct
+{
+  gint idx;
+  gint64 pos;
+  gdouble rate;
+  GstPlayModTrickMode mode;
+  GstClockTime base;
+  GstState state;
+} GstPlayModSyncPoint;
+
+/* the other end of a control connection: the slaves on the master, the
+ * master on a slave */
+typedef struct
+{
+  GstPlayMod *play;
+  GSocketConnection *connection;
+  GDataInputStream *input;
+  GCancellable *cancellable;
+  gchar *name;
+
+  /* lines not written yet, the head one is being written */
+  GQueue output;
+
+  /* master: how far ahead of us the slave was at its last report */
+  GstClockTimeDiff skew;
+  GstClockTimeDiff skew_max;
+  guint reports;
+} GstPlayModSyncPeer;
+
+typedef struct
+{
+  gboolean master;
+  gchar *address;
+  GstClock *clock;
+  GstNetTimeProvider *provider;
+  GSocketService *service;
+  GList *peers;
+  GstClockTime delay;
+
+  GstPlayModSyncPoint point;
+  gboolean pending;             /* waiting for the item to preroll */
+  gboolean executing;           /* our own seek, not a new sync point */
+  gboolean prerolling;          /* base time goes in on ASYNC_DONE */
+  guint points;
+
+  gint64 last_report;
+} GstPlayModSync;
+
+/* frames going through one side of the downscaler, for the current item */
+typedef struct
+{
+  gint width;
+  gint height;
+  guint64 bytes;
+  guint frames;
+  GstClockTime first_pts;
+  GstClockTime last_pts;
+} GstPlayModFrameStats;
+
+typedef struct
+{
+  GstElement *bin;
+  gint max_width;
+  gint max_height;
+
+  GMutex lock;
+  gint idx;                     /* the item the stats below are for */
+  GstPlayModFrameStats decoded;
+  GstPlayModFrameStats scaled;
+} GstPlayModDownscale;
+
+/* render intervals as a multiple of the expected one */
+#define PACING_BUCKETS 7
+static const gdouble pacing_bucket_limits[PACING_BUCKETS - 1] =
+    { 0.5, 0.9, 1.1, 1.5, 2.5, 4.0 };
+
+/* frame pacing at one playback rate */
+typedef struct
+{
+  gdouble rate;
+  guint frames;
+  guint late;                   /* reached the sink after their time */
+  guint early;                  /* shown less than half a frame after the last */
+  guint intervals;
+  gdouble interval_sum;         /* ms */
+  gdouble interval_sumsq;
+  gdouble interval_max;
+  guint histogram[PACING_BUCKETS];
+} GstPlayModPacingRate;
+
+typedef struct
+{
+  GMutex lock;
+  GArray *rates;                /* GstPlayModPacingRate */
+  guint frames;
+  guint late;
+
+  /* streaming thread only */
+  GstSegment segment;
+  GstClockTime last_render;
+  GstClockTime last_running;
+
+  /* for the status line, control thread only */
+  guint status_frames;
+  gint64 status_time;
+  gdouble fps;
+} GstPlayModPacing;
+
+typedef struct
+{
+  guint failures;
+  gint64 bad_until;             /* monotonic time, 0 while retrying */
+} GstPlayModFailure;
+
+/* control thread only */
+typedef struct
+{
+  guint max_retries;
+  GstClockTime stall_timeout;   /* 0 disables the watchdog */
+  GHashTable *failures;         /* uri -> GstPlayModFailure */
+  guint retry_timeout;
+
+  /* where to continue after a retry or restart, applied at PAUSED */
+  GstClockTime resume;
+
+  /* watchdog */
+  gint64 last_pos;
+  gint64 last_progress;
+  gboolean progressed;
+
+  guint retries;
+  guint restarts;
+  guint given_up;
+  guint skipped;
+} GstPlayModRecovery;
+
+/* 0 marks a free slot; written key last, so a slot is never found half
+ * written */
+typedef struct
+{
+  guint64 key;
+  gint64 position;
+  gint64 duration;
+  gint64 updated;               /* real time in seconds */
+} GstPlayModResumeSlot;
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 slots;
+  guint32 reserved;
+  GstPlayModResumeSlot slot[RESUME_SLOTS];
+} GstPlayModResumeTable;
+
+/* control thread only */
+typedef struct
+{
+  GstPlayModResumeTable *table;
+  gint fd;                      /* locked while a slot is taken */
+
+  /* the item positions are saved for, NULL once it played to the end */
+  const gchar *uri;
+  gint64 saved;
+
+  /* a resume seek for the item being set up, done while it prerolls */
+  GstClockTime pending;
+  gboolean seeked;
+
+  /* time to first frame, from gst_play_mod_uri() to the end of preroll */
+  gint64 started;
+  guint resumed;
+  gint64 resumed_total;
+  gint64 resumed_max;
+  guint fresh;
+  gint64 fresh_total;
+} GstPlayModResume;
+
+typedef struct
+{
+  GstPlayMod *play;
+  GstSample *sample;
+  gchar *path;
+  GstPlayModSnapshotFunc func;
+  gpointer user_data;
+} GstPlayModSnapshotJob;
+
+/* One strip per item, generated on its own pipeline in the thread pool.
+ * A new item bumps generation, which stops work on the previous one. */
+typedef struct
+{
+  GThreadPool *pool;            /* exclusive, one thread */
+  GstTaskPool *task_pool;       /* for the pipeline's streaming threads */
+  GstClockTime interval;
+  guint width;
+  gint generation;
+
+  /* protects the strip and the stats */
+  GMutex lock;
+  gchar *uri;
+  gchar *path;
+  guint tile_height;
+  guint tiles;
+  guint strips;
+  guint cached;
+  guint tiles_total;
+  gint64 time_total;
+} GstPlayModThumbnails;
+
+typedef struct
+{
+  gchar *uri;
+  gchar *source_uri;
+  gint generation;
+} GstPlayModThumbnailJob;
+
+/* Releasing the pipeline after a long pause: what was playing is kept
+ * here and restored with the preroll on resume. Control thread only. */
+typedef struct
+{
+  GstClockTime timeout;         /* 0 disables it */
+  gint64 paused_since;
+  gboolean released;
+  gboolean restoring;
+
+  /* where to go back to, moved by seeks while released */
+  GstClockTime position;
+  gint64 duration;
+  gint tracks[3];               /* playbin current-audio, -video, -text */
+  gchar *sids[3];               /* playbin3 selection */
+
+  gint64 restore_started;
+  guint releases;
+  gint64 freed_total;
+  guint restores;
+  gint64 restore_total;
+  gint64 restore_max;
+} GstPlayModIdle;
+
+/* A seek to do before an item's first preroll: the sinks drop what
+ * reaches them until the pipeline can take the seek, so they only
+ * preroll once, at its target. */
+typedef enum
+{
+  PLAY_HOLD_NONE,
+  PLAY_HOLD_WAITING,            /* for data to reach a sink */
+  PLAY_HOLD_READY,              /* it did, the seek can go out */
+  PLAY_HOLD_SEEKING             /* until the seek flushes the sinks */
+} PlayHoldState;
+
+typedef struct
+{
+  gint state;                   /* PlayHoldState, atomic */
+  gint seqnum;                  /* atomic, tells a new hold from an old one */
+} GstPlayModHold;
+
+/* What the next gapless item's segments get at the sinks: our rate.
+ * Written in about-to-finish before the item is set up, seqnum last; 0
+ * while there's nothing to carry over. */
+typedef struct
+{
+  gint seqnum;                  /* atomic */
+  gint counter;                 /* about-to-finish only */
+  gdouble rate;
+} GstPlayModCarry;
+
+typedef struct _GstPlayModStateJob GstPlayModStateJob;
+
+/* runs on the control thread once the state change is done */
+typedef void (*PlayStateDoneFunc) (GstPlayMod * play,
+    GstPlayModStateJob * job);
+
+/* A state change of the playbin. They are made in order on the state
+ * thread, so the control thread never waits for streaming threads to
+ * stop or for a source to connect, see play_set_state(). */
+struct _GstPlayModStateJob
+{
+  GstState state;
+  gchar *uri;                   /* switch to it in READY first */
+  gboolean flush;               /* drop what the pipeline posted so far */
+  gboolean trim;                /* hand freed memory back afterwards */
+  PlayStateDoneFunc done;
+
+  GstStateChangeReturn ret;
+  gint64 freed;
+};
+
+/* a play_add_timeout() timer, whose source only queues it */
+typedef struct
+{
+  GstPlayMod *play;
+  GSourceFunc func;
+  gboolean queued;
+} PlayTimer;
+
+typedef enum
+{
+  PLAY_ENTRY_COMMAND,
+  PLAY_ENTRY_MESSAGE,           /* from the playbin's bus */
+  PLAY_ENTRY_TIMER,
+  PLAY_ENTRY_SWITCHED,          /* what the old item posted is dropped */
+  PLAY_ENTRY_STATE              /* a state change with a done func */
+} PlayEntryKind;
+
+typedef struct _GstPlayModCommand GstPlayModCommand;
+
+struct _GstPlayModCommand
+{
+  GstPlayModCommand *next;
+  PlayEntryKind kind;
+  GstPlayModCommandType type;
+  gchar *arg;
+  gint64 queued;
+
+  GstMessage *message;
+  GSource *source;              /* of the timer, ref'd */
+  PlayTimer *timer;             /* valid while the source isn't destroyed */
+  GstPlayModStateJob *job;
+};
+
+/* Multi-producer, single-consumer: producers push onto head with a
+ * compare-and-swap, the control thread takes the whole list at once.
+ * Commands, bus messages, timers and finished state changes all come
+ * this way. */
+typedef struct
+{
+  GstPlayModCommand *head;
+  GMainContext *context;
+  GSource *source;
+
+  gint depth;
+  gint max_depth;
+
+  /* only touched by the control thread */
+  guint count;
+  gint64 latency_total;
+  gint64 latency_max;
+  GstPlayModCommandType slowest;
+} GstPlayModCommandQueue;
+
+typedef struct
+{
+  GSource source;
+  GstPlayModCommandQueue *queue;
+} GstPlayModCommandSource;
+
+struct _GstPlayMod
+{
+  gchar **uris;
+  guint num_uris;
+  gint cur_idx;
+
+  /* options of each playlist entry, NULL ones use default_item. item_idx
+   * is the entry whose options are applied, which only follows cur_idx
+   * once the next entry actually starts in gapless mode */
+  GstPlayModItem **items;
+  GstPlayModItem default_item;
+  gint item_idx;
+  guint loops_done;
+  guint wraps;
+  GstClockTimeDiff wrap_gap_max;
+  guint boundaries;
+  GstClockTimeDiff boundary_gap_max;
+  guint rate_carried;
+
+  GstElement *playbin;
+
+  GstStreamCollection *collection;
+  gchar *cur_audio_sid;
+  gchar *cur_video_sid;
+  gchar *cur_text_sid;
+  GMutex selection_lock;
+
+  /* playbin3 switches tracks with select-streams, timed from the request
+   * to STREAMS_SELECTED */
+  gboolean is_playbin3;
+  gint64 select_started;
+  guint switches;
+  gint64 switch_total;
+  gint64 switch_max;
+
+  /* the control thread runs loop, which handles the command queue; the
+   * state thread makes the playbin's state changes */
+  GMainLoop *loop;
+  guint timeout;
+  GstPlayModCommandQueue commands;
+  GThreadPool *state_pool;
+  gint switching;               /* switches and flushes not done, atomic */
+
+  gboolean start_pending;
+
+  gboolean buffering;
+  gboolean is_live;
+  GstPlayModBufferingStats buffering_stats;
+
+  GstState desired_state;
+
+  gulong deep_notify_id;
+
+  /* configuration */
+  gboolean gapless;
+  GstClockTime fade;            /* at item boundaries, 0 for none */
+
+  GstPlayModTuning tuning;
+  gboolean tuning_dumped;
+
+  GstPlayModCache *cache;
+  GstPlayModProber *prober;
+  GstPlayModTimeshift *timeshift;
+  GstPlayModMosaic *mosaic;
+  GstPlayModSync *sync;
+  GstPlayModDownscale *downscale;
+  GstPlayModPacing *pacing;
+  GstPlayModRecovery recovery;
+  GstPlayModResume *resume;
+  GstPlayModThumbnails *thumbnails;
+  GstPlayModIdle idle;
+  GstPlayModHold hold;
+  GstPlayModCarry carry;
+  GThreadPool *snapshot_pool;
+  guint snapshots;
+
+  /* index of what's playing, and of the item decoders are being set up
+   * for, which runs ahead of it in gapless mode */
+  GMutex index_lock;
+  GstPlayModIndex *index;
+  GstPlayModIndex *setup_index;
+  guint index_seeks;
+  GstClockTime step_keyframe;   /* where the last keyframe step went */
+
+  guint latency_timeout;
+  guint64 qos_dropped;
+  GstClockTimeDiff qos_jitter;  /* decays once a second */
+
+  /* jitterbuffer shrinking: what it was like before the last step, and
+   * whether shrinking stopped helping */
+  GstClockTime shrink_latency;
+  guint64 shrink_dropped;
+  gboolean shrink_done;
+
+  GstPlayModTrickMode trick_mode;
+  gdouble rate;
+
+  GstPlayModEventFunc event_func;
+  gpointer event_data;
+  GDestroyNotify event_notify;
+  gboolean stopped;
+  guint position_interval;      /* ms */
+  gint64 position_sent;
+
+  /* output window, created for the first video and kept for the
+   * following items */
+  GstPlayModRegion region;
+  xcb_window_t window;
+
+  /* what the video decoders do while the window can't be seen */
+  GstPlayModHiddenVideo hidden_video;
+  gboolean obscured;            /* from the X server, under display_lock */
+  gboolean unmapped;
+  gint hidden;                  /* GstPlayModHiddenVideo in effect, atomic */
+  gint frames_skipped;          /* atomic */
+  guint hidden_count;
+  gint64 visibility_since;
+  gint64 visibility_cpu;
+  gint64 visible_time, visible_cpu;
+  gint64 hidden_time, hidden_cpu;
+};
+
+typedef struct
+{
+  GstPlayModLogLevel level;
+  gint64 time;
+  gchar text[LOG_ENTRY_SIZE];
+} GstPlayModLogEntry;
+
+/* one log for all the players in the process: a ring of preallocated
+ * entries, emptied by a writer thread so slow consoles never hold up the
+ * players */
+static GMutex log_lock;
+static GCond log_cond;          /* something to write */
+static GCond log_drained;       /* nothing left to write */
+static GstPlayModLogEntry *log_entries;
+static guint log_head;
+static guint log_count;
+static gint log_status = -1;    /* queued status line, replaced by the next */
+static gboolean log_writing;
+static guint log_dropped;
+static gint log_level = GST_PLAY_MOD_LOG_STATUS;
+static gboolean log_json;
+
+/* one X connection for all the players in the process */
+static GMutex display_lock;
+static xcb_connection_t *display;
+static guint display_users;
+static GList *display_players;  /* the ones with a window */
+
+static gboolean play_bus_msg (GstBus * bus, GstMessage * msg, gpointer data);
+static void play_set_state (GstPlayMod * play, GstState state);
+static void play_set_state_flush (GstPlayMod * play, GstState state);
+static void play_state_func (gpointer data, gpointer user_data);
+static void play_state_job_free (GstPlayModStateJob * job);
+static gboolean play_timeout (gpointer user_data);
+static void play_about_to_finish (GstElement * playbin, gpointer user_data);
+static void play_reset (GstPlayMod * play);
+static void play_idle_clear (GstPlayMod * play);
+static gboolean play_do_seek_full (GstPlayMod * play, gint64 pos, gdouble rate,
+    GstPlayModTrickMode mode, GstSeekFlags extra_flags);
+static gboolean play_latency_timeout (gpointer user_data);
+static void play_step_keyframe (GstPlayMod * play, gboolean forward);
+static void play_select_track_command (GstPlayMod * play, const gchar * arg);
+static void play_pacing_attach (GstPlayMod * play, GstElement * sink);
+static void play_index_attach (GstPlayMod * play, GstElement * decoder);
+static void play_wrap_attach (GstElement * sink);
+static void play_hold_attach (GstPlayMod * play, GstElement * sink);
+static void play_carry_attach (GstPlayMod * play, GstElement * sink);
+static void play_fade_attach (GstPlayMod * play, GstElement * sink,
+    gboolean is_audio);
+static void play_timeshift_setup_queue (GstPlayMod * play, GstElement * queue);
+static void play_timeshift_catch_up (GstPlayMod * play);
+static gboolean play_mosaic_command (GstPlayMod * play,
+    GstPlayModCommandType type);
+static gboolean play_sync_command (GstPlayMod * play,
+    GstPlayModCommandType type);
+
+static GstClockTime play_item_in (GstPlayMod * play);
+static void play_end_of_playlist (GstPlayMod * play);
+
+static const struct
+{
+  const gchar *name;
+  GstPlayModCommandType type;
+} play_commands[] = {
+  {"Quit", GST_PLAY_MOD_COMMAND_QUIT},
+  {"TogglePaused", GST_PLAY_MOD_COMMAND_TOGGLE_PAUSED},
+  {"PlayNext", GST_PLAY_MOD_COMMAND_PLAY_NEXT},
+  {"PlayPrevious", GST_PLAY_MOD_COMMAND_PLAY_PREVIOUS},
+  {"IncreasePlaybackRate", GST_PLAY_MOD_COMMAND_INCREASE_RATE},
+  {"DecreasePlaybackRate", GST_PLAY_MOD_COMMAND_DECREASE_RATE},
+  {"ChangePlaybackDirection", GST_PLAY_MOD_COMMAND_CHANGE_DIRECTION},
+  {"ToggleTrickMode", GST_PLAY_MOD_COMMAND_TOGGLE_TRICK_MODE},
+  {"ChangeAudioTrack", GST_PLAY_MOD_COMMAND_CHANGE_AUDIO_TRACK},
+  {"ChangeVideoTrack", GST_PLAY_MOD_COMMAND_CHANGE_VIDEO_TRACK},
+  {"ChangeSubtitleTrack", GST_PLAY_MOD_COMMAND_CHANGE_SUBTITLE_TRACK},
+  {"SeekToBeginning", GST_PLAY_MOD_COMMAND_SEEK_TO_BEGINNING},
+  {"ToggleAudioMute", GST_PLAY_MOD_COMMAND_TOGGLE_MUTE},
+  {"IncreaseAudioVolume", GST_PLAY_MOD_COMMAND_INCREASE_VOLUME},
+  {"DecreaseAudioVolume", GST_PLAY_MOD_COMMAND_DECREASE_VOLUME},
+  {"SeekRight", GST_PLAY_MOD_COMMAND_SEEK_RIGHT},
+  {"SeekLeft", GST_PLAY_MOD_COMMAND_SEEK_LEFT},
+  {"CatchUp", GST_PLAY_MOD_COMMAND_CATCH_UP},
+  {"NextKeyframe", GST_PLAY_MOD_COMMAND_NEXT_KEYFRAME},
+  {"PreviousKeyframe", GST_PLAY_MOD_COMMAND_PREVIOUS_KEYFRAME},
+  {"DumpTuning", GST_PLAY_MOD_COMMAND_DUMP_TUNING},
+  {"PrintStats", GST_PLAY_MOD_COMMAND_PRINT_STATS},
+  {"SelectTrack", GST_PLAY_MOD_COMMAND_SELECT_TRACK},
+};
+
+gboolean
+gst_play_mod_command_lookup (const gchar * name, GstPlayModCommandType * type)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (play_commands); i++) {
+    if (g_str_equal (play_commands[i].name, name)) {
+      *type = play_commands[i].type;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+const gchar *
+gst_play_mod_command_get_name (GstPlayModCommandType type)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (play_commands); i++) {
+    if (play_commands[i].type == type)
+      return play_commands[i].name;
+  }
+  return "unknown";
+}
+
+/* may be called from any thread */
+void
+gst_play_mod_command_push (GstPlayMod * play, GstPlayModCommandType type)
+{
+  gst_play_mod_command_push_full (play, type, NULL);
+}
+
+/* any thread */
+static void
+play_command_queue_push (GstPlayModCommandQueue * queue,
+    GstPlayModCommand * cmd)
+{
+  gint depth;
+
+  cmd->queued = g_get_monotonic_time ();
+
+  do {
+    cmd->next = g_atomic_pointer_get (&queue->head);
+  } while (!g_atomic_pointer_compare_and_exchange (&queue->head, cmd->next,
+          cmd));
+
+  depth = g_atomic_int_add (&queue->depth, 1) + 1;
+  if (depth > g_atomic_int_get (&queue->max_depth))
+    g_atomic_int_set (&queue->max_depth, depth);
+
+  g_main_context_wakeup (queue->context);
+}
+
+static GstPlayModCommand *
+play_command_entry_new (PlayEntryKind kind)
+{
+  GstPlayModCommand *cmd = g_new0 (GstPlayModCommand, 1);
+
+  cmd->kind = kind;
+  return cmd;
+}
+
+static void
+play_command_entry_free (GstPlayModCommand * cmd)
+{
+  g_free (cmd->arg);
+  if (cmd->message)
+    gst_message_unref (cmd->message);
+  if (cmd->source)
+    g_source_unref (cmd->source);
+  if (cmd->job)
+    play_state_job_free (cmd->job);
+  g_free (cmd);
+}
+
+/* same, for commands taking an argument such as SelectTrack */
+void
+gst_play_mod_command_push_full (GstPlayMod * play, GstPlayModCommandType type,
+    const gchar * arg)
+{
+  GstPlayModCommand *cmd;
+
+  cmd = play_command_entry_new (PLAY_ENTRY_COMMAND);
+  cmd->type = type;
+  cmd->arg = g_strdup (arg);
+  play_command_queue_push (&play->commands, cmd);
+}
+
+/* streaming threads: messages are handled on the control thread in the
+ * order they were posted, along with everything else */
+static GstBusSyncReply
+play_bus_sync (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModCommand *cmd;
+
+  cmd = play_command_entry_new (PLAY_ENTRY_MESSAGE);
+  cmd->message = gst_message_ref (msg);
+  play_command_queue_push (&play->commands, cmd);
+  return GST_BUS_DROP;
+}
+
+static void
+play_command_run (GstPlayMod * play, GstPlayModCommandType type,
+    const gchar * arg)
+{
+  if (play->mosaic != NULL && play_mosaic_command (play, type))
+    return;
+  if (play->sync != NULL && !play->sync->master &&
+      play_sync_command (play, type))
+    return;
+
+  switch (type) {
+    case GST_PLAY_MOD_COMMAND_QUIT:
+      gst_play_mod_quit (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_TOGGLE_PAUSED:
+      gst_play_mod_toggle_paused (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_PLAY_NEXT:
+      if (!gst_play_mod_next (play))
+        play_end_of_playlist (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_PLAY_PREVIOUS:
+      gst_play_mod_prev (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_INCREASE_RATE:
+      if (play->rate > -0.2 && play->rate < 0.0)
+        gst_play_mod_set_relative_playback_rate (play, 0.0, TRUE);
+      else if (ABS (play->rate) < 2.0)
+        gst_play_mod_set_relative_playback_rate (play, 0.1, FALSE);
+      else if (ABS (play->rate) < 4.0)
+        gst_play_mod_set_relative_playback_rate (play, 0.5, FALSE);
+      else
+        gst_play_mod_set_relative_playback_rate (play, 1.0, FALSE);
+      break;
+    case GST_PLAY_MOD_COMMAND_DECREASE_RATE:
+      if (play->rate > 0.0 && play->rate < 0.20)
+        gst_play_mod_set_relative_playback_rate (play, 0.0, TRUE);
+      else if (ABS (play->rate) <= 2.0)
+        gst_play_mod_set_relative_playback_rate (play, -0.1, FALSE);
+      else if (ABS (play->rate) <= 4.0)
+        gst_play_mod_set_relative_playback_rate (play, -0.5, FALSE);
+      else
+        gst_play_mod_set_relative_playback_rate (play, -1.0, FALSE);
+      break;
+    case GST_PLAY_MOD_COMMAND_CHANGE_DIRECTION:
+      gst_play_mod_set_relative_playback_rate (play, 0.0, TRUE);
+      break;
+    case GST_PLAY_MOD_COMMAND_TOGGLE_TRICK_MODE:
+      gst_play_mod_switch_trick_mode (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_CHANGE_AUDIO_TRACK:
+      gst_play_mod_cycle_track_selection (play, GST_PLAY_MOD_TRACK_TYPE_AUDIO);
+      break;
+    case GST_PLAY_MOD_COMMAND_CHANGE_VIDEO_TRACK:
+      gst_play_mod_cycle_track_selection (play, GST_PLAY_MOD_TRACK_TYPE_VIDEO);
+      break;
+    case GST_PLAY_MOD_COMMAND_CHANGE_SUBTITLE_TRACK:
+      gst_play_mod_cycle_track_selection (play,
+          GST_PLAY_MOD_TRACK_TYPE_SUBTITLE);
+      break;
+    case GST_PLAY_MOD_COMMAND_SEEK_TO_BEGINNING:
+      gst_play_mod_do_seek (play, play_item_in (play), play->rate,
+          play->trick_mode);
+      break;
+    case GST_PLAY_MOD_COMMAND_TOGGLE_MUTE:
+      gst_play_mod_toggle_audio_mute (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_INCREASE_VOLUME:
+      gst_play_mod_set_relative_volume (play, +1.0 / VOLUME_STEPS);
+      break;
+    case GST_PLAY_MOD_COMMAND_DECREASE_VOLUME:
+      gst_play_mod_set_relative_volume (play, -1.0 / VOLUME_STEPS);
+      break;
+    case GST_PLAY_MOD_COMMAND_SEEK_RIGHT:
+      gst_play_mod_relative_seek (play, +0.08);
+      break;
+    case GST_PLAY_MOD_COMMAND_SEEK_LEFT:
+      gst_play_mod_relative_seek (play, -0.08);
+      break;
+    case GST_PLAY_MOD_COMMAND_CATCH_UP:
+      play_timeshift_catch_up (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_NEXT_KEYFRAME:
+      play_step_keyframe (play, TRUE);
+      break;
+    case GST_PLAY_MOD_COMMAND_PREVIOUS_KEYFRAME:
+      play_step_keyframe (play, FALSE);
+      break;
+    case GST_PLAY_MOD_COMMAND_DUMP_TUNING:
+      gst_play_mod_tuning_dump (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_PRINT_STATS:
+      gst_play_mod_print_stats (play);
+      break;
+    case GST_PLAY_MOD_COMMAND_SELECT_TRACK:
+      play_select_track_command (play, arg);
+      break;
+  }
+}
+
+static gboolean
+play_command_source_prepare (GSource * source, gint * timeout)
+{
+  GstPlayModCommandSource *csource = (GstPlayModCommandSource *) source;
+
+  *timeout = -1;
+  return g_atomic_pointer_get (&csource->queue->head) != NULL;
+}
+
+static gboolean
+play_command_source_check (GSource * source)
+{
+  GstPlayModCommandSource *csource = (GstPlayModCommandSource *) source;
+
+  return g_atomic_pointer_get (&csource->queue->head) != NULL;
+}
+
+static gboolean
+play_command_source_dispatch (GSource * source, GSourceFunc callback,
+    gpointer user_data)
+{
+  return callback (user_data);
+}
+
+static GSourceFuncs play_command_source_funcs = {
+  play_command_source_prepare,
+  play_command_source_check,
+  play_command_source_dispatch,
+  NULL
+};
+
+static void
+play_command_entry_run (GstPlayMod * play, GstPlayModCommand * cmd)
+{
+  GstPlayModCommandQueue *queue = &play->commands;
+  gint64 latency;
+
+  switch (cmd->kind) {
+    case PLAY_ENTRY_COMMAND:
+      play_command_run (play, cmd->type, cmd->arg);
+
+      latency = g_get_monotonic_time () - cmd->queued;
+      queue->count++;
+      queue->latency_total += latency;
+      if (latency > queue->latency_max) {
+        queue->latency_max = latency;
+        queue->slowest = cmd->type;
+      }
+      GST_DEBUG ("%s took %" G_GINT64_FORMAT " us",
+          gst_play_mod_command_get_name (cmd->type), latency);
+      break;
+    case PLAY_ENTRY_MESSAGE:
+      /* left over from an item we already switched away from */
+      if (g_atomic_int_get (&play->switching) > 0)
+        break;
+      play_bus_msg (NULL, cmd->message, play);
+      break;
+    case PLAY_ENTRY_TIMER:
+      if (g_source_is_destroyed (cmd->source))
+        break;
+      cmd->timer->queued = FALSE;
+      if (!cmd->timer->func (play))
+        g_source_destroy (cmd->source);
+      break;
+    case PLAY_ENTRY_SWITCHED:
+      g_atomic_int_add (&play->switching, -1);
+      break;
+    case PLAY_ENTRY_STATE:
+      cmd->job->done (play, cmd->job);
+      break;
+  }
+}
+
+/* runs on the control thread */
+static gboolean
+play_command_dispatch (gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModCommandQueue *queue = &play->commands;
+  GstPlayModCommand *list, *cmd, *fifo = NULL;
+
+  /* take everything queued so far in one go */
+  do {
+    list = g_atomic_pointer_get (&queue->head);
+  } while (!g_atomic_pointer_compare_and_exchange (&queue->head, list, NULL));
+
+  /* producers push to the front, so reverse into arrival order */
+  while (list != NULL) {
+    cmd = list;
+    list = cmd->next;
+    cmd->next = fifo;
+    fifo = cmd;
+  }
+
+  while ((cmd = fifo) != NULL) {
+    fifo = cmd->next;
+    g_atomic_int_add (&queue->depth, -1);
+    play_command_entry_run (play, cmd);
+    play_command_entry_free (cmd);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* takes ownership of @context */
+static void
+play_command_queue_init (GstPlayMod * play, GMainContext * context)
+{
+  GstPlayModCommandQueue *queue = &play->commands;
+  GSource *source;
+
+  queue->context = context;
+
+  source = g_source_new (&play_command_source_funcs,
+      sizeof (GstPlayModCommandSource));
+  ((GstPlayModCommandSource *) source)->queue = queue;
+  g_source_set_callback (source, play_command_dispatch, play, NULL);
+  /* ahead of anything else an application attaches to the context */
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_attach (source, context);
+  queue->source = source;
+}
+
+static void
+play_command_queue_clear (GstPlayMod * play)
+{
+  GstPlayModCommandQueue *queue = &play->commands;
+  GstPlayModCommand *cmd;
+
+  g_source_destroy (queue->source);
+  g_source_unref (queue->source);
+
+  while ((cmd = queue->head) != NULL) {
+    queue->head = cmd->next;
+    play_command_entry_free (cmd);
+  }
+
+  g_main_context_unref (queue->context);
+}
+
+static void
+play_command_print_stats (GstPlayMod * play)
+{
+  GstPlayModCommandQueue *queue = &play->commands;
+
+  if (queue->count == 0)
+    return;
+
+  gst_print ("Commands: %u, queue depth max %d, latency avg %.2f ms, max %.2f"
+      " ms (%s)\n", queue->count, g_atomic_int_get (&queue->max_depth),
+      (gdouble) queue->latency_total / queue->count / 1000,
+      (gdouble) queue->latency_max / 1000,
+      gst_play_mod_command_get_name (queue->slowest));
+}
+
+static xcb_connection_t *
+play_display_ref (void)
+{
+  xcb_connection_t *connection;
+
+  g_mutex_lock (&display_lock);
+  if (display == NULL) {
+    display = xcb_connect (NULL, NULL);
+    if (xcb_connection_has_error (display)) {
+      xcb_disconnect (display);
+      display = NULL;
+    }
+  }
+  if (display != NULL)
+    display_users++;
+  connection = display;
+  g_mutex_unlock (&display_lock);
+
+  return connection;
+}
+
+static void
+play_display_unref (void)
+{
+  g_mutex_lock (&display_lock);
+  if (--display_users == 0) {
+    xcb_disconnect (display);
+    display = NULL;
+  }
+  g_mutex_unlock (&display_lock);
+}
+
+/* the area covered by the RandR output @name */
+static gboolean
+play_output_lookup (xcb_connection_t * connection, const gchar * name,
+    GstPlayModRegion * region)
+{
+  xcb_screen_t *screen;
+  xcb_randr_get_screen_resources_current_reply_t *res;
+  xcb_randr_output_t *outputs;
+  gboolean found = FALSE;
+  gint i, n;
+
+  screen = xcb_setup_roots_iterator (xcb_get_setup (connection)).data;
+  res = xcb_randr_get_screen_resources_current_reply (connection,
+      xcb_randr_get_screen_resources_current (connection, screen->root), NULL);
+  if (res == NULL)
+    return FALSE;
+
+  outputs = xcb_randr_get_screen_resources_current_outputs (res);
+  n = xcb_randr_get_screen_resources_current_outputs_length (res);
+
+  for (i = 0; i < n && !found; i++) {
+    xcb_randr_get_output_info_reply_t *info;
+    xcb_randr_get_crtc_info_reply_t *crtc;
+
+    info = xcb_randr_get_output_info_reply (connection,
+        xcb_randr_get_output_info (connection, outputs[i],
+            res->config_timestamp), NULL);
+    if (info == NULL)
+      continue;
+
+    if (info->crtc != XCB_NONE &&
+        xcb_randr_get_output_info_name_length (info) == strlen (name) &&
+        strncmp ((const gchar *) xcb_randr_get_output_info_name (info), name,
+            strlen (name)) == 0) {
+      crtc = xcb_randr_get_crtc_info_reply (connection,
+          xcb_randr_get_crtc_info (connection, info->crtc,
+              res->config_timestamp), NULL);
+      if (crtc != NULL) {
+        region->x = crtc->x;
+        region->y = crtc->y;
+        region->width = crtc->width;
+        region->height = crtc->height;
+        found = TRUE;
+        free (crtc);
+      }
+    }
+    free (info);
+  }
+  free (res);
+
+  return found;
+}
+
+/* WIDTHxHEIGHT+X+Y, or the name of a RandR output */
+gboolean
+gst_play_mod_parse_region (const gchar * spec, GstPlayModRegion * region)
+{
+  xcb_connection_t *connection;
+  gboolean found;
+
+  if (sscanf (spec, "%ux%u+%d+%d", &region->width, &region->height,
+          &region->x, &region->y) == 4)
+    return TRUE;
+
+  connection = play_display_ref ();
+  if (connection == NULL)
+    return FALSE;
+
+  found = play_output_lookup (connection, spec, region);
+  play_display_unref ();
+
+  return found;
+}
+
+/* fill in the screen size if no region was set */
+static void
+play_region_resolve (GstPlayMod * play, xcb_connection_t * connection)
+{
+  GstPlayModRegion *region = &play->region;
+  xcb_screen_t *screen;
+
+  if (region->width != 0 && region->height != 0)
+    return;
+
+  screen = xcb_setup_roots_iterator (xcb_get_setup (connection)).data;
+  region->x = region->y = 0;
+  region->width = screen->width_in_pixels;
+  region->height = screen->height_in_pixels;
+}
+
+static void
+create_window (GstPlayMod * play, GstMessage * message)
+{
+  xcb_connection_t *connection;
+  xcb_screen_t     *screen;
+  xcb_window_t     window;
+  GstPlayModRegion    *region = &play->region;
+  uint32_t         values[3];
+  uint32_t         mask;
+  guint            n = 0;
+
+  if (play->window != XCB_WINDOW_NONE)
+    goto done;
+
+  connection = play_display_ref ();
+  if (connection == NULL) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+        "Could not connect to the X server\n");
+    return;
+  }
+
+  screen = xcb_setup_roots_iterator (xcb_get_setup (connection)).data;
+  window = xcb_generate_id(connection);
+
+  mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
+  values[n++] = screen->black_pixel;
+  if (region->width != 0 && region->height != 0) {
+    /* keep the window manager from moving it off its output */
+    mask |= XCB_CW_OVERRIDE_REDIRECT;
+    values[n++] = 1;
+  }
+  values[n++] = XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_VISIBILITY_CHANGE |
+      XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+  play_region_resolve (play, connection);
+
+  xcb_create_window (connection, XCB_COPY_FROM_PARENT, window, screen->root,
+    region->x, region->y, region->width, region->height, 0,
+    XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, mask, values);
+
+  xcb_map_window (connection, window);
+  xcb_flush (connection);
+
+  play->window = window;
+
+  g_mutex_lock (&display_lock);
+  display_players = g_list_prepend (display_players, play);
+  g_mutex_unlock (&display_lock);
+
+done:
+  gst_video_overlay_set_window_handle (
+    GST_VIDEO_OVERLAY (GST_MESSAGE_SRC (message)), play->window);
+}
+
+/* process CPU time in microseconds */
+static gint64
+play_cpu_time (void)
+{
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+      G_USEC_PER_SEC + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static GstPlayMod *
+play_display_find (xcb_window_t window)
+{
+  GList *l;
+
+  for (l = display_players; l != NULL; l = l->next) {
+    if (((GstPlayMod *) l->data)->window == window)
+      return l->data;
+  }
+  return NULL;
+}
+
+/* The connection is shared, so whichever player gets here first hands
+ * out the events of all windows */
+static void
+play_display_dispatch (void)
+{
+  xcb_generic_event_t *event;
+  GstPlayMod *play;
+
+  g_mutex_lock (&display_lock);
+  while (display != NULL && (event = xcb_poll_for_event (display)) != NULL) {
+    switch (event->response_type & ~0x80) {
+      case XCB_VISIBILITY_NOTIFY:{
+        xcb_visibility_notify_event_t *ev =
+            (xcb_visibility_notify_event_t *) event;
+
+        if ((play = play_display_find (ev->window)) != NULL)
+          play->obscured = ev->state == XCB_VISIBILITY_FULLY_OBSCURED;
+        break;
+      }
+      case XCB_MAP_NOTIFY:{
+        xcb_map_notify_event_t *ev = (xcb_map_notify_event_t *) event;
+
+        if ((play = play_display_find (ev->window)) != NULL)
+          play->unmapped = FALSE;
+        break;
+      }
+      case XCB_UNMAP_NOTIFY:{
+        xcb_unmap_notify_event_t *ev = (xcb_unmap_notify_event_t *) event;
+
+        if ((play = play_display_find (ev->window)) != NULL)
+          play->unmapped = TRUE;
+        break;
+      }
+      default:
+        break;
+    }
+    free (event);
+  }
+  g_mutex_unlock (&display_lock);
+}
+
+/* put the CPU time since the last switch on the visible or hidden side */
+static void
+play_visibility_account (GstPlayMod * play, gint64 now, gint64 cpu)
+{
+  if (play->visibility_since != 0) {
+    if (g_atomic_int_get (&play->hidden) != GST_PLAY_MOD_HIDDEN_VIDEO_DECODE) {
+      play->hidden_time += now - play->visibility_since;
+      play->hidden_cpu += cpu - play->visibility_cpu;
+    } else {
+      play->visible_time += now - play->visibility_since;
+      play->visible_cpu += cpu - play->visibility_cpu;
+    }
+  }
+  play->visibility_since = now;
+  play->visibility_cpu = cpu;
+}
+
+/* called from play_timeout */
+static void
+play_visibility_update (GstPlayMod * play)
+{
+  GstPlayModHiddenVideo hidden = GST_PLAY_MOD_HIDDEN_VIDEO_DECODE;
+
+  if (play->window == XCB_WINDOW_NONE)
+    return;
+
+  play_display_dispatch ();
+
+  g_mutex_lock (&display_lock);
+  if (play->obscured || play->unmapped)
+    hidden = play->hidden_video;
+  g_mutex_unlock (&display_lock);
+
+  if (hidden == g_atomic_int_get (&play->hidden))
+    return;
+
+  play_visibility_account (play, g_get_monotonic_time (), play_cpu_time ());
+  g_atomic_int_set (&play->hidden, hidden);
+
+  if (hidden == GST_PLAY_MOD_HIDDEN_VIDEO_DECODE) {
+    gst_print ("\nWindow visible again, back to full video decoding.\n");
+  } else {
+    play->hidden_count++;
+    gst_print ("\nWindow hidden, %s.\n",
+        hidden == GST_PLAY_MOD_HIDDEN_VIDEO_KEYFRAMES ?
+        "decoding keyframes only" : "video decoding stopped");
+  }
+}
+
+typedef struct
+{
+  GstPlayMod *play;
+  gboolean passed;              /* a frame went through since the flush */
+  gboolean resync;              /* skipped frames, wait for a keyframe */
+} PlayHiddenProbe;
+
+/* Keeps frames away from the decoder while the window is hidden. Going
+ * back is only possible from a keyframe, and with nothing at all the
+ * sink could not preroll after a seek, so the first keyframe after a
+ * flush always goes through. */
+static GstPadProbeReturn
+play_hidden_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  PlayHiddenProbe *probe = user_data;
+  GstPlayModHiddenVideo hidden = g_atomic_int_get (&probe->play->hidden);
+  gboolean delta;
+
+  if (!(info->type & GST_PAD_PROBE_TYPE_BUFFER)) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+        GST_EVENT_FLUSH_STOP)
+      probe->passed = FALSE;
+    return GST_PAD_PROBE_OK;
+  }
+
+  delta = GST_BUFFER_FLAG_IS_SET (GST_PAD_PROBE_INFO_BUFFER (info),
+      GST_BUFFER_FLAG_DELTA_UNIT);
+
+  if (hidden == GST_PLAY_MOD_HIDDEN_VIDEO_DECODE) {
+    if (probe->resync && delta)
+      goto skip;
+    probe->resync = FALSE;
+  } else if (delta || (hidden == GST_PLAY_MOD_HIDDEN_VIDEO_OFF
+          && probe->passed)) {
+    probe->resync = TRUE;
+    goto skip;
+  }
+
+  probe->passed = TRUE;
+  return GST_PAD_PROBE_OK;
+
+skip:
+  g_atomic_int_inc (&probe->play->frames_skipped);
+  return GST_PAD_PROBE_DROP;
+}
+
+/* called from element-setup for each video decoder */
+static void
+play_hidden_attach (GstPlayMod * play, GstElement * decoder)
+{
+  PlayHiddenProbe *probe;
+  GstPad *pad;
+
+  if (play->hidden_video == GST_PLAY_MOD_HIDDEN_VIDEO_DECODE)
+    return;
+
+  pad = gst_element_get_static_pad (decoder, "sink");
+  if (pad == NULL)
+    return;
+
+  probe = g_new0 (PlayHiddenProbe, 1);
+  probe->play = play;
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_FLUSH, play_hidden_probe, probe, g_free);
+  gst_object_unref (pad);
+}
+
+static void
+play_visibility_print (GstPlayMod * play)
+{
+  if (play->hidden_count == 0)
+    return;
+
+  play_visibility_account (play, g_get_monotonic_time (), play_cpu_time ());
+  gst_print ("Hidden window: %u times, %.1f s, %d frames skipped, CPU %.0f%% "
+      "visible, %.0f%% hidden\n", play->hidden_count,
+      (gdouble) play->hidden_time / G_USEC_PER_SEC,
+      g_atomic_int_get (&play->frames_skipped),
+      play->visible_time ? 100.0 * play->visible_cpu / play->visible_time : 0.0,
+      play->hidden_time ? 100.0 * play->hidden_cpu / play->hidden_time : 0.0);
+}
+
+static const gchar *
+play_log_level_get_name (GstPlayModLogLevel level)
+{
+  switch (level) {
+    case GST_PLAY_MOD_LOG_ERROR:
+      return "error";
+    case GST_PLAY_MOD_LOG_WARNING:
+      return "warning";
+    case GST_PLAY_MOD_LOG_INFO:
+      return "info";
+    case GST_PLAY_MOD_LOG_STATUS:
+      return "status";
+    default:
+      return "debug";
+  }
+}
+
+/* one JSON object per line, without the message's own line breaks */
+static void
+play_log_write_json (FILE * out, const GstPlayModLogEntry * entry)
+{
+  static gchar buf[LOG_ENTRY_SIZE * 6];
+  const gchar *s = entry->text;
+  gsize len = 0;
+
+  while (*s == '\n' || *s == '\r')
+    s++;
+  if (*s == '\0')
+    return;
+
+  for (; *s != '\0'; s++) {
+    guchar c = *s;
+
+    if (c == '"' || c == '\\') {
+      buf[len++] = '\\';
+      buf[len++] = c;
+    } else if (c < 0x20) {
+      if (c == '\n' || c == '\r') {
+        /* trailing line breaks are just terminators */
+        if (s[1] == '\0' || s[1] == '\n' || s[1] == '\r')
+          continue;
+        buf[len++] = '\\';
+        buf[len++] = c == '\n' ? 'n' : 'r';
+      } else {
+        len += g_snprintf (buf + len, 7, "\\u%04x", c);
+      }
+    } else {
+      buf[len++] = c;
+    }
+  }
+  buf[len] = '\0';
+
+  fprintf (out, "{\"time\":%" G_GINT64_FORMAT ".%06d,\"level\":\"%s\","
+      "\"message\":\"%s\"}\n", entry->time / G_USEC_PER_SEC,
+      (gint) (entry->time % G_USEC_PER_SEC),
+      play_log_level_get_name (entry->level), buf);
+}
+
+static gpointer
+play_log_thread (gpointer user_data)
+{
+  static GstPlayModLogEntry entry;
+  guint dropped;
+
+  g_mutex_lock (&log_lock);
+  for (;;) {
+    if (log_count == 0) {
+      g_cond_broadcast (&log_drained);
+      g_cond_wait (&log_cond, &log_lock);
+      continue;
+    }
+
+    entry = log_entries[log_head];
+    if (log_status == (gint) log_head)
+      log_status = -1;
+    log_head = (log_head + 1) % LOG_ENTRIES;
+    log_count--;
+    dropped = log_dropped;
+    log_dropped = 0;
+    log_writing = TRUE;
+    g_mutex_unlock (&log_lock);
+
+    if (dropped > 0)
+      fprintf (stderr, "(%u log messages dropped)\n", dropped);
+
+    if (log_json) {
+      play_log_write_json (stdout, &entry);
+      fflush (stdout);
+    } else if (entry.level <= GST_PLAY_MOD_LOG_WARNING) {
+      fputs (entry.text, stderr);
+    } else {
+      fputs (entry.text, stdout);
+      fflush (stdout);
+    }
+
+    g_mutex_lock (&log_lock);
+    log_writing = FALSE;
+  }
+
+  return NULL;
+}
+
+/* Formats into a free ring entry and returns: nothing is allocated and
+ * nothing waits for the console. A status line replaces one that wasn't
+ * written yet, and when the ring is full the message is dropped and
+ * counted. May be called from any thread. */
+void
+gst_play_mod_log (GstPlayModLogLevel level, const gchar * format, ...)
+{
+  GstPlayModLogEntry *entry;
+  gchar text[LOG_ENTRY_SIZE];
+  va_list args;
+  gboolean status;
+  gsize len;
+
+  va_start (args, format);
+  g_vsnprintf (text, sizeof (text), format, args);
+  va_end (args);
+
+  len = strlen (text);
+  status = level == GST_PLAY_MOD_LOG_STATUS;
+
+  if ((gint) level > g_atomic_int_get (&log_level))
+    return;
+
+  g_mutex_lock (&log_lock);
+  if (log_entries == NULL) {
+    log_entries = g_new (GstPlayModLogEntry, LOG_ENTRIES);
+    g_thread_unref (g_thread_new ("log", play_log_thread, NULL));
+  }
+
+  if (status && log_status >= 0 &&
+      (guint) log_status == (log_head + log_count - 1) % LOG_ENTRIES) {
+    entry = &log_entries[log_status];
+  } else if (log_count == LOG_ENTRIES) {
+    log_dropped++;
+    g_mutex_unlock (&log_lock);
+    return;
+  } else {
+    guint idx = (log_head + log_count) % LOG_ENTRIES;
+
+    entry = &log_entries[idx];
+    log_status = status ? (gint) idx : -1;
+    log_count++;
+  }
+
+  entry->level = level;
+  entry->time = g_get_real_time ();
+  memcpy (entry->text, text, len + 1);
+
+  g_cond_signal (&log_cond);
+  g_mutex_unlock (&log_lock);
+}
+
+/* waits until everything logged so far is written */
+void
+gst_play_mod_log_flush (void)
+{
+  g_mutex_lock (&log_lock);
+  while (log_entries != NULL && (log_count > 0 || log_writing))
+    g_cond_wait (&log_drained, &log_lock);
+  g_mutex_unlock (&log_lock);
+}
+
+void
+gst_play_mod_log_set_level (GstPlayModLogLevel level)
+{
+  g_atomic_int_set (&log_level, level);
+}
+
+void
+gst_play_mod_log_set_json (gboolean json)
+{
+  log_json = json;
+}
+
+void
+gst_play_mod_set_quiet (gboolean q)
+{
+  gst_play_mod_log_set_level (q ? GST_PLAY_MOD_LOG_WARNING :
+      GST_PLAY_MOD_LOG_STATUS);
+}
+
+static void
+play_emit (GstPlayMod * play, GstPlayModEvent * event)
+{
+  if (play->event_func != NULL)
+    play->event_func (play, event, play->event_data);
+}
+
+static void
+play_emit_error (GstPlayMod * play, GstPlayModEventType type,
+    const GError * err)
+{
+  GstPlayModEvent event = { type, };
+
+  event.index = play->cur_idx;
+  event.uri = play->cur_idx >= 0 ? play->uris[play->cur_idx] : NULL;
+  event.error = err;
+  play_emit (play, &event);
+}
+
+static void
+play_emit_rate (GstPlayMod * play)
+{
+  GstPlayModEvent event = { GST_PLAY_MOD_EVENT_RATE_CHANGED, };
+
+  event.rate = play->rate;
+  event.trick_mode = play->trick_mode;
+  play_emit (play, &event);
+}
+
+static void
+play_emit_volume (GstPlayMod * play)
+{
+  GstPlayModEvent event = { GST_PLAY_MOD_EVENT_VOLUME_CHANGED, };
+
+  event.volume = gst_stream_volume_get_volume (GST_STREAM_VOLUME
+      (play->playbin), GST_STREAM_VOLUME_FORMAT_CUBIC);
+  event.mute = gst_stream_volume_get_mute (GST_STREAM_VOLUME (play->playbin));
+  play_emit (play, &event);
+}
+
+/* the selected track of @type, counting from 0, or -1 */
+static gint
+play_current_track (GstPlayMod * play, GstStreamType type, const gchar * sid,
+    const gchar * prop_cur, guint flag)
+{
+  guint flags, i, len;
+  gint cur = -1, n = 0;
+
+  if (!play->is_playbin3) {
+    g_object_get (play->playbin, "flags", &flags, prop_cur, &cur, NULL);
+    return (flags & flag) ? cur : -1;
+  }
+
+  if (sid == NULL || play->collection == NULL)
+    return -1;
+
+  len = gst_stream_collection_get_size (play->collection);
+  for (i = 0; i < len; i++) {
+    GstStream *stream = gst_stream_collection_get_stream (play->collection, i);
+
+    if (!(gst_stream_get_stream_type (stream) & type))
+      continue;
+    if (g_str_equal (gst_stream_get_stream_id (stream), sid))
+      return n;
+    n++;
+  }
+  return -1;
+}
+
+static void
+play_emit_tracks (GstPlayMod * play)
+{
+  GstPlayModEvent event = { GST_PLAY_MOD_EVENT_TRACKS_CHANGED, };
+
+  g_mutex_lock (&play->selection_lock);
+  event.audio_track = play_current_track (play, GST_STREAM_TYPE_AUDIO,
+      play->cur_audio_sid, "current-audio", 0x2);
+  event.video_track = play_current_track (play, GST_STREAM_TYPE_VIDEO,
+      play->cur_video_sid, "current-video", 0x1);
+  event.subtitle_track = play_current_track (play, GST_STREAM_TYPE_TEXT,
+      play->cur_text_sid, "current-text", 0x4);
+  g_mutex_unlock (&play->selection_lock);
+
+  play_emit (play, &event);
+}
+
+/* called from play_timeout */
+static void
+play_emit_position (GstPlayMod * play, gint64 pos, gint64 dur)
+{
+  GstPlayModEvent event = { GST_PLAY_MOD_EVENT_POSITION, };
+  gint64 now;
+
+  if (play->position_interval == 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  if (now - play->position_sent < play->position_interval * 1000)
+    return;
+  play->position_sent = now;
+
+  event.position = pos;
+  event.duration = dur;
+  play_emit (play, &event);
+}
+
+static void
+play_end_of_playlist (GstPlayMod * play)
+{
+  GstPlayModEvent event = { GST_PLAY_MOD_EVENT_END_OF_PLAYLIST, };
+
+  gst_print ("\n%s\n", "Reached end of play list.");
+  play_emit (play, &event);
+  gst_play_mod_quit (play);
+}
+
+/* properties reported by gst_play_mod_tuning_dump() */
+static const gchar *tuning_properties[] = {
+  "max-threads", "threads", "n-threads", "thread-type", "low-latency",
+  "max-size-buffers", "max-size-bytes", "max-size-time",
+  "buffer-size", "buffer-duration", "use-buffering", NULL
+};
+
+/* decoders don't agree on what to call their thread count */
+static const gchar *decoder_thread_properties[] = {
+  "max-threads", "threads", "n-threads", NULL
+};
+
+void
+gst_play_mod_tuning_init (GstPlayModTuning * tuning)
+{
+  tuning->decoder_max_threads = -1;
+  tuning->decoder_low_latency = FALSE;
+  tuning->queue_max_buffers = -1;
+  tuning->queue_max_bytes = -1;
+  tuning->queue_max_time = -1;
+  tuning->buffer_size = -1;
+  tuning->buffer_duration = -1;
+  tuning->properties = NULL;
+  tuning->dump = FALSE;
+  tuning->buffer_low_percent = 10;
+  tuning->buffer_high_percent = 100;
+  tuning->low_latency = FALSE;
+  tuning->latency_target = 200 * GST_MSECOND;
+}
+
+void
+gst_play_mod_tuning_add_property (GstPlayModTuning * tuning,
+    const gchar * assignment)
+{
+  guint n = tuning->properties ? g_strv_length (tuning->properties) : 0;
+
+  if (strchr (assignment, '.') == NULL || strchr (assignment, '=') == NULL) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+        "Ignoring malformed property '%s', expected FACTORY.PROPERTY=VALUE\n",
+        assignment);
+    return;
+  }
+
+  tuning->properties = g_renew (gchar *, tuning->properties, n + 2);
+  tuning->properties[n] = g_strdup (assignment);
+  tuning->properties[n + 1] = NULL;
+}
+
+/* The key file getters leave @value alone if the key is missing, and
+ * also if it's malformed, with a warning instead of silently using 0 */
+static gboolean
+play_tuning_check (const gchar * group, const gchar * key, GError * err)
+{
+  if (err == NULL)
+    return TRUE;
+
+  if (err->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND &&
+      err->code != G_KEY_FILE_ERROR_GROUP_NOT_FOUND)
+    gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING, "Ignoring [%s] %s: %s\n",
+        group, key, err->message);
+  g_error_free (err);
+  return FALSE;
+}
+
+static gboolean
+play_tuning_get_int (GKeyFile * kf, const gchar * group, const gchar * key,
+    gint * value)
+{
+  GError *err = NULL;
+  gint v = g_key_file_get_integer (kf, group, key, &err);
+
+  if (!play_tuning_check (group, key, err))
+    return FALSE;
+  *value = v;
+  return TRUE;
+}
+
+/* in ms in the file */
+static gboolean
+play_tuning_get_time (GKeyFile * kf, const gchar * group, const gchar * key,
+    gint64 * value)
+{
+  GError *err = NULL;
+  gint64 v = g_key_file_get_int64 (kf, group, key, &err);
+
+  if (!play_tuning_check (group, key, err))
+    return FALSE;
+  *value = v * GST_MSECOND;
+  return TRUE;
+}
+
+static gboolean
+play_tuning_get_boolean (GKeyFile * kf, const gchar * group,
+    const gchar * key, gboolean * value)
+{
+  GError *err = NULL;
+  gboolean v = g_key_file_get_boolean (kf, group, key, &err);
+
+  if (!play_tuning_check (group, key, err))
+    return FALSE;
+  *value = v;
+  return TRUE;
+}
+
+/* Key file layout:
+ *
+ *   [decoder]    max-threads, low-latency
+ *   [queue]      max-size-buffers, max-size-bytes, max-size-time (ms)
+ *   [buffering]  buffer-size (bytes), buffer-duration (ms),
+ *                low-percent, high-percent
+ *   [latency]    low-latency, target (ms)
+ *   [properties] FACTORY.PROPERTY=VALUE
+ */
+gboolean
+gst_play_mod_tuning_load (GstPlayModTuning * tuning, const gchar * filename,
+    GError ** error)
+{
+  GKeyFile *kf;
+  gchar **keys;
+  gsize i, n_keys;
+  gint64 target;
+
+  kf = g_key_file_new ();
+  if (!g_key_file_load_from_file (kf, filename, G_KEY_FILE_NONE, error)) {
+    g_key_file_free (kf);
+    return FALSE;
+  }
+
+  play_tuning_get_int (kf, "decoder", "max-threads",
+      &tuning->decoder_max_threads);
+  play_tuning_get_boolean (kf, "decoder", "low-latency",
+      &tuning->decoder_low_latency);
+
+  play_tuning_get_int (kf, "queue", "max-size-buffers",
+      &tuning->queue_max_buffers);
+  play_tuning_get_int (kf, "queue", "max-size-bytes",
+      &tuning->queue_max_bytes);
+  play_tuning_get_time (kf, "queue", "max-size-time", &tuning->queue_max_time);
+
+  play_tuning_get_int (kf, "buffering", "buffer-size", &tuning->buffer_size);
+  play_tuning_get_time (kf, "buffering", "buffer-duration",
+      &tuning->buffer_duration);
+  play_tuning_get_int (kf, "buffering", "low-percent",
+      &tuning->buffer_low_percent);
+  play_tuning_get_int (kf, "buffering", "high-percent",
+      &tuning->buffer_high_percent);
+
+  play_tuning_get_boolean (kf, "latency", "low-latency", &tuning->low_latency);
+  if (play_tuning_get_time (kf, "latency", "target", &target)) {
+    if (target >= 0)
+      tuning->latency_target = target;
+    else
+      gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+          "Ignoring negative [latency] target\n");
+  }
+  if (tuning->low_latency)
+    tuning->decoder_low_latency = TRUE;
+
+  keys = g_key_file_get_keys (kf, "properties", &n_keys, NULL);
+  for (i = 0; keys != NULL && i < n_keys; i++) {
+    gchar *value, *assignment;
+
+    value = g_key_file_get_string (kf, "properties", keys[i], NULL);
+    assignment = g_strdup_printf ("%s=%s", keys[i], value ? value : "");
+    gst_play_mod_tuning_add_property (tuning, assignment);
+    g_free (assignment);
+    g_free (value);
+  }
+  g_strfreev (keys);
+
+  g_key_file_free (kf);
+  return TRUE;
+}
+
+static gboolean
+play_tuning_set (GstElement * element, const gchar * prop, const gchar * value)
+{
+  gchar *name;
+
+  if (!g_object_class_find_property (G_OBJECT_GET_CLASS (element), prop))
+    return FALSE;
+
+  name = gst_object_get_path_string (GST_OBJECT (element));
+  GST_INFO ("%s: setting %s = %s", name, prop, value);
+  g_free (name);
+
+  gst_util_set_object_arg (G_OBJECT (element), prop, value);
+  return TRUE;
+}
+
+static void
+play_tuning_set_int64 (GstElement * element, const gchar * prop, gint64 value)
+{
+  gchar str[32];
+
+  g_snprintf (str, sizeof (str), "%" G_GINT64_FORMAT, value);
+  play_tuning_set (element, prop, str);
+}
+
+/* called from whichever thread playbin happens to add the element in */
+static void
+play_element_setup (GstElement * playbin, GstElement * element,
+    gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModTuning *tuning = &play->tuning;
+  GstElementFactory *factory;
+  const gchar *factory_name, *klass;
+  guint i;
+
+  factory = gst_element_get_factory (element);
+  if (factory == NULL)
+    return;
+
+  factory_name = gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory));
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+
+  if (tuning->low_latency) {
+    if (g_str_equal (factory_name, "rtspsrc") ||
+        g_str_equal (factory_name, "rtpjitterbuffer")) {
+      gchar str[16];
+
+      /* leave the other half of the budget to decoding and rendering */
+      g_snprintf (str, sizeof (str), "%" G_GUINT64_FORMAT,
+          tuning->latency_target / GST_MSECOND / 2);
+      play_tuning_set (element, "latency", str);
+      play_tuning_set (element, "drop-on-latency", "true");
+    }
+    if (klass != NULL && (strstr (klass, "Sink") != NULL ||
+            strstr (klass, "Decoder") != NULL))
+      play_tuning_set (element, "qos", "true");
+  }
+
+  if (klass != NULL && strstr (klass, "Decoder") != NULL) {
+    if (tuning->decoder_max_threads >= 0) {
+      for (i = 0; decoder_thread_properties[i] != NULL; i++) {
+        gchar str[16];
+
+        g_snprintf (str, sizeof (str), "%d", tuning->decoder_max_threads);
+        if (play_tuning_set (element, decoder_thread_properties[i], str))
+          break;
+      }
+    }
+    if (tuning->decoder_low_latency) {
+      play_tuning_set (element, "low-latency", "true");
+      /* frame threading adds a frame of delay per thread */
+      play_tuning_set (element, "thread-type", "slice");
+    }
+    if (strstr (klass, "Video") != NULL) {
+      play_index_attach (play, element);
+      play_hidden_attach (play, element);
+    }
+  }
+
+  if (play->timeshift != NULL && g_str_equal (factory_name, "queue2"))
+    play_timeshift_setup_queue (play, element);
+
+  if (klass != NULL && strstr (klass, "Sink") != NULL && !GST_IS_BIN (element)
+      && (strstr (klass, "Video") != NULL || strstr (klass, "Audio") != NULL)) {
+    /* first, so the others see the segments it rewrites */
+    play_carry_attach (play, element);
+    play_wrap_attach (element);
+    play_hold_attach (play, element);
+    if (play->fade > 0)
+      play_fade_attach (play, element, strstr (klass, "Audio") != NULL);
+  }
+
+  if (play->pacing != NULL && klass != NULL && strstr (klass, "Sink") != NULL
+      && strstr (klass, "Video") != NULL && !GST_IS_BIN (element))
+    play_pacing_attach (play, element);
+
+  /* decodebin re-applies its own limits to its multiqueue, so go through
+   * decodebin's properties where it has them */
+  if (g_str_equal (factory_name, "decodebin") ||
+      g_str_equal (factory_name, "multiqueue")) {
+    if (tuning->queue_max_buffers >= 0)
+      play_tuning_set_int64 (element, "max-size-buffers",
+          tuning->queue_max_buffers);
+    if (tuning->queue_max_bytes >= 0)
+      play_tuning_set_int64 (element, "max-size-bytes",
+          tuning->queue_max_bytes);
+    if (tuning->queue_max_time >= 0)
+      play_tuning_set_int64 (element, "max-size-time", tuning->queue_max_time);
+  }
+
+  for (i = 0; tuning->properties != NULL && tuning->properties[i]; i++) {
+    const gchar *assignment = tuning->properties[i];
+    const gchar *dot = strchr (assignment, '.');
+    gchar **prop_value;
+
+    if (strncmp (assignment, factory_name, dot - assignment) != 0 ||
+        factory_name[dot - assignment] != '\0')
+      continue;
+
+    prop_value = g_strsplit (dot + 1, "=", 2);
+    if (prop_value[0] != NULL && prop_value[1] != NULL &&
+        !play_tuning_set (element, prop_value[0], prop_value[1]))
+      gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING, "%s has no property '%s'\n",
+          factory_name, prop_value[0]);
+    g_strfreev (prop_value);
+  }
+}
+
+typedef void (*PlayElementFunc) (GstElement * element, gpointer user_data);
+
+static void
+play_foreach_element (GstPlayMod * play, PlayElementFunc func,
+    gpointer user_data)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  gboolean done = FALSE;
+
+  it = gst_bin_iterate_recurse (GST_BIN (play->playbin));
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:
+        func (g_value_get_object (&item), user_data);
+        g_value_reset (&item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+static void
+play_tuning_dump_element (GstElement * element, gpointer user_data)
+{
+  GObjectClass *klass = G_OBJECT_GET_CLASS (element);
+  gchar *name = NULL;
+  guint i;
+
+  for (i = 0; tuning_properties[i] != NULL; i++) {
+    GParamSpec *pspec;
+    GValue val = G_VALUE_INIT;
+    gchar *val_str;
+
+    pspec = g_object_class_find_property (klass, tuning_properties[i]);
+    if (pspec == NULL || !(pspec->flags & G_PARAM_READABLE))
+      continue;
+
+    if (name == NULL)
+      name = gst_object_get_path_string (GST_OBJECT (element));
+
+    g_value_init (&val, pspec->value_type);
+    g_object_get_property (G_OBJECT (element), pspec->name, &val);
+    val_str = g_strdup_value_contents (&val);
+    gst_print ("  %s: %s = %s\n", name, pspec->name, val_str);
+    g_free (val_str);
+    g_value_unset (&val);
+  }
+
+  g_free (name);
+}
+
+void
+gst_play_mod_tuning_dump (GstPlayMod * play)
+{
+  gst_print ("\nEffective tuning:\n");
+  play_tuning_dump_element (play->playbin, NULL);
+  play_foreach_element (play, play_tuning_dump_element, NULL);
+}
+
+static gboolean
+play_is_jitterbuffer (GstElement * element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  return factory != NULL && g_str_equal (gst_plugin_feature_get_name
+      (GST_PLUGIN_FEATURE (factory)), "rtpjitterbuffer");
+}
+
+/* the largest jitterbuffer latency in ms, that's what adds up */
+static void
+play_jitterbuffer_latency (GstElement * element, gpointer user_data)
+{
+  guint *max = user_data;
+  guint latency;
+
+  if (!play_is_jitterbuffer (element))
+    return;
+
+  g_object_get (element, "latency", &latency, NULL);
+  *max = MAX (*max, latency);
+}
+
+static void
+play_shrink_jitterbuffer (GstElement * element, gpointer user_data)
+{
+  guint target_ms = GPOINTER_TO_UINT (user_data);
+  guint latency;
+  gchar *name;
+
+  if (!play_is_jitterbuffer (element))
+    return;
+
+  g_object_get (element, "latency", &latency, NULL);
+  if (latency <= target_ms)
+    return;
+
+  name = gst_object_get_path_string (GST_OBJECT (element));
+  gst_print ("\n%s: reducing latency from %u ms to %u ms\n", name, latency,
+      target_ms);
+  g_free (name);
+
+  /* the jitterbuffer posts a latency message, which makes us redistribute */
+  g_object_set (element, "latency", target_ms, NULL);
+}
+
+/* Only the jitterbuffers' share of the latency can be shrunk, sinks and
+ * decoders keep theirs. Stops for the item once a step didn't bring the
+ * pipeline latency down or frames started to drop. */
+static void
+play_latency_shrink (GstPlayMod * play, GstClockTime min_latency)
+{
+  GstClockTime target = play->tuning.latency_target, jitterbuffer, rest;
+  guint jitterbuffer_ms = 0, new_ms;
+
+  if (play->shrink_done)
+    return;
+
+  if (GST_CLOCK_TIME_IS_VALID (play->shrink_latency) &&
+      (min_latency >= play->shrink_latency ||
+          play->qos_dropped > play->shrink_dropped)) {
+    gst_print ("\nShrinking the jitterbuffer stopped helping, keeping "
+        "%" G_GUINT64_FORMAT " ms\n", min_latency / GST_MSECOND);
+    play->shrink_done = TRUE;
+    return;
+  }
+  play->shrink_latency = GST_CLOCK_TIME_NONE;
+
+  if (min_latency <= target)
+    return;
+
+  play_foreach_element (play, play_jitterbuffer_latency, &jitterbuffer_ms);
+  jitterbuffer = jitterbuffer_ms * GST_MSECOND;
+  rest = min_latency > jitterbuffer ? min_latency - jitterbuffer : 0;
+
+  if (rest + LOW_LATENCY_MIN_JITTERBUFFER_MS * GST_MSECOND >= target) {
+    gst_print ("\nLatency target out of reach, %" G_GUINT64_FORMAT " ms "
+        "are outside the jitterbuffer\n", rest / GST_MSECOND);
+    play->shrink_done = TRUE;
+    return;
+  }
+
+  new_ms = (target - rest) / GST_MSECOND;
+  if (new_ms >= jitterbuffer_ms)
+    return;
+
+  play->shrink_latency = min_latency;
+  play->shrink_dropped = play->qos_dropped;
+  play_foreach_element (play, play_shrink_jitterbuffer,
+      GUINT_TO_POINTER (new_ms));
+}
+
+/* report end-to-end latency of live pipelines once a second and pull the
+ * jitterbuffers in when we are above target */
+static gboolean
+play_latency_timeout (gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstQuery *query;
+  gboolean live = FALSE;
+  GstClockTime min_latency = 0, max_latency = 0, latency;
+
+  if (!play->is_live)
+    return TRUE;
+
+  query = gst_query_new_latency ();
+  if (gst_element_query (play->playbin, query))
+    gst_query_parse_latency (query, &live, &min_latency, &max_latency);
+  gst_query_unref (query);
+
+  if (!live)
+    return TRUE;
+
+  /* configured latency plus however late the sinks recently rendered */
+  latency = min_latency + MAX (play->qos_jitter, 0);
+
+  gst_print ("Latency: %" G_GUINT64_FORMAT " ms (target %" G_GUINT64_FORMAT
+      " ms, %" G_GUINT64_FORMAT " frames dropped)   \r",
+      latency / GST_MSECOND, play->tuning.latency_target / GST_MSECOND,
+      play->qos_dropped);
+
+  play->qos_jitter /= 2;
+
+  play_latency_shrink (play, min_latency);
+
+  return TRUE;
+}
+
+#define CACHE_INDEX_KEY_SIZE "size"
+
+/* Copies what a network source pushes into a temporary file; if the stream
+ * reaches EOS without gaps it is handed to the main thread to be indexed. */
+typedef struct
+{
+  gchar *key;
+  gchar *uri;
+  gchar *tmp_path;
+  FILE *file;
+  guint64 offset;
+  gchar *etag;
+  gchar *last_modified;
+  gboolean done;
+} PlayCacheWriter;
+
+static gchar *
+play_cache_key (const gchar * uri)
+{
+  return g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+}
+
+static gboolean
+play_cache_is_cacheable (const gchar * uri)
+{
+  return gst_uri_has_protocol (uri, "http") ||
+      gst_uri_has_protocol (uri, "https");
+}
+
+static gchar *
+play_cache_path (GstPlayModCache * cache, const gchar * key)
+{
+  return g_build_filename (cache->dir, key, NULL);
+}
+
+static void
+play_cache_save (GstPlayModCache * cache)
+{
+  GError *err = NULL;
+  gchar *path;
+
+  path = g_build_filename (cache->dir, "index", NULL);
+  if (!g_key_file_save_to_file (cache->index, path, &err)) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+        "Could not write cache index: %s\n", err->message);
+    g_clear_error (&err);
+  }
+  g_free (path);
+}
+
+static void
+play_cache_remove_entry (GstPlayModCache * cache, const gchar * key)
+{
+  gchar *path;
+
+  cache->size -= g_key_file_get_uint64 (cache->index, key,
+      CACHE_INDEX_KEY_SIZE, NULL);
+
+  path = play_cache_path (cache, key);
+  g_unlink (path);
+  g_free (path);
+
+  g_key_file_remove_group (cache->index, key, NULL);
+}
+
+/* drop least recently used entries until we are within budget */
+static void
+play_cache_evict (GstPlayModCache * cache)
+{
+  while (cache->size > cache->max_size) {
+    gchar **groups, *oldest = NULL;
+    gint64 oldest_access = G_MAXINT64;
+    guint i;
+
+    groups = g_key_file_get_groups (cache->index, NULL);
+    for (i = 0; groups[i] != NULL; i++) {
+      gint64 accessed;
+
+      accessed = g_key_file_get_int64 (cache->index, groups[i], "accessed",
+          NULL);
+      if (accessed < oldest_access) {
+        oldest_access = accessed;
+        oldest = groups[i];
+      }
+    }
+
+    if (oldest != NULL) {
+      GST_INFO ("evicting %s", oldest);
+      play_cache_remove_entry (cache, oldest);
+    }
+    g_strfreev (groups);
+
+    if (oldest == NULL)
+      break;
+  }
+}
+
+static GstPlayModCache *
+play_cache_new (const gchar * dir, guint64 max_size, gint64 max_age)
+{
+  GstPlayModCache *cache;
+  gchar *path, **groups;
+  const gchar *entry;
+  GDir *d;
+  guint i;
+
+  if (g_mkdir_with_parents (dir, 0755) != 0) {
+    gst_printerr ("Could not create cache directory %s: %s\n", dir,
+        g_strerror (errno));
+    return NULL;
+  }
+
+  cache = g_new0 (GstPlayModCache, 1);
+  cache->dir = g_strdup (dir);
+  cache->max_size = max_size;
+  cache->max_age = max_age;
+  g_mutex_init (&cache->lock);
+  g_queue_init (&cache->fetch_queue);
+
+  cache->index = g_key_file_new ();
+  path = g_build_filename (dir, "index", NULL);
+  g_key_file_load_from_file (cache->index, path, G_KEY_FILE_NONE, NULL);
+  g_free (path);
+
+  /* forget entries whose data went missing */
+  groups = g_key_file_get_groups (cache->index, NULL);
+  for (i = 0; groups[i] != NULL; i++) {
+    path = play_cache_path (cache, groups[i]);
+    if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+      cache->size += g_key_file_get_uint64 (cache->index, groups[i],
+          CACHE_INDEX_KEY_SIZE, NULL);
+    else
+      g_key_file_remove_group (cache->index, groups[i], NULL);
+    g_free (path);
+  }
+  g_strfreev (groups);
+
+  /* and partial downloads of a previous run */
+  if ((d = g_dir_open (dir, 0, NULL))) {
+    while ((entry = g_dir_read_name (d))) {
+      if (g_str_has_suffix (entry, ".part")) {
+        path = g_build_filename (dir, entry, NULL);
+        g_unlink (path);
+        g_free (path);
+      }
+    }
+    g_dir_close (d);
+  }
+
+  play_cache_evict (cache);
+  return cache;
+}
+
+static void
+play_cache_free (GstPlayModCache * cache)
+{
+  if (cache->fetch != NULL) {
+    gst_element_set_state (cache->fetch, GST_STATE_NULL);
+    gst_bus_remove_watch (GST_ELEMENT_BUS (cache->fetch));
+    gst_object_unref (cache->fetch);
+  }
+  g_free (cache->fetch_key);
+  g_queue_foreach (&cache->fetch_queue, (GFunc) g_free, NULL);
+  g_queue_clear (&cache->fetch_queue);
+
+  play_cache_save (cache);
+  g_key_file_free (cache->index);
+  g_mutex_clear (&cache->lock);
+  g_free (cache->dir);
+  g_free (cache);
+}
+
+/* Returns a file:// URI to play instead of @uri, or NULL. Called from
+ * the main thread and from the about-to-finish streaming thread. */
+static gchar *
+play_cache_lookup (GstPlayMod * play, const gchar * uri)
+{
+  GstPlayModCache *cache = play->cache;
+  gchar *key, *path, *file_uri = NULL;
+  gint64 now;
+
+  if (cache == NULL || !play_cache_is_cacheable (uri))
+    return NULL;
+
+  key = play_cache_key (uri);
+  path = play_cache_path (cache, key);
+  now = g_get_real_time () / G_USEC_PER_SEC;
+
+  g_mutex_lock (&cache->lock);
+  if (g_key_file_has_group (cache->index, key) &&
+      g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+    file_uri = gst_filename_to_uri (path, NULL);
+    g_key_file_set_int64 (cache->index, key, "accessed", now);
+
+    cache->hits++;
+    cache->bytes_saved += g_key_file_get_uint64 (cache->index, key,
+        CACHE_INDEX_KEY_SIZE, NULL);
+  } else {
+    cache->misses++;
+  }
+  g_mutex_unlock (&cache->lock);
+
+  g_free (path);
+  g_free (key);
+
+  return file_uri;
+}
+
+static void
+play_cache_writer_free (gpointer data)
+{
+  PlayCacheWriter *writer = data;
+
+  if (writer->file != NULL)
+    fclose (writer->file);
+  if (!writer->done)
+    g_unlink (writer->tmp_path);
+
+  g_free (writer->key);
+  g_free (writer->uri);
+  g_free (writer->tmp_path);
+  g_free (writer->etag);
+  g_free (writer->last_modified);
+  g_free (writer);
+}
+
+static void
+play_cache_writer_parse_headers (PlayCacheWriter * writer,
+    const GstStructure * s)
+{
+  const GstStructure *headers;
+  const GValue *val;
+  gint i, n;
+
+  val = gst_structure_get_value (s, "response-headers");
+  if (val == NULL || G_VALUE_TYPE (val) != GST_TYPE_STRUCTURE)
+    return;
+  headers = gst_value_get_structure (val);
+
+  /* header names keep whatever case the server sent */
+  n = gst_structure_n_fields (headers);
+  for (i = 0; i < n; i++) {
+    const gchar *name = gst_structure_nth_field_name (headers, i);
+
+    val = gst_structure_get_value (headers, name);
+    if (!G_VALUE_HOLDS_STRING (val))
+      continue;
+
+    if (g_ascii_strcasecmp (name, "ETag") == 0) {
+      g_free (writer->etag);
+      writer->etag = g_value_dup_string (val);
+    } else if (g_ascii_strcasecmp (name, "Last-Modified") == 0) {
+      g_free (writer->last_modified);
+      writer->last_modified = g_value_dup_string (val);
+    }
+  }
+}
+
+static GstPadProbeReturn
+play_cache_writer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  PlayCacheWriter *writer = user_data;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstMapInfo map;
+
+    /* a seek means we won't get a contiguous copy, give up */
+    if (GST_BUFFER_OFFSET (buf) != GST_BUFFER_OFFSET_NONE &&
+        GST_BUFFER_OFFSET (buf) != writer->offset) {
+      GST_INFO ("%s: not cacheable, offset jumped", writer->uri);
+      return GST_PAD_PROBE_REMOVE;
+    }
+
+    if (!gst_buffer_map (buf, &map, GST_MAP_READ))
+      return GST_PAD_PROBE_REMOVE;
+    if (fwrite (map.data, 1, map.size, writer->file) != map.size) {
+      GST_WARNING ("%s: write failed", writer->tmp_path);
+      gst_buffer_unmap (buf, &map);
+      return GST_PAD_PROBE_REMOVE;
+    }
+    writer->offset += map.size;
+    gst_buffer_unmap (buf, &map);
+  } else if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_DOWNSTREAM_STICKY &&
+        gst_event_has_name (event, "http-headers")) {
+      play_cache_writer_parse_headers (writer, gst_event_get_structure (event));
+    } else if (GST_EVENT_TYPE (event) == GST_EVENT_EOS && writer->offset > 0) {
+      GstStructure *s;
+
+      fclose (writer->file);
+      writer->file = NULL;
+      writer->done = TRUE;
+
+      s = gst_structure_new ("gst-play-mod-cache",
+          "key", G_TYPE_STRING, writer->key,
+          "uri", G_TYPE_STRING, writer->uri,
+          "tmp-path", G_TYPE_STRING, writer->tmp_path,
+          "size", G_TYPE_UINT64, writer->offset,
+          "etag", G_TYPE_STRING, writer->etag,
+          "last-modified", G_TYPE_STRING, writer->last_modified, NULL);
+      gst_element_post_message (GST_ELEMENT (GST_PAD_PARENT (pad)),
+          gst_message_new_application (GST_OBJECT (pad), s));
+      return GST_PAD_PROBE_REMOVE;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+play_cache_attach (GstPlayMod * play, GstElement * source, const gchar * uri)
+{
+  PlayCacheWriter *writer;
+  GstPad *pad;
+  gchar *key;
+
+  pad = gst_element_get_static_pad (source, "src");
+  if (pad == NULL)
+    return;
+
+  key = play_cache_key (uri);
+
+  writer = g_new0 (PlayCacheWriter, 1);
+  writer->key = key;
+  writer->uri = g_strdup (uri);
+  writer->tmp_path = g_strdup_printf ("%s/%s.%08x.part", play->cache->dir, key,
+      g_random_int ());
+  writer->file = fopen (writer->tmp_path, "wb");
+
+  if (writer->file == NULL) {
+    gst_printerr ("Could not create %s: %s\n", writer->tmp_path,
+        g_strerror (errno));
+    play_cache_writer_free (writer);
+  } else {
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, play_cache_writer_probe, writer,
+        play_cache_writer_free);
+  }
+  gst_object_unref (pad);
+}
+
+/* a writer finished a complete copy, move it into place */
+static void
+play_cache_complete (GstPlayMod * play, const GstStructure * s)
+{
+  GstPlayModCache *cache = play->cache;
+  const gchar *key, *uri, *tmp_path, *etag, *last_modified;
+  gchar *path, *old_etag, *old_last_modified;
+  guint64 size = 0;
+  gint64 now;
+
+  key = gst_structure_get_string (s, "key");
+  uri = gst_structure_get_string (s, "uri");
+  tmp_path = gst_structure_get_string (s, "tmp-path");
+  etag = gst_structure_get_string (s, "etag");
+  last_modified = gst_structure_get_string (s, "last-modified");
+  gst_structure_get_uint64 (s, "size", &size);
+
+  path = play_cache_path (cache, key);
+  now = g_get_real_time () / G_USEC_PER_SEC;
+
+  g_mutex_lock (&cache->lock);
+
+  old_etag = g_key_file_get_string (cache->index, key, "etag", NULL);
+  old_last_modified = g_key_file_get_string (cache->index, key,
+      "last-modified", NULL);
+
+  if (g_key_file_has_group (cache->index, key) &&
+      g_strcmp0 (old_etag, etag) == 0 &&
+      g_strcmp0 (old_last_modified, last_modified) == 0 &&
+      g_key_file_get_uint64 (cache->index, key, CACHE_INDEX_KEY_SIZE,
+          NULL) == size) {
+    /* revalidated, what we have is still current */
+    g_unlink (tmp_path);
+  } else {
+    if (g_key_file_has_group (cache->index, key))
+      play_cache_remove_entry (cache, key);
+
+    if (g_rename (tmp_path, path) != 0) {
+      gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+          "Could not store %s in cache: %s\n", uri, g_strerror (errno));
+      g_unlink (tmp_path);
+      goto done;
+    }
+
+    g_key_file_set_string (cache->index, key, "uri", uri);
+    if (etag != NULL)
+      g_key_file_set_string (cache->index, key, "etag", etag);
+    if (last_modified != NULL)
+      g_key_file_set_string (cache->index, key, "last-modified",
+          last_modified);
+    g_key_file_set_uint64 (cache->index, key, CACHE_INDEX_KEY_SIZE, size);
+    g_key_file_set_int64 (cache->index, key, "accessed", now);
+    cache->size += size;
+
+    GST_INFO ("cached %s (%" G_GUINT64_FORMAT " bytes)", uri, size);
+  }
+  g_key_file_set_int64 (cache->index, key, "fetched", now);
+
+  play_cache_evict (cache);
+  play_cache_save (cache);
+
+done:
+  g_mutex_unlock (&cache->lock);
+
+  g_free (old_etag);
+  g_free (old_last_modified);
+  g_free (path);
+}
+
+/* our copy is still current, it's good for another max-age */
+static void
+play_cache_revalidated (GstPlayModCache * cache, const gchar * key)
+{
+  g_mutex_lock (&cache->lock);
+  if (g_key_file_has_group (cache->index, key)) {
+    g_key_file_set_int64 (cache->index, key, "fetched",
+        g_get_real_time () / G_USEC_PER_SEC);
+    play_cache_save (cache);
+    GST_INFO ("%s not modified", key);
+  }
+  g_mutex_unlock (&cache->lock);
+}
+
+/* Makes a refresh conditional on the validators we stored, so an
+ * unchanged file comes back as 304 Not Modified instead of in full */
+static void
+play_cache_set_validators (GstPlayModCache * cache, GstElement * src,
+    const gchar * key)
+{
+  GstStructure *headers;
+  gchar *etag, *last_modified;
+
+  if (!g_object_class_find_property (G_OBJECT_GET_CLASS (src),
+          "extra-headers"))
+    return;
+
+  g_mutex_lock (&cache->lock);
+  etag = g_key_file_get_string (cache->index, key, "etag", NULL);
+  last_modified = g_key_file_get_string (cache->index, key, "last-modified",
+      NULL);
+  g_mutex_unlock (&cache->lock);
+
+  if (etag != NULL || last_modified != NULL) {
+    headers = gst_structure_new_empty ("extra-headers");
+    if (etag != NULL)
+      gst_structure_set (headers, "If-None-Match", G_TYPE_STRING, etag, NULL);
+    if (last_modified != NULL)
+      gst_structure_set (headers, "If-Modified-Since", G_TYPE_STRING,
+          last_modified, NULL);
+    g_object_set (src, "extra-headers", headers, NULL);
+    gst_structure_free (headers);
+  }
+
+  g_free (etag);
+  g_free (last_modified);
+}
+
+static void play_cache_fetch_next (GstPlayMod * play);
+
+static gboolean
+play_cache_fetch_bus_msg (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModCache *cache = play->cache;
+
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_APPLICATION:
+      if (gst_message_has_name (msg, "gst-play-mod-cache"))
+        play_cache_complete (play, gst_message_get_structure (msg));
+      return TRUE;
+    case GST_MESSAGE_ERROR:{
+      const GstStructure *details = NULL;
+      guint status = 0;
+      GError *err;
+
+      /* souphttpsrc fails on anything but 2xx, 304 included */
+      gst_message_parse_error (msg, &err, NULL);
+      gst_message_parse_error_details (msg, &details);
+      if (details != NULL)
+        gst_structure_get_uint (details, "http-status-code", &status);
+
+      if (status == 304)
+        play_cache_revalidated (cache, cache->fetch_key);
+      else
+        gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING, "Prefetch failed: %s\n",
+            err->message);
+      g_clear_error (&err);
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      break;
+    default:
+      return TRUE;
+  }
+
+  gst_element_set_state (cache->fetch, GST_STATE_NULL);
+  gst_object_unref (cache->fetch);
+  cache->fetch = NULL;
+  cache->fetch_watch = 0;
+
+  g_mutex_lock (&cache->lock);
+  g_free (cache->fetch_key);
+  cache->fetch_key = NULL;
+  g_mutex_unlock (&cache->lock);
+
+  play_cache_fetch_next (play);
+
+  return FALSE;
+}
+
+static void
+play_cache_fetch_next (GstPlayMod * play)
+{
+  GstPlayModCache *cache = play->cache;
+  GstElement *src, *sink;
+  GError *err = NULL;
+  GstBus *bus;
+  gchar *uri;
+
+  while (cache->fetch == NULL &&
+      (uri = g_queue_pop_head (&cache->fetch_queue)) != NULL) {
+    src = gst_element_make_from_uri (GST_URI_SRC, uri, NULL, &err);
+    if (src == NULL) {
+      gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING, "Cannot prefetch %s: %s\n",
+          uri, err->message);
+      g_clear_error (&err);
+      g_free (uri);
+      continue;
+    }
+
+    GST_INFO ("prefetching %s", uri);
+
+    sink = gst_element_factory_make ("fakesink", NULL);
+    g_object_set (sink, "sync", FALSE, NULL);
+
+    cache->fetch = gst_pipeline_new ("cache-fetch");
+    gst_bin_add_many (GST_BIN (cache->fetch), src, sink, NULL);
+    gst_element_link (src, sink);
+
+    g_mutex_lock (&cache->lock);
+    cache->fetch_key = play_cache_key (uri);
+    g_mutex_unlock (&cache->lock);
+
+    play_cache_set_validators (cache, src, cache->fetch_key);
+    play_cache_attach (play, src, uri);
+
+    bus = gst_element_get_bus (cache->fetch);
+    cache->fetch_watch = gst_bus_add_watch (bus, play_cache_fetch_bus_msg,
+        play);
+    gst_object_unref (bus);
+    g_free (uri);
+
+    gst_element_set_state (cache->fetch, GST_STATE_PLAYING);
+  }
+}
+
+/* download @uri into the cache in the background, unless we have a
+ * copy that is recent enough; with @refresh_only only if we have an old
+ * copy */
+static void
+play_cache_prefetch (GstPlayMod * play, const gchar * uri,
+    gboolean refresh_only)
+{
+  GstPlayModCache *cache = play->cache;
+  gchar *key;
+  gboolean cached, fresh, busy;
+
+  if (cache == NULL || !play_cache_is_cacheable (uri))
+    return;
+
+  key = play_cache_key (uri);
+
+  g_mutex_lock (&cache->lock);
+  cached = fresh = g_key_file_has_group (cache->index, key);
+  if (cached && cache->max_age > 0) {
+    gint64 fetched = g_key_file_get_int64 (cache->index, key, "fetched", NULL);
+
+    fresh = g_get_real_time () / G_USEC_PER_SEC - fetched <= cache->max_age;
+  }
+  busy = g_strcmp0 (cache->fetch_key, key) == 0;
+  g_mutex_unlock (&cache->lock);
+
+  if (refresh_only && !cached)
+    fresh = TRUE;
+
+  if (!fresh && !busy && !g_queue_find_custom (&cache->fetch_queue, uri,
+          (GCompareFunc) strcmp)) {
+    g_queue_push_tail (&cache->fetch_queue, g_strdup (uri));
+    play_cache_fetch_next (play);
+  }
+
+  g_free (key);
+}
+
+/* playbin picked a source for a URI we don't have yet, read through it */
+static void
+play_source_setup (GstElement * playbin, GstElement * source,
+    gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  gchar *uri, *key;
+  gboolean busy;
+
+  if (play->cache == NULL || !GST_IS_URI_HANDLER (source))
+    return;
+
+  uri = gst_uri_handler_get_uri (GST_URI_HANDLER (source));
+  if (uri == NULL || !play_cache_is_cacheable (uri)) {
+    g_free (uri);
+    return;
+  }
+
+  /* no need to download it twice if the prefetcher is already on it */
+  key = play_cache_key (uri);
+  g_mutex_lock (&play->cache->lock);
+  busy = g_strcmp0 (key, play->cache->fetch_key) == 0;
+  g_mutex_unlock (&play->cache->lock);
+
+  if (!busy)
+    play_cache_attach (play, source, uri);
+
+  g_free (key);
+  g_free (uri);
+}
+
+static void
+play_probe_info_free (gpointer data)
+{
+  GstPlayModProbeInfo *info = data;
+
+  g_free (info->container);
+  g_free (info->video_codec);
+  g_free (info->audio_codec);
+  g_free (info->video_decoder);
+  g_free (info->audio_decoder);
+  g_free (info);
+}
+
+/* Load the plugin of the decoder playbin is going to pick for @caps now,
+ * rather than when the item starts, and return its name */
+static gchar *
+play_probe_preload_decoder (GstCaps * caps)
+{
+  GList *factories, *decoders;
+  GstPluginFeature *loaded;
+  gchar *name = NULL;
+
+  factories = gst_element_factory_list_get_elements
+      (GST_ELEMENT_FACTORY_TYPE_DECODER, GST_RANK_MARGINAL);
+  factories = g_list_sort (factories,
+      (GCompareFunc) gst_plugin_feature_rank_compare_func);
+  decoders = gst_element_factory_list_filter (factories, caps, GST_PAD_SINK,
+      FALSE);
+
+  if (decoders != NULL) {
+    loaded = gst_plugin_feature_load (GST_PLUGIN_FEATURE (decoders->data));
+    if (loaded != NULL) {
+      name = g_strdup (gst_plugin_feature_get_name (loaded));
+      gst_object_unref (loaded);
+    }
+  }
+
+  gst_plugin_feature_list_free (decoders);
+  gst_plugin_feature_list_free (factories);
+
+  return name;
+}
+
+static void
+play_probe_streams (GList * streams, gchar ** codec, gchar ** decoder)
+{
+  GstDiscovererStreamInfo *sinfo;
+  GstCaps *caps;
+
+  if (streams == NULL)
+    return;
+
+  /* the first stream is the one playbin selects by default */
+  sinfo = streams->data;
+  caps = gst_discoverer_stream_info_get_caps (sinfo);
+  if (caps != NULL) {
+    *codec = gst_pb_utils_get_codec_description (caps);
+    *decoder = play_probe_preload_decoder (caps);
+    gst_caps_unref (caps);
+  }
+}
+
+/* Missing plugins and broken files stay broken, timeouts and network
+ * trouble may not */
+static gboolean
+play_probe_is_definitive (GstDiscovererResult result, const GError * err)
+{
+  switch (result) {
+    case GST_DISCOVERER_MISSING_PLUGINS:
+    case GST_DISCOVERER_URI_INVALID:
+      return TRUE;
+    case GST_DISCOVERER_ERROR:
+      return err != NULL && (err->domain == GST_STREAM_ERROR ||
+          g_error_matches (err, GST_RESOURCE_ERROR,
+              GST_RESOURCE_ERROR_NOT_FOUND) ||
+          g_error_matches (err, GST_RESOURCE_ERROR,
+              GST_RESOURCE_ERROR_NOT_AUTHORIZED));
+    default:
+      return FALSE;
+  }
+}
+
+static void
+play_probe_discovered (GstDiscoverer * discoverer, GstDiscovererInfo * dinfo,
+    GError * err, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModProber *prober = play->prober;
+  GstPlayModProbeInfo *info;
+  GstDiscovererStreamInfo *sinfo;
+  GstDiscovererResult result;
+  GList *streams;
+  const gchar *uri;
+
+  uri = gst_discoverer_info_get_uri (dinfo);
+  result = gst_discoverer_info_get_result (dinfo);
+
+  info = g_new0 (GstPlayModProbeInfo, 1);
+  info->playable = (result == GST_DISCOVERER_OK);
+  if (!info->playable && !play_probe_is_definitive (result, err))
+    info->expires = g_get_monotonic_time () + PROBE_RETRY_TIME;
+  info->duration = gst_discoverer_info_get_duration (dinfo);
+  info->seekable = gst_discoverer_info_get_seekable (dinfo);
+
+  sinfo = gst_discoverer_info_get_stream_info (dinfo);
+  if (sinfo != NULL) {
+    if (GST_IS_DISCOVERER_CONTAINER_INFO (sinfo)) {
+      GstCaps *caps = gst_discoverer_stream_info_get_caps (sinfo);
+
+      if (caps != NULL) {
+        info->container = gst_pb_utils_get_codec_description (caps);
+        gst_caps_unref (caps);
+      }
+    }
+    gst_discoverer_stream_info_unref (sinfo);
+  }
+
+  if (info->playable) {
+    streams = gst_discoverer_info_get_video_streams (dinfo);
+    play_probe_streams (streams, &info->video_codec, &info->video_decoder);
+    gst_discoverer_stream_info_list_free (streams);
+
+    streams = gst_discoverer_info_get_audio_streams (dinfo);
+    play_probe_streams (streams, &info->audio_codec, &info->audio_decoder);
+    gst_discoverer_stream_info_list_free (streams);
+  }
+
+  GST_INFO ("probed %s: %s, container %s, video %s (%s), audio %s (%s)", uri,
+      info->playable ? "playable" : "not playable",
+      GST_STR_NULL (info->container), GST_STR_NULL (info->video_codec),
+      GST_STR_NULL (info->video_decoder), GST_STR_NULL (info->audio_codec),
+      GST_STR_NULL (info->audio_decoder));
+
+  g_mutex_lock (&prober->lock);
+  g_hash_table_remove (prober->pending, uri);
+  g_hash_table_insert (prober->results, g_strdup (uri), info);
+  g_mutex_unlock (&prober->lock);
+}
+
+/* runs in the thread pool, so a slow disk doesn't hold up anyone */
+static void
+play_probe_warm_file (gpointer data, gpointer user_data)
+{
+  gchar *filename = data;
+  gchar *buf;
+  gssize len, total = 0;
+  gint fd;
+
+  fd = g_open (filename, O_RDONLY, 0);
+  if (fd >= 0) {
+    posix_fadvise (fd, 0, PROBE_WARM_BYTES, POSIX_FADV_WILLNEED);
+
+    /* typefinding and the demuxer headers are all near the start */
+    buf = g_malloc (64 * 1024);
+    while (total < PROBE_WARM_BYTES &&
+        (len = read (fd, buf, 64 * 1024)) > 0)
+      total += len;
+    g_free (buf);
+
+    close (fd);
+  }
+
+  g_free (filename);
+}
+
+static GstPlayModProber *
+play_prober_new (GstPlayMod * play, guint depth)
+{
+  GstPlayModProber *prober;
+  GError *err = NULL;
+
+  gst_pb_utils_init ();
+
+  prober = g_new0 (GstPlayModProber, 1);
+  prober->depth = depth;
+  g_mutex_init (&prober->lock);
+  prober->results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      play_probe_info_free);
+  prober->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+
+  prober->discoverer = gst_discoverer_new (10 * GST_SECOND, &err);
+  if (prober->discoverer == NULL) {
+    gst_printerr ("Could not create discoverer: %s\n", err->message);
+    g_clear_error (&err);
+  } else {
+    g_signal_connect (prober->discoverer, "discovered",
+        G_CALLBACK (play_probe_discovered), play);
+    gst_discoverer_start (prober->discoverer);
+  }
+
+  prober->warm_pool = g_thread_pool_new (play_probe_warm_file, NULL, 1, FALSE,
+      NULL);
+
+  return prober;
+}
+
+static void
+play_prober_free (GstPlayModProber * prober)
+{
+  g_thread_pool_free (prober->warm_pool, TRUE, FALSE);
+
+  if (prober->discoverer != NULL) {
+    gst_discoverer_stop (prober->discoverer);
+    g_object_unref (prober->discoverer);
+  }
+
+  g_hash_table_unref (prober->results);
+  g_hash_table_unref (prober->pending);
+  g_mutex_clear (&prober->lock);
+  g_free (prober);
+}
+
+/* queue the next few playlist entries for probing */
+static void
+play_probe_upcoming (GstPlayMod * play)
+{
+  GstPlayModProber *prober = play->prober;
+  guint i;
+
+  if (prober == NULL)
+    return;
+
+  for (i = play->cur_idx + 1;
+      i < play->num_uris && i <= play->cur_idx + prober->depth; i++) {
+    const gchar *uri = play->uris[i];
+    gboolean known;
+
+    g_mutex_lock (&prober->lock);
+    known = g_hash_table_contains (prober->results, uri) ||
+        g_hash_table_contains (prober->pending, uri);
+    if (!known)
+      g_hash_table_add (prober->pending, g_strdup (uri));
+    g_mutex_unlock (&prober->lock);
+
+    if (known)
+      continue;
+
+    if (gst_uri_has_protocol (uri, "file")) {
+      gchar *filename = g_filename_from_uri (uri, NULL, NULL);
+
+      if (filename != NULL)
+        g_thread_pool_push (prober->warm_pool, filename, NULL);
+    }
+
+    if (prober->discoverer != NULL)
+      gst_discoverer_discover_uri_async (prober->discoverer, uri);
+  }
+}
+
+/* FALSE only if we probed @uri and know it won't play */
+static gboolean
+play_probe_is_playable (GstPlayMod * play, const gchar * uri)
+{
+  GstPlayModProber *prober = play->prober;
+  GstPlayModProbeInfo *info;
+  gboolean playable = TRUE;
+
+  if (prober == NULL)
+    return TRUE;
+
+  g_mutex_lock (&prober->lock);
+  info = g_hash_table_lookup (prober->results, uri);
+  if (info != NULL && info->expires != 0 &&
+      g_get_monotonic_time () >= info->expires) {
+    /* give it another chance, and probe it again when it comes up */
+    g_hash_table_remove (prober->results, uri);
+    info = NULL;
+  }
+  if (info != NULL)
+    playable = info->playable;
+  g_mutex_unlock (&prober->lock);
+
+  return playable;
+}
+
+static void
+play_probe_print (GstPlayMod * play, const gchar * uri)
+{
+  GstPlayModProber *prober = play->prober;
+  GstPlayModProbeInfo *info;
+
+  if (prober == NULL)
+    return;
+
+  g_mutex_lock (&prober->lock);
+  info = g_hash_table_lookup (prober->results, uri);
+  if (info != NULL) {
+    gst_print ("%s, %s%s%s%s%s%s, %" GST_TIME_FORMAT "%s\n",
+        GST_STR_NULL (info->container),
+        info->video_codec ? "video " : "",
+        info->video_codec ? info->video_codec : "",
+        info->video_codec && info->audio_codec ? ", " : "",
+        info->audio_codec ? "audio " : "",
+        info->audio_codec ? info->audio_codec : "",
+        info->video_codec || info->audio_codec ? "" : "no streams",
+        GST_TIME_ARGS (info->duration),
+        info->seekable ? "" : ", not seekable");
+  }
+  g_mutex_unlock (&prober->lock);
+}
+
+typedef struct
+{
+  GstPlayModIndex *index;
+  GstSegment segment;
+} PlayIndexProbe;
+
+static GstPlayModIndex *
+play_index_ref (GstPlayModIndex * index)
+{
+  g_atomic_int_inc (&index->refcount);
+  return index;
+}
+
+static void
+play_index_unref (GstPlayModIndex * index)
+{
+  if (!g_atomic_int_dec_and_test (&index->refcount))
+    return;
+
+  g_array_unref (index->keyframes);
+  g_mutex_clear (&index->lock);
+  g_free (index->path);
+  g_free (index);
+}
+
+/* position of the first keyframe after @pos */
+static guint
+play_index_upper_bound (GstPlayModIndex * index, GstClockTime pos)
+{
+  guint lo = 0, hi = index->keyframes->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (index->keyframes, GstClockTime, mid) <= pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void
+play_index_add (GstPlayModIndex * index, GstClockTime ts)
+{
+  guint i;
+
+  g_mutex_lock (&index->lock);
+  i = play_index_upper_bound (index, ts);
+  if (i == 0 || g_array_index (index->keyframes, GstClockTime, i - 1) != ts) {
+    g_array_insert_val (index->keyframes, i, ts);
+    index->dirty = TRUE;
+  }
+  g_mutex_unlock (&index->lock);
+}
+
+/* Keyframe strictly after (or before) @pos */
+static gboolean
+play_index_step (GstPlayModIndex * index, GstClockTime pos, gboolean forward,
+    GstClockTime * keyframe)
+{
+  gboolean found = FALSE;
+  guint i;
+
+  g_mutex_lock (&index->lock);
+  i = play_index_upper_bound (index, pos);
+  if (forward && i < index->keyframes->len) {
+    *keyframe = g_array_index (index->keyframes, GstClockTime, i);
+    found = TRUE;
+  } else if (!forward) {
+    /* skip the keyframe we are sitting on */
+    while (i > 0 && g_array_index (index->keyframes, GstClockTime,
+            i - 1) >= pos)
+      i--;
+    if (i > 0) {
+      *keyframe = g_array_index (index->keyframes, GstClockTime, i - 1);
+      found = TRUE;
+    }
+  }
+  g_mutex_unlock (&index->lock);
+
+  return found;
+}
+
+/* Sidecar files are named after the file's path, size and modification
+ * time, so an edited file gets a fresh index */
+static gchar *
+play_index_sidecar_path (const gchar * uri)
+{
+  GStatBuf st;
+  gchar *filename, *identity, *key, *name, *path;
+
+  if (!gst_uri_has_protocol (uri, "file"))
+    return NULL;
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  if (filename == NULL || g_stat (filename, &st) != 0) {
+    g_free (filename);
+    return NULL;
+  }
+
+  identity = g_strdup_printf ("%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+      filename, (gint64) st.st_size, (gint64) st.st_mtime);
+  key = g_compute_checksum_for_string (G_CHECKSUM_SHA1, identity, -1);
+  name = g_strconcat (key, ".idx", NULL);
+  path = g_build_filename (g_get_user_cache_dir (), PROGRAM_NAME, "index",
+      name, NULL);
+
+  g_free (name);
+  g_free (key);
+  g_free (identity);
+  g_free (filename);
+
+  return path;
+}
+
+static GstPlayModIndex *
+play_index_new (const gchar * uri)
+{
+  GstPlayModIndex *index;
+  gchar *contents;
+  gsize len;
+
+  index = g_new0 (GstPlayModIndex, 1);
+  index->refcount = 1;
+  g_mutex_init (&index->lock);
+  index->keyframes = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+  index->path = play_index_sidecar_path (uri);
+
+  if (index->path != NULL &&
+      g_file_get_contents (index->path, &contents, &len, NULL)) {
+    gsize header = sizeof (INDEX_MAGIC) - 1;
+
+    if (len >= header && memcmp (contents, INDEX_MAGIC, header) == 0 &&
+        (len - header) % sizeof (GstClockTime) == 0) {
+      g_array_append_vals (index->keyframes, contents + header,
+          (len - header) / sizeof (GstClockTime));
+      GST_INFO ("loaded %u keyframes from %s", index->keyframes->len,
+          index->path);
+    }
+    g_free (contents);
+  }
+
+  return index;
+}
+
+static void
+play_index_save (GstPlayModIndex * index)
+{
+  GError *err = NULL;
+  GByteArray *data;
+  gchar *dir;
+
+  if (index->path == NULL)
+    return;
+
+  data = g_byte_array_new ();
+
+  g_mutex_lock (&index->lock);
+  if (index->dirty) {
+    g_byte_array_append (data, (const guint8 *) INDEX_MAGIC,
+        sizeof (INDEX_MAGIC) - 1);
+    g_byte_array_append (data, (const guint8 *) index->keyframes->data,
+        index->keyframes->len * sizeof (GstClockTime));
+    index->dirty = FALSE;
+  }
+  g_mutex_unlock (&index->lock);
+
+  if (data->len > 0) {
+    dir = g_path_get_dirname (index->path);
+    g_mkdir_with_parents (dir, 0755);
+    g_free (dir);
+
+    if (!g_file_set_contents (index->path, (const gchar *) data->data,
+            data->len, &err)) {
+      GST_WARNING ("could not save index: %s", err->message);
+      g_clear_error (&err);
+    }
+  }
+
+  g_byte_array_unref (data);
+}
+
+static GstPadProbeReturn
+play_index_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  PlayIndexProbe *probe = user_data;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstClockTime ts;
+
+    if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT) ||
+        probe->segment.format != GST_FORMAT_TIME)
+      return GST_PAD_PROBE_OK;
+
+    ts = GST_BUFFER_PTS (buf);
+    if (!GST_CLOCK_TIME_IS_VALID (ts))
+      ts = GST_BUFFER_DTS (buf);
+
+    ts = gst_segment_to_stream_time (&probe->segment, GST_FORMAT_TIME, ts);
+    if (GST_CLOCK_TIME_IS_VALID (ts))
+      play_index_add (probe->index, ts);
+  } else if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT)
+      gst_event_copy_segment (event, &probe->segment);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+play_index_probe_free (gpointer data)
+{
+  PlayIndexProbe *probe = data;
+
+  play_index_unref (probe->index);
+  g_free (probe);
+}
+
+/* called from element-setup for each video decoder */
+static void
+play_index_attach (GstPlayMod * play, GstElement * decoder)
+{
+  PlayIndexProbe *probe;
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (decoder, "sink");
+  if (pad == NULL)
+    return;
+
+  probe = g_new0 (PlayIndexProbe, 1);
+  gst_segment_init (&probe->segment, GST_FORMAT_UNDEFINED);
+
+  g_mutex_lock (&play->index_lock);
+  if (play->setup_index != NULL)
+    probe->index = play_index_ref (play->setup_index);
+  g_mutex_unlock (&play->index_lock);
+
+  if (probe->index != NULL)
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, play_index_probe, probe,
+        play_index_probe_free);
+  else
+    g_free (probe);
+
+  gst_object_unref (pad);
+}
+
+/* the item @uri is about to be set up; decoders created from now on feed
+ * its index. Called from the main thread and from about-to-finish. */
+static void
+play_index_prepare (GstPlayMod * play, const gchar * uri)
+{
+  GstPlayModIndex *index = play_index_new (uri);
+
+  g_mutex_lock (&play->index_lock);
+  if (play->setup_index != NULL)
+    play_index_unref (play->setup_index);
+  play->setup_index = index;
+  g_mutex_unlock (&play->index_lock);
+}
+
+/* the item that was last prepared is now what's playing */
+static void
+play_index_activate (GstPlayMod * play)
+{
+  GstPlayModIndex *old;
+
+  g_mutex_lock (&play->index_lock);
+  old = play->index;
+  if (old == play->setup_index) {
+    g_mutex_unlock (&play->index_lock);
+    return;
+  }
+  play->index = play->setup_index ? play_index_ref (play->setup_index) : NULL;
+  g_mutex_unlock (&play->index_lock);
+
+  if (old != NULL) {
+    play_index_save (old);
+    play_index_unref (old);
+  }
+}
+
+typedef struct
+{
+  GstSegment segment;
+  GstClockTime last_end;        /* running time */
+  gint64 last_arrival;
+  gboolean wrapped;
+  gboolean boundary;
+
+  /* to express gaps in samples or frames */
+  gint rate;
+  gint fps_n;
+  gint fps_d;
+} PlayWrapProbe;
+
+/* a gap in running time as whole samples or frames, rounded */
+static gint64
+play_wrap_gap_units (PlayWrapProbe * probe, GstClockTimeDiff gap)
+{
+  guint64 units;
+
+  if (probe->rate > 0)
+    units = gst_util_uint64_scale_round (ABS (gap), probe->rate, GST_SECOND);
+  else if (probe->fps_n > 0 && probe->fps_d > 0)
+    units = gst_util_uint64_scale_round (ABS (gap), probe->fps_n,
+        probe->fps_d * GST_SECOND);
+  else
+    return 0;
+
+  return gap < 0 ? -(gint64) units : (gint64) units;
+}
+
+/* Measures how seamless a loop wrap is: a non-flushing segment seek starts
+ * a new segment without a flush, so the running time of the first buffer
+ * after it should continue right where the last one before it ended. The
+ * same goes for the first buffer of the next item in gapless mode. */
+static GstPadProbeReturn
+play_wrap_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  PlayWrapProbe *probe = user_data;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstClockTime start;
+    gint64 now = g_get_monotonic_time ();
+
+    if (probe->segment.format != GST_FORMAT_TIME ||
+        !GST_BUFFER_PTS_IS_VALID (buf))
+      return GST_PAD_PROBE_OK;
+
+    start = gst_segment_to_running_time (&probe->segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buf));
+
+    /* after a restart from READY the running time starts over at 0, a
+     * gapless item continues it, so its segment has a base */
+    if (probe->boundary && probe->segment.base == 0)
+      probe->last_end = GST_CLOCK_TIME_NONE;
+
+    if ((probe->wrapped || probe->boundary) &&
+        GST_CLOCK_TIME_IS_VALID (probe->last_end) &&
+        GST_CLOCK_TIME_IS_VALID (start)) {
+      GstElement *sink = GST_ELEMENT (GST_PAD_PARENT (pad));
+      GstClockTimeDiff gap = GST_CLOCK_DIFF (probe->last_end, start);
+      GstStructure *s;
+
+      s = gst_structure_new (probe->boundary ? "gst-play-mod-boundary" :
+          "gst-play-mod-wrap", "gap", G_TYPE_INT64, gap,
+          "units", G_TYPE_INT64, play_wrap_gap_units (probe, gap),
+          "unit", G_TYPE_STRING, probe->rate > 0 ? "samples" : "frames",
+          "interval", G_TYPE_INT64,
+          (now - probe->last_arrival) * (gint64) GST_USECOND, NULL);
+      gst_element_post_message (sink,
+          gst_message_new_application (GST_OBJECT (sink), s));
+    }
+    probe->wrapped = FALSE;
+    probe->boundary = FALSE;
+
+    if (GST_CLOCK_TIME_IS_VALID (start)) {
+      probe->last_end = start;
+      if (GST_BUFFER_DURATION_IS_VALID (buf))
+        probe->last_end += GST_BUFFER_DURATION (buf) /
+            ABS (probe->segment.rate);
+    }
+    probe->last_arrival = now;
+  } else if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    switch (GST_EVENT_TYPE (event)) {
+      case GST_EVENT_SEGMENT:
+        gst_event_copy_segment (event, &probe->segment);
+        probe->wrapped = TRUE;
+        break;
+      case GST_EVENT_CAPS:{
+        GstStructure *s;
+        GstCaps *caps;
+
+        gst_event_parse_caps (event, &caps);
+        s = gst_caps_get_structure (caps, 0);
+
+        if (!gst_structure_get_int (s, "rate", &probe->rate))
+          probe->rate = 0;
+        if (!gst_structure_get_fraction (s, "framerate", &probe->fps_n,
+                &probe->fps_d))
+          probe->fps_n = probe->fps_d = 0;
+        break;
+      }
+      case GST_EVENT_STREAM_START:
+        /* not a wrap, but maybe the next gapless item */
+        probe->boundary = TRUE;
+        probe->wrapped = FALSE;
+        break;
+      case GST_EVENT_FLUSH_STOP:
+        /* nothing to compare with */
+        probe->last_end = GST_CLOCK_TIME_NONE;
+        break;
+      default:
+        break;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* called from element-setup for each audio and video sink */
+static void
+play_wrap_attach (GstElement * sink)
+{
+  PlayWrapProbe *probe;
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  if (pad == NULL)
+    return;
+
+  probe = g_new0 (PlayWrapProbe, 1);
+  gst_segment_init (&probe->segment, GST_FORMAT_UNDEFINED);
+  probe->last_end = GST_CLOCK_TIME_NONE;
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, play_wrap_probe, probe, g_free);
+  gst_object_unref (pad);
+}
+
+/* Streaming thread: while a hold is on, the first data to reach a sink
+ * tells the control thread it can seek, and it and everything after it
+ * is dropped until the seek flushes */
+static GstPadProbeReturn
+play_hold_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModHold *hold = &play->hold;
+
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+        GST_EVENT_FLUSH_STOP)
+      g_atomic_int_compare_and_exchange (&hold->state, PLAY_HOLD_SEEKING,
+          PLAY_HOLD_NONE);
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (g_atomic_int_compare_and_exchange (&hold->state, PLAY_HOLD_WAITING,
+          PLAY_HOLD_READY)) {
+    GstElement *sink = GST_ELEMENT (GST_PAD_PARENT (pad));
+    GstStructure *s;
+
+    s = gst_structure_new ("gst-play-mod-hold", "seqnum", G_TYPE_INT,
+        g_atomic_int_get (&hold->seqnum), NULL);
+    gst_element_post_message (sink,
+        gst_message_new_application (GST_OBJECT (sink), s));
+  }
+
+  if (g_atomic_int_get (&hold->state) != PLAY_HOLD_NONE)
+    return GST_PAD_PROBE_DROP;
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* called from element-setup for each audio and video sink */
+static void
+play_hold_attach (GstPlayMod * play, GstElement * sink)
+{
+  GstPad *pad;
+
+  if (play == NULL)
+    return;
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  if (pad == NULL)
+    return;
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_BUFFER_LIST | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+      play_hold_probe, play, NULL);
+  gst_object_unref (pad);
+}
+
+/* control thread: holds the sinks back for a seek while the item that is
+ * about to be set up prerolls */
+static void
+play_hold_start (GstPlayMod * play)
+{
+  g_atomic_int_inc (&play->hold.seqnum);
+  g_atomic_int_set (&play->hold.state, PLAY_HOLD_WAITING);
+}
+
+/* state thread: the old item may have tripped the hold on its way out,
+ * its message is dropped with the rest of what it posted */
+static void
+play_hold_rearm (GstPlayMod * play)
+{
+  g_atomic_int_compare_and_exchange (&play->hold.state, PLAY_HOLD_READY,
+      PLAY_HOLD_WAITING);
+}
+
+static void
+play_hold_release (GstPlayMod * play)
+{
+  g_atomic_int_set (&play->hold.state, PLAY_HOLD_NONE);
+}
+
+/* TRUE while the first preroll waits for a seek, the seeking query isn't
+ * answered yet then */
+static gboolean
+play_hold_active (GstPlayMod * play)
+{
+  return g_atomic_int_get (&play->hold.state) != PLAY_HOLD_NONE;
+}
+
+static void
+play_wrap_report (GstPlayMod * play, GstMessage * msg)
+{
+  const GstStructure *s = gst_message_get_structure (msg);
+  gint64 gap = 0, units = 0, interval = 0;
+  const gchar *unit = gst_structure_get_string (s, "unit");
+
+  gst_structure_get_int64 (s, "gap", &gap);
+  gst_structure_get_int64 (s, "units", &units);
+  gst_structure_get_int64 (s, "interval", &interval);
+
+  if (gst_message_has_name (msg, "gst-play-mod-boundary")) {
+    play->boundaries++;
+    play->boundary_gap_max = MAX (play->boundary_gap_max, ABS (gap));
+    gst_print ("%s next item: %.2f ms gap (%" G_GINT64_FORMAT " %s)\n",
+        GST_OBJECT_NAME (GST_MESSAGE_SRC (msg)), (gdouble) gap / GST_MSECOND,
+        units, unit);
+    return;
+  }
+
+  play->wraps++;
+  play->wrap_gap_max = MAX (play->wrap_gap_max, ABS (gap));
+
+  gst_print ("%s wrapped: %.2f ms gap (%" G_GINT64_FORMAT " %s), %.2f ms "
+      "since previous buffer\n", GST_OBJECT_NAME (GST_MESSAGE_SRC (msg)),
+      (gdouble) gap / GST_MSECOND, units, unit,
+      (gdouble) interval / GST_MSECOND);
+}
+
+typedef struct
+{
+  GstClockTime fade;
+  GstSegment segment;
+  gboolean is_audio;
+  GstAudioInfo ainfo;
+  GstVideoInfo vinfo;
+  gboolean have_info;
+
+  /* stream times of the first buffer of the item and of its end, NONE
+   * when there's nothing to fade */
+  gboolean starting;
+  GstClockTime origin;
+  GstClockTime end;
+  gboolean end_known;
+} PlayFadeProbe;
+
+/* 0 (silent, black) to 1 (untouched) at stream time @ts */
+static gdouble
+play_fade_gain (PlayFadeProbe * probe, GstClockTime ts)
+{
+  gdouble gain = 1.0;
+
+  if (GST_CLOCK_TIME_IS_VALID (probe->origin) && ts < probe->origin +
+      probe->fade)
+    gain = ts <= probe->origin ? 0.0 :
+        (gdouble) (ts - probe->origin) / probe->fade;
+
+  if (GST_CLOCK_TIME_IS_VALID (probe->end) && ts + probe->fade > probe->end)
+    gain = MIN (gain, ts >= probe->end ? 0.0 :
+        (gdouble) (probe->end - ts) / probe->fade);
+
+  return gain;
+}
+
+#define PLAY_FADE_SAMPLES(type, data, frames, channels, g0, g1)        \
+  G_STMT_START {                                                        \
+    type *s = (type *) (data);                                          \
+    guint f, c;                                                         \
+    for (f = 0; f < (frames); f++) {                                    \
+      gdouble g = (g0) + ((g1) - (g0)) * f / (frames);                  \
+      for (c = 0; c < (channels); c++, s++)                             \
+        *s = (type) (*s * g);                                           \
+    }                                                                   \
+  } G_STMT_END
+
+/* ramp the samples from @g0 at the start of the buffer to @g1 at its end */
+static void
+play_fade_audio (PlayFadeProbe * probe, GstBuffer * buf, gdouble g0,
+    gdouble g1)
+{
+  GstAudioInfo *info = &probe->ainfo;
+  guint channels = GST_AUDIO_INFO_CHANNELS (info);
+  GstMapInfo map;
+  guint frames;
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READWRITE))
+    return;
+
+  frames = map.size / GST_AUDIO_INFO_BPF (info);
+  if (frames > 0) {
+    switch (GST_AUDIO_INFO_FORMAT (info)) {
+      case GST_AUDIO_FORMAT_S16:
+        PLAY_FADE_SAMPLES (gint16, map.data, frames, channels, g0, g1);
+        break;
+      case GST_AUDIO_FORMAT_S32:
+        PLAY_FADE_SAMPLES (gint32, map.data, frames, channels, g0, g1);
+        break;
+      case GST_AUDIO_FORMAT_F32:
+        PLAY_FADE_SAMPLES (gfloat, map.data, frames, channels, g0, g1);
+        break;
+      case GST_AUDIO_FORMAT_F64:
+        PLAY_FADE_SAMPLES (gdouble, map.data, frames, channels, g0, g1);
+        break;
+      default:
+        break;
+    }
+  }
+
+  gst_buffer_unmap (buf, &map);
+}
+
+/* dissolve through black: every 8 bit component toward its black level */
+static void
+play_fade_video (PlayFadeProbe * probe, GstBuffer * buf, gdouble gain)
+{
+  const GstVideoFormatInfo *finfo = probe->vinfo.finfo;
+  guint g = (guint) (gain * 256), c;
+  GstVideoFrame frame;
+
+  if (GST_VIDEO_FORMAT_INFO_DEPTH (finfo, 0) != 8 ||
+      !gst_video_frame_map (&frame, &probe->vinfo, buf, GST_MAP_READWRITE))
+    return;
+
+  for (c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS (&frame); c++) {
+    gint black = GST_VIDEO_FORMAT_INFO_IS_YUV (finfo) ? (c == 0 ? 16 : 128) :
+        0;
+    gint pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (&frame, c);
+    gint stride = GST_VIDEO_FRAME_COMP_STRIDE (&frame, c);
+    gint x, y;
+
+    if (GST_VIDEO_FORMAT_INFO_HAS_ALPHA (finfo) && c == GST_VIDEO_COMP_A)
+      continue;
+
+    for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (&frame, c); y++) {
+      guint8 *p = (guint8 *) GST_VIDEO_FRAME_COMP_DATA (&frame, c) +
+          y * stride;
+
+      for (x = 0; x < GST_VIDEO_FRAME_COMP_WIDTH (&frame, c); x++, p +=
+          pstride)
+        *p = black + (((gint) * p - black) * (gint) g >> 8);
+    }
+  }
+
+  gst_video_frame_unmap (&frame);
+}
+
+/* Fades each item in from its first buffer and out toward its end, on the
+ * way into the sink. Items that loop, trick modes and reverse playback
+ * are left alone. */
+static GstPadProbeReturn
+play_fade_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  PlayFadeProbe *probe = user_data;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstClockTime start, stop;
+    gdouble g0, g1;
+
+    if (probe->segment.format != GST_FORMAT_TIME || !probe->have_info ||
+        probe->segment.rate < 0 || (probe->segment.flags &
+            (GST_SEGMENT_FLAG_TRICKMODE | GST_SEGMENT_FLAG_SEGMENT)) ||
+        !GST_BUFFER_PTS_IS_VALID (buf))
+      return GST_PAD_PROBE_OK;
+
+    start = gst_segment_to_stream_time (&probe->segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buf));
+    if (!GST_CLOCK_TIME_IS_VALID (start))
+      return GST_PAD_PROBE_OK;
+    stop = start;
+    if (GST_BUFFER_DURATION_IS_VALID (buf))
+      stop += GST_BUFFER_DURATION (buf);
+
+    if (probe->starting) {
+      probe->origin = start;
+      probe->starting = FALSE;
+    }
+
+    /* the duration is known once the first buffers made it through */
+    if (!probe->end_known) {
+      gint64 duration;
+
+      probe->end_known = TRUE;
+      if (GST_CLOCK_TIME_IS_VALID (probe->segment.stop))
+        probe->end = gst_segment_to_stream_time (&probe->segment,
+            GST_FORMAT_TIME, probe->segment.stop);
+      else if (gst_pad_peer_query_duration (pad, GST_FORMAT_TIME, &duration)
+          && duration > 0)
+        probe->end = duration;
+    }
+
+    g0 = play_fade_gain (probe, start);
+    g1 = play_fade_gain (probe, stop);
+    if (g0 >= 1.0 && g1 >= 1.0) {
+      /* past the fade in, not at the fade out yet */
+      if (GST_CLOCK_TIME_IS_VALID (probe->origin) && start >= probe->origin +
+          probe->fade)
+        probe->origin = GST_CLOCK_TIME_NONE;
+      return GST_PAD_PROBE_OK;
+    }
+
+    buf = gst_buffer_make_writable (buf);
+    GST_PAD_PROBE_INFO_DATA (info) = buf;
+
+    if (probe->is_audio)
+      play_fade_audio (probe, buf, g0, g1);
+    else
+      play_fade_video (probe, buf, (g0 + g1) / 2);
+  } else if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    GstCaps *caps;
+
+    switch (GST_EVENT_TYPE (event)) {
+      case GST_EVENT_STREAM_START:
+        probe->starting = TRUE;
+        probe->origin = GST_CLOCK_TIME_NONE;
+        probe->end = GST_CLOCK_TIME_NONE;
+        probe->end_known = FALSE;
+        break;
+      case GST_EVENT_SEGMENT:
+        /* a seek moves the end, but only fades in after a new item */
+        gst_event_copy_segment (event, &probe->segment);
+        if (!probe->starting)
+          probe->origin = GST_CLOCK_TIME_NONE;
+        probe->end = GST_CLOCK_TIME_NONE;
+        probe->end_known = FALSE;
+        break;
+      case GST_EVENT_CAPS:
+        gst_event_parse_caps (event, &caps);
+        if (probe->is_audio)
+          probe->have_info = gst_audio_info_from_caps (&probe->ainfo, caps);
+        else
+          probe->have_info = gst_video_info_from_caps (&probe->vinfo, caps);
+        break;
+      default:
+        break;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* called from element-setup for each audio and video sink */
+static void
+play_fade_attach (GstPlayMod * play, GstElement * sink, gboolean is_audio)
+{
+  PlayFadeProbe *probe;
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  if (pad == NULL)
+    return;
+
+  probe = g_new0 (PlayFadeProbe, 1);
+  probe->fade = play->fade;
+  probe->is_audio = is_audio;
+  gst_segment_init (&probe->segment, GST_FORMAT_UNDEFINED);
+  probe->origin = GST_CLOCK_TIME_NONE;
+  probe->end = GST_CLOCK_TIME_NONE;
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, play_fade_probe, probe, g_free);
+  gst_object_unref (pad);
+}
+
+/* [[h:]m:]s with optional fraction */
+gboolean
+gst_play_mod_parse_time (const gchar * str, GstClockTime * time)
+{
+  gchar **fields, *end;
+  gdouble seconds = 0;
+  guint i;
+
+  fields = g_strsplit (str, ":", 3);
+  for (i = 0; fields[i] != NULL; i++) {
+    gdouble value = g_ascii_strtod (fields[i], &end);
+
+    if (end == fields[i] || *end != '\0' || value < 0) {
+      g_strfreev (fields);
+      return FALSE;
+    }
+    seconds = seconds * 60 + value;
+  }
+  g_strfreev (fields);
+
+  if (i == 0)
+    return FALSE;
+
+  *time = seconds * GST_SECOND;
+  return TRUE;
+}
+
+/* a pass count, 0 for forever */
+static gboolean
+play_parse_loops (const gchar * str, gint * loops)
+{
+  gchar *end;
+  gint64 value;
+
+  errno = 0;
+  value = g_ascii_strtoll (str, &end, 10);
+  if (end == str || *end != '\0' || errno != 0 || value < 0 ||
+      value > G_MAXINT) {
+    gst_printerr ("Invalid loop count '%s'\n", str);
+    return FALSE;
+  }
+
+  *loops = value;
+  return TRUE;
+}
+
+/* parses "in=..|out=..|loop=N" */
+gboolean
+gst_play_mod_item_parse (GstPlayModItem * item, const gchar * options)
+{
+  gchar **opts;
+  gboolean ret = TRUE;
+  guint i;
+
+  opts = g_strsplit (options, "|", -1);
+  for (i = 0; ret && opts[i] != NULL; i++) {
+    gchar *value = strchr (opts[i], '=');
+
+    if (value == NULL) {
+      ret = FALSE;
+      break;
+    }
+    *value++ = '\0';
+
+    if (g_str_equal (opts[i], "in"))
+      ret = gst_play_mod_parse_time (value, &item->in);
+    else if (g_str_equal (opts[i], "out"))
+      ret = gst_play_mod_parse_time (value, &item->out);
+    else if (g_str_equal (opts[i], "loop"))
+      ret = play_parse_loops (value, &item->loops);
+    else
+      ret = FALSE;
+  }
+  g_strfreev (opts);
+
+  if (ret && GST_CLOCK_TIME_IS_VALID (item->in) &&
+      GST_CLOCK_TIME_IS_VALID (item->out) && item->out <= item->in)
+    ret = FALSE;
+
+  return ret;
+}
+
+static const GstPlayModItem *
+play_current_item (GstPlayMod * play)
+{
+  if (play->items != NULL && play->item_idx >= 0 &&
+      play->items[play->item_idx] != NULL)
+    return play->items[play->item_idx];
+
+  return &play->default_item;
+}
+
+static GstClockTime
+play_item_in (GstPlayMod * play)
+{
+  const GstPlayModItem *item = play_current_item (play);
+
+  return GST_CLOCK_TIME_IS_VALID (item->in) ? item->in : 0;
+}
+
+/* TRUE while the current pass isn't the last one */
+static gboolean
+play_item_loops_left (GstPlayMod * play)
+{
+  const GstPlayModItem *item = play_current_item (play);
+
+  return item->loops == 0 || play->loops_done + 1 < (guint) item->loops;
+}
+
+/* seek to the in point of the current item; FALSE if it has no in or out
+ * point and doesn't loop, so doesn't need a segment seek */
+static gboolean
+play_item_start (GstPlayMod * play)
+{
+  const GstPlayModItem *item = play_current_item (play);
+
+  play->loops_done = 0;
+
+  if (!GST_CLOCK_TIME_IS_VALID (item->in) &&
+      !GST_CLOCK_TIME_IS_VALID (item->out) && item->loops == 1)
+    return FALSE;
+
+  gst_play_mod_do_seek (play, play->rate > 0 ? play_item_in (play) : item->out,
+      play->rate, play->trick_mode);
+  return TRUE;
+}
+
+/* back to the start of the section without flushing, so the next pass
+ * follows the last frame of this one as if it were the same stream */
+static void
+play_item_wrap (GstPlayMod * play)
+{
+  const GstPlayModItem *item = play_current_item (play);
+
+  play->loops_done++;
+
+  if (item->loops == 0)
+    gst_print ("Loop %u\n", play->loops_done + 1);
+  else
+    gst_print ("Loop %u/%d\n", play->loops_done + 1, item->loops);
+
+  if (!play_do_seek_full (play,
+          play->rate > 0 ? play_item_in (play) : item->out, play->rate,
+          play->trick_mode, 0))
+    gst_print ("\nCould not loop.\n");
+}
+
+/* The next item took over in gapless mode, its segments already had our
+ * rate, see play_carry_probe() */
+static void
+play_item_continue (GstPlayMod * play)
+{
+  play->loops_done = 0;
+  if (play->rate != 1.0)
+    play->rate_carried++;
+}
+
+/* Streaming thread: about-to-finish decides whether the next item can
+ * follow without a seek of its own. In and out points, loops, reverse
+ * playback and trick modes need one from the demuxer, so such items
+ * start the usual way after the current one ends. */
+static gboolean
+play_carry_prepare (GstPlayMod * play, guint idx)
+{
+  const GstPlayModItem *item = &play->default_item;
+  GstPlayModCarry *carry = &play->carry;
+
+  if (play->items != NULL && play->items[idx] != NULL)
+    item = play->items[idx];
+
+  if (GST_CLOCK_TIME_IS_VALID (item->in) ||
+      GST_CLOCK_TIME_IS_VALID (item->out) || item->loops != 1 ||
+      play->rate < 0 || play->trick_mode != GST_PLAY_MOD_TRICK_MODE_NONE)
+    return FALSE;
+
+  carry->rate = play->rate;
+  if (++carry->counter <= 0)
+    carry->counter = 1;
+  g_atomic_int_set (&carry->seqnum, carry->counter);
+  return TRUE;
+}
+
+typedef struct
+{
+  GstPlayMod *play;
+  gint apply;                   /* seqnum for the next segment */
+  gint applied;
+} PlayCarryProbe;
+
+/* The first segment after the next item's STREAM_START gets our rate */
+static GstPadProbeReturn
+play_carry_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  PlayCarryProbe *probe = user_data;
+  GstPlayModCarry *carry = &probe->play->carry;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  GstSegment segment;
+  GstEvent *carried;
+  gint seqnum;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_STREAM_START:
+      seqnum = g_atomic_int_get (&carry->seqnum);
+      probe->apply = seqnum != 0 && seqnum != probe->applied ? seqnum : 0;
+      break;
+    case GST_EVENT_SEGMENT:
+      if (probe->apply == 0)
+        break;
+      probe->applied = probe->apply;
+      probe->apply = 0;
+
+      gst_event_copy_segment (event, &segment);
+      if (segment.format != GST_FORMAT_TIME)
+        break;
+
+      segment.rate *= carry->rate;
+
+      carried = gst_event_new_segment (&segment);
+      gst_event_set_seqnum (carried, gst_event_get_seqnum (event));
+      gst_event_unref (event);
+      GST_PAD_PROBE_INFO_DATA (info) = carried;
+      break;
+    default:
+      break;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* called from element-setup for each audio and video sink */
+static void
+play_carry_attach (GstPlayMod * play, GstElement * sink)
+{
+  PlayCarryProbe *probe;
+  GstPad *pad;
+
+  if (play == NULL)
+    return;
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  if (pad == NULL)
+    return;
+
+  probe = g_new0 (PlayCarryProbe, 1);
+  probe->play = play;
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      play_carry_probe, probe, g_free);
+  gst_object_unref (pad);
+}
+
+static GstPlayModTimeshift *
+play_timeshift_new (GstPlayMod * play, guint64 size, const gchar * dir,
+    gdouble catchup_rate)
+{
+  GstPlayModTimeshift *timeshift;
+
+  timeshift = g_new0 (GstPlayModTimeshift, 1);
+  timeshift->size = size;
+  timeshift->dir = g_strdup (dir);
+  timeshift->catchup_rate = catchup_rate;
+  timeshift->start_pos = GST_CLOCK_TIME_NONE;
+
+  if (dir != NULL)
+    g_mkdir_with_parents (dir, 0700);
+
+  /* playbin hands this to the queue2 it puts behind stream sources */
+  g_object_set (play->playbin, "ring-buffer-max-size", size, NULL);
+
+  return timeshift;
+}
+
+static void
+play_timeshift_free (GstPlayModTimeshift * timeshift)
+{
+  g_free (timeshift->dir);
+  g_free (timeshift);
+}
+
+static void
+play_timeshift_reset (GstPlayModTimeshift * timeshift)
+{
+  timeshift->available = FALSE;
+  timeshift->active = FALSE;
+  timeshift->catching_up = FALSE;
+  timeshift->start_pos = GST_CLOCK_TIME_NONE;
+  timeshift->delay = 0;
+}
+
+/* called from element-setup for the stream queue2 */
+static void
+play_timeshift_setup_queue (GstPlayMod * play, GstElement * queue)
+{
+  GstPlayModTimeshift *timeshift = play->timeshift;
+
+  if (timeshift->dir != NULL) {
+    gchar *template;
+
+    template = g_build_filename (timeshift->dir, PROGRAM_NAME "-XXXXXX", NULL);
+    play_tuning_set (queue, "temp-template", template);
+    play_tuning_set (queue, "temp-remove", "true");
+    g_free (template);
+  }
+  play_tuning_set_int64 (queue, "ring-buffer-max-size", timeshift->size);
+
+  g_atomic_int_set (&timeshift->available, TRUE);
+}
+
+/* how far back the ring buffer reaches at the current byte rate */
+static GstClockTime
+play_timeshift_window (GstPlayMod * play)
+{
+  gint64 rate = play->buffering_stats.download_rate;
+
+  if (rate <= 0)
+    return GST_CLOCK_TIME_NONE;
+
+  return gst_util_uint64_scale (play->timeshift->size, GST_SECOND, rate);
+}
+
+static GstClockTime
+play_timeshift_live_edge (GstPlayMod * play)
+{
+  GstPlayModTimeshift *timeshift = play->timeshift;
+
+  return timeshift->start_pos +
+      (g_get_monotonic_time () - timeshift->start_time) * GST_USECOND;
+}
+
+static GstClockTime
+play_timeshift_oldest (GstPlayMod * play)
+{
+  GstClockTime edge = play_timeshift_live_edge (play);
+  GstClockTime window = play_timeshift_window (play);
+
+  if (!GST_CLOCK_TIME_IS_VALID (window) ||
+      edge < play->timeshift->start_pos + window)
+    return play->timeshift->start_pos;
+
+  return edge - window;
+}
+
+/* keep track of where the live edge is, called from play_timeout. The
+ * source keeps filling the ring buffer at the stream's own pace whatever
+ * we do, so the live edge moves with the wall clock. */
+static void
+play_timeshift_update (GstPlayMod * play, gint64 pos, gint64 dur)
+{
+  GstPlayModTimeshift *timeshift = play->timeshift;
+  GstClockTime edge, oldest;
+
+  if (timeshift == NULL || !g_atomic_int_get (&timeshift->available) ||
+      dur > 0 || pos < 0)
+    return;
+
+  if (!timeshift->active) {
+    timeshift->active = TRUE;
+    timeshift->start_pos = pos;
+    timeshift->start_time = g_get_monotonic_time ();
+    gst_print ("Time-shift enabled, %" G_GUINT64_FORMAT " MB %s buffer\n",
+        timeshift->size >> 20, timeshift->dir ? "disk" : "memory");
+    return;
+  }
+
+  edge = play_timeshift_live_edge (play);
+  timeshift->delay = edge > (GstClockTime) pos ? edge - pos : 0;
+
+  /* a rate change by hand ends the catch-up */
+  if (timeshift->catching_up && play->rate != timeshift->catchup_rate)
+    timeshift->catching_up = FALSE;
+
+  /* no point going faster than live */
+  if (timeshift->delay < 100 * GST_MSECOND && play->rate > 1.0) {
+    gst_print (timeshift->catching_up ? "\nCaught up with live.\n" :
+        "\nReached live, back to normal speed.\n");
+    timeshift->catching_up = FALSE;
+    gst_play_mod_set_playback_rate (play, 1.0);
+    return;
+  }
+
+  /* paused (or rewound) for longer than the ring buffer holds, the data
+   * under us is being overwritten */
+  oldest = play_timeshift_oldest (play);
+  if ((GstClockTime) pos < oldest) {
+    gst_print ("\nTime-shift buffer full, moving to oldest position.\n");
+    gst_play_mod_do_seek (play, oldest + GST_SECOND, play->rate,
+        play->trick_mode);
+  }
+}
+
+/* keep seeks within what's buffered */
+static gint64
+play_timeshift_clamp (GstPlayMod * play, gint64 pos)
+{
+  GstPlayModTimeshift *timeshift = play->timeshift;
+  GstClockTime edge, oldest;
+
+  if (timeshift == NULL || !timeshift->active)
+    return pos;
+
+  edge = play_timeshift_live_edge (play);
+  oldest = play_timeshift_oldest (play);
+
+  return CLAMP (pos, (gint64) oldest, (gint64) edge);
+}
+
+static void
+play_timeshift_catch_up (GstPlayMod * play)
+{
+  GstPlayModTimeshift *timeshift = play->timeshift;
+  gint64 pos = -1;
+
+  if (timeshift == NULL || !timeshift->active) {
+    gst_print ("\nNot time-shifting.\n");
+    return;
+  }
+
+  if (!gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    return;
+
+  timeshift->delay = play_timeshift_live_edge (play) - pos;
+
+  if (play->desired_state != GST_STATE_PLAYING)
+    gst_play_mod_toggle_paused (play);
+
+  if (timeshift->catchup_rate <= 1.0) {
+    gst_print ("\nJumping to live.\n");
+    gst_play_mod_do_seek (play, play_timeshift_live_edge (play), 1.0,
+        play->trick_mode);
+    return;
+  }
+
+  if (timeshift->catching_up) {
+    gst_print ("\nAlready catching up.\n");
+    return;
+  }
+
+  /* we gain (rate - 1) seconds on live per second */
+  gst_print ("\nCatching up at %.2fx, live in %.1f s\n",
+      timeshift->catchup_rate, (gdouble) timeshift->delay / GST_SECOND /
+      (timeshift->catchup_rate - 1.0));
+  timeshift->catching_up = TRUE;
+  gst_play_mod_set_playback_rate (play, timeshift->catchup_rate);
+}
+
+static void
+play_timeshift_print (GstPlayMod * play)
+{
+  GstPlayModTimeshift *timeshift = play->timeshift;
+  GstClockTime window, buffered;
+  gchar full[32] = "", catching[32] = "";
+
+  if (timeshift == NULL || !timeshift->active)
+    return;
+
+  window = play_timeshift_window (play);
+  buffered = play_timeshift_live_edge (play) - play_timeshift_oldest (play);
+
+  if (GST_CLOCK_TIME_IS_VALID (window))
+    g_snprintf (full, sizeof (full), " (%.0f%% full)",
+        100.0 * buffered / window);
+  if (timeshift->catching_up)
+    g_snprintf (catching, sizeof (catching), ", catching up at %.2fx",
+        timeshift->catchup_rate);
+
+  gst_print ("Time-shift: %" G_GUINT64_FORMAT " MB %s buffer, %.1f s behind"
+      " live, %.1f s buffered%s%s\n", timeshift->size >> 20,
+      timeshift->dir ? "disk" : "memory",
+      (gdouble) timeshift->delay / GST_SECOND,
+      (gdouble) buffered / GST_SECOND, full, catching);
+}
+
+static GstPlayModMosaic *
+play_mosaic_new (GstPlayMod * play, guint columns)
+{
+  GstPlayModMosaic *mosaic;
+  guint i;
+
+  mosaic = g_new0 (GstPlayModMosaic, 1);
+  mosaic->num_tiles = play->num_uris;
+  mosaic->columns = columns;
+  if (mosaic->columns == 0)
+    mosaic->columns = (guint) ceil (sqrt (mosaic->num_tiles));
+  mosaic->columns = CLAMP (mosaic->columns, 1, MAX (mosaic->num_tiles, 1));
+  mosaic->rows = (mosaic->num_tiles + mosaic->columns - 1) / mosaic->columns;
+
+  mosaic->tiles = g_new0 (GstPlayModMosaicTile, mosaic->num_tiles);
+  for (i = 0; i < mosaic->num_tiles; i++) {
+    mosaic->tiles[i].mosaic = mosaic;
+    mosaic->tiles[i].index = i;
+  }
+
+  return mosaic;
+}
+
+static void
+play_mosaic_free (GstPlayModMosaic * mosaic)
+{
+  guint i;
+
+  if (mosaic->pipeline != NULL) {
+    gst_element_set_state (mosaic->pipeline, GST_STATE_NULL);
+    gst_bus_remove_watch (GST_ELEMENT_BUS (mosaic->pipeline));
+    gst_object_unref (mosaic->pipeline);
+  }
+
+  for (i = 0; i < mosaic->num_tiles; i++) {
+    if (mosaic->tiles[i].pad != NULL)
+      gst_object_unref (mosaic->tiles[i].pad);
+  }
+  g_free (mosaic->tiles);
+  g_free (mosaic);
+}
+
+static GstPadProbeReturn
+play_mosaic_count (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstPlayModMosaicTile *tile = user_data;
+
+  g_atomic_int_inc (&tile->frames);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Streaming thread: the first video stream of a tile is scaled down to
+ * the tile size before it reaches the compositor, everything else is
+ * dropped */
+static void
+play_mosaic_pad_added (GstElement * decodebin, GstPad * pad,
+    gpointer user_data)
+{
+  GstPlayModMosaicTile *tile = user_data;
+  GstPlayModMosaic *mosaic = tile->mosaic;
+  GstElement *bin, *filter;
+  GstPad *sinkpad, *srcpad;
+  GstCaps *caps;
+  gboolean video;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (caps == NULL)
+    caps = gst_pad_query_caps (pad, NULL);
+  video = g_str_has_prefix (gst_structure_get_name (gst_caps_get_structure
+          (caps, 0)), "video/");
+  gst_caps_unref (caps);
+
+  /* pads can be added from several streaming threads at once, only the
+   * first video stream gets the tile */
+  if (video) {
+    GST_OBJECT_LOCK (decodebin);
+    if (tile->claimed)
+      video = FALSE;
+    tile->claimed = TRUE;
+    GST_OBJECT_UNLOCK (decodebin);
+  }
+
+  if (!video) {
+    bin = gst_element_factory_make ("fakesink", NULL);
+    gst_bin_add (GST_BIN (mosaic->pipeline), bin);
+    gst_element_sync_state_with_parent (bin);
+    sinkpad = gst_element_get_static_pad (bin, "sink");
+    gst_pad_link (pad, sinkpad);
+    gst_object_unref (sinkpad);
+    return;
+  }
+
+  bin = gst_parse_bin_from_description ("videoconvert ! videoscale ! "
+      "capsfilter name=size", TRUE, NULL);
+  filter = gst_bin_get_by_name (GST_BIN (bin), "size");
+  caps = gst_caps_new_simple ("video/x-raw",
+      "width", G_TYPE_INT, mosaic->tile_width,
+      "height", G_TYPE_INT, mosaic->tile_height,
+      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  gst_object_unref (filter);
+
+  gst_bin_add (GST_BIN (mosaic->pipeline), bin);
+
+#if GST_CHECK_VERSION (1, 20, 0)
+  sinkpad = gst_element_request_pad_simple (mosaic->compositor, "sink_%u");
+#else
+  sinkpad = gst_element_get_request_pad (mosaic->compositor, "sink_%u");
+#endif
+  g_object_set (sinkpad,
+      "xpos", (gint) ((tile->index % mosaic->columns) * mosaic->tile_width),
+      "ypos", (gint) ((tile->index / mosaic->columns) * mosaic->tile_height),
+      NULL);
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER, play_mosaic_count,
+      tile, NULL);
+
+  srcpad = gst_element_get_static_pad (bin, "src");
+  gst_pad_link (srcpad, sinkpad);
+  gst_object_unref (srcpad);
+
+  gst_element_sync_state_with_parent (bin);
+
+  srcpad = gst_element_get_static_pad (bin, "sink");
+  gst_pad_link (pad, srcpad);
+  gst_object_unref (srcpad);
+
+  GST_OBJECT_LOCK (decodebin);
+  tile->pad = sinkpad;
+  GST_OBJECT_UNLOCK (decodebin);
+}
+
+/* end a broken tile rather than have the compositor wait for it,
+ * FALSE if the error didn't come from a tile */
+static gboolean
+play_mosaic_drop_tile (GstPlayMod * play, GstObject * src)
+{
+  GstPlayModMosaic *mosaic = play->mosaic;
+  guint i;
+
+  for (i = 0; i < mosaic->num_tiles; i++) {
+    GstPlayModMosaicTile *tile = &mosaic->tiles[i];
+    GstPad *pad;
+
+    if (src != GST_OBJECT (tile->decodebin) &&
+        !gst_object_has_as_ancestor (src, GST_OBJECT (tile->decodebin)))
+      continue;
+
+    gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING, "Dropping tile %u (%s)\n", i,
+        play->uris[i]);
+    GST_OBJECT_LOCK (tile->decodebin);
+    pad = tile->pad != NULL ? gst_object_ref (tile->pad) : NULL;
+    GST_OBJECT_UNLOCK (tile->decodebin);
+    if (pad != NULL) {
+      gst_pad_send_event (pad, gst_event_new_eos ());
+      gst_object_unref (pad);
+    }
+    gst_element_set_locked_state (tile->decodebin, TRUE);
+    gst_element_set_state (tile->decodebin, GST_STATE_NULL);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+play_mosaic_bus_msg (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GError *err = NULL;
+  gchar *dbg = NULL;
+
+  if (gst_is_video_overlay_prepare_window_handle_message (msg))
+    create_window (play, msg);
+
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_EOS:
+      play_end_of_playlist (play);
+      break;
+    case GST_MESSAGE_WARNING:
+      gst_message_parse_warning (msg, &err, &dbg);
+      gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING, "WARNING %s\n", err->message);
+      play_emit_error (play, GST_PLAY_MOD_EVENT_WARNING, err);
+      g_clear_error (&err);
+      g_free (dbg);
+      break;
+    case GST_MESSAGE_ERROR:
+      gst_message_parse_error (msg, &err, &dbg);
+      gst_printerr ("ERROR %s\n", err->message);
+      if (dbg != NULL)
+        gst_printerr ("ERROR debug information: %s\n", dbg);
+      play_emit_error (play, GST_PLAY_MOD_EVENT_ERROR, err);
+      if (!play_mosaic_drop_tile (play, GST_MESSAGE_SRC (msg)))
+        gst_play_mod_quit (play);
+      g_clear_error (&err);
+      g_free (dbg);
+      break;
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static void
+play_mosaic_element_added (GstBin * pipeline, GstBin * bin,
+    GstElement * element, gpointer user_data)
+{
+  play_element_setup (NULL, element, user_data);
+}
+
+static gboolean
+play_mosaic_start (GstPlayMod * play)
+{
+  GstPlayModMosaic *mosaic = play->mosaic;
+  GstElement *filter, *convert, *sink = NULL;
+  xcb_connection_t *connection;
+  GstCaps *caps;
+  guint i;
+
+  if (mosaic->num_tiles == 0)
+    return FALSE;
+
+  connection = play_display_ref ();
+  if (connection != NULL) {
+    play_region_resolve (play, connection);
+    play_display_unref ();
+  } else if (play->region.width == 0 || play->region.height == 0) {
+    play->region.width = 1920;
+    play->region.height = 1080;
+  }
+  mosaic->tile_width = GST_ROUND_DOWN_2 (play->region.width / mosaic->columns);
+  mosaic->tile_height = GST_ROUND_DOWN_2 (play->region.height / mosaic->rows);
+
+  mosaic->pipeline = gst_pipeline_new ("mosaic");
+  mosaic->compositor = gst_element_factory_make ("compositor", NULL);
+  filter = gst_element_factory_make ("capsfilter", NULL);
+  convert = gst_element_factory_make ("videoconvert", NULL);
+
+  /* playbin never gets to use the sink in mosaic mode; either way we
+   * hold a reference to it here */
+  g_object_get (play->playbin, "video-sink", &sink, NULL);
+  if (sink != NULL)
+    g_object_set (play->playbin, "video-sink", NULL, NULL);
+  else if ((sink = gst_element_factory_make ("autovideosink", NULL)))
+    gst_object_ref_sink (sink);
+
+  if (mosaic->compositor == NULL || filter == NULL || convert == NULL ||
+      sink == NULL) {
+    gst_printerr ("Mosaic needs the compositor, videoconvert and a video "
+        "sink. Check your GStreamer installation.\n");
+    /* none of these made it into the pipeline yet */
+    if (mosaic->compositor != NULL)
+      gst_object_unref (mosaic->compositor);
+    if (filter != NULL)
+      gst_object_unref (filter);
+    if (convert != NULL)
+      gst_object_unref (convert);
+    if (sink != NULL)
+      gst_object_unref (sink);
+    mosaic->compositor = NULL;
+    gst_object_unref (mosaic->pipeline);
+    mosaic->pipeline = NULL;
+    return FALSE;
+  }
+
+  g_object_set (mosaic->compositor, "background", 1, NULL);
+  caps = gst_caps_new_simple ("video/x-raw",
+      "width", G_TYPE_INT, mosaic->tile_width * mosaic->columns,
+      "height", G_TYPE_INT, mosaic->tile_height * mosaic->rows, NULL);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  gst_bin_add_many (GST_BIN (mosaic->pipeline), mosaic->compositor, filter,
+      convert, sink, NULL);
+  gst_element_link_many (mosaic->compositor, filter, convert, sink, NULL);
+  gst_object_unref (sink);
+
+  /* same decoder tuning as playbin gets */
+  g_signal_connect (mosaic->pipeline, "deep-element-added",
+      G_CALLBACK (play_mosaic_element_added), play);
+
+  /* tiles only show video; leave the rest undecoded, and unexposed */
+  caps = gst_caps_new_empty_simple ("video/x-raw");
+  for (i = 0; i < mosaic->num_tiles; i++) {
+    GstPlayModMosaicTile *tile = &mosaic->tiles[i];
+
+    tile->decodebin = gst_element_factory_make ("uridecodebin", NULL);
+    g_object_set (tile->decodebin, "uri", play->uris[i], "caps", caps,
+        "expose-all-streams", FALSE, NULL);
+    g_signal_connect (tile->decodebin, "pad-added",
+        G_CALLBACK (play_mosaic_pad_added), tile);
+    gst_bin_add (GST_BIN (mosaic->pipeline), tile->decodebin);
+  }
+  gst_caps_unref (caps);
+
+  gst_bus_add_watch (GST_ELEMENT_BUS (mosaic->pipeline), play_mosaic_bus_msg,
+      play);
+
+  gst_print ("Mosaic of %u tiles, %ux%u of %ux%u\n", mosaic->num_tiles,
+      mosaic->columns, mosaic->rows, mosaic->tile_width, mosaic->tile_height);
+
+  mosaic->last_update = g_get_monotonic_time ();
+
+  if (gst_element_set_state (mosaic->pipeline, play->desired_state) ==
+      GST_STATE_CHANGE_FAILURE) {
+    gst_printerr ("Could not start the mosaic\n");
+    gst_element_set_state (mosaic->pipeline, GST_STATE_NULL);
+    gst_bus_remove_watch (GST_ELEMENT_BUS (mosaic->pipeline));
+    gst_object_unref (mosaic->pipeline);
+    mosaic->pipeline = NULL;
+    mosaic->compositor = NULL;
+    for (i = 0; i < mosaic->num_tiles; i++)
+      mosaic->tiles[i].decodebin = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* commands that make sense for a whole wall, the rest is ignored */
+static gboolean
+play_mosaic_command (GstPlayMod * play, GstPlayModCommandType type)
+{
+  GstPlayModMosaic *mosaic = play->mosaic;
+
+  switch (type) {
+    case GST_PLAY_MOD_COMMAND_QUIT:
+    case GST_PLAY_MOD_COMMAND_PRINT_STATS:
+      return FALSE;
+    case GST_PLAY_MOD_COMMAND_TOGGLE_PAUSED:
+      if (play->desired_state == GST_STATE_PLAYING)
+        play->desired_state = GST_STATE_PAUSED;
+      else
+        play->desired_state = GST_STATE_PLAYING;
+      if (mosaic->pipeline != NULL)
+        gst_element_set_state (mosaic->pipeline, play->desired_state);
+      break;
+    case GST_PLAY_MOD_COMMAND_SEEK_TO_BEGINNING:
+      if (mosaic->pipeline != NULL)
+        gst_element_seek_simple (mosaic->pipeline, GST_FORMAT_TIME,
+            GST_SEEK_FLAG_FLUSH, 0);
+      break;
+    default:
+      gst_print ("%s is not available in mosaic mode\n",
+          gst_play_mod_command_get_name (type));
+      break;
+  }
+
+  return TRUE;
+}
+
+/* called from play_timeout */
+static void
+play_mosaic_update (GstPlayMod * play)
+{
+  GstPlayModMosaic *mosaic = play->mosaic;
+  gdouble fps_min = G_MAXDOUBLE, fps_total = 0.0;
+  gint64 now, cpu;
+  guint i;
+
+  now = g_get_monotonic_time ();
+  if (mosaic->pipeline == NULL || now - mosaic->last_update < G_USEC_PER_SEC)
+    return;
+
+  for (i = 0; i < mosaic->num_tiles; i++) {
+    GstPlayModMosaicTile *tile = &mosaic->tiles[i];
+    gint frames = g_atomic_int_get (&tile->frames);
+
+    tile->fps = (gdouble) (frames - tile->last_frames) * G_USEC_PER_SEC /
+        (now - mosaic->last_update);
+    tile->last_frames = frames;
+    fps_min = MIN (fps_min, tile->fps);
+    fps_total += tile->fps;
+  }
+
+  cpu = play_cpu_time ();
+  if (mosaic->last_cpu != 0) {
+    mosaic->cpu = 100.0 * (cpu - mosaic->last_cpu) /
+        (now - mosaic->last_update);
+    mosaic->cpu_max = MAX (mosaic->cpu_max, mosaic->cpu);
+  }
+  mosaic->last_cpu = cpu;
+  mosaic->last_update = now;
+
+  gst_print ("%u tiles, %.1f fps avg, %.1f fps min, CPU %.0f%% of %u cores\r",
+      mosaic->num_tiles, fps_total / mosaic->num_tiles, fps_min, mosaic->cpu,
+      g_get_num_processors ());
+}
+
+static void
+play_mosaic_print (GstPlayMod * play)
+{
+  GstPlayModMosaic *mosaic = play->mosaic;
+  guint i;
+
+  if (mosaic == NULL)
+    return;
+
+  gst_print ("Mosaic: %u tiles of %ux%u, CPU %.0f%% (max %.0f%%) of %u "
+      "cores\n", mosaic->num_tiles, mosaic->tile_width, mosaic->tile_height,
+      mosaic->cpu, mosaic->cpu_max, g_get_num_processors ());
+  for (i = 0; i < mosaic->num_tiles; i++)
+    gst_print ("  tile %2u: %5.1f fps, %u frames, %s\n", i,
+        mosaic->tiles[i].fps, g_atomic_int_get (&mosaic->tiles[i].frames),
+        play->uris[i]);
+}
+
+static void play_sync_peer_read (GstPlayModSyncPeer * peer);
+
+static GstPlayModSyncPeer *
+play_sync_peer_new (GstPlayMod * play, GSocketConnection * connection)
+{
+  GstPlayModSyncPeer *peer;
+  GSocketAddress *address;
+
+  peer = g_new0 (GstPlayModSyncPeer, 1);
+  peer->play = play;
+  peer->connection = g_object_ref (connection);
+  peer->input = g_data_input_stream_new (g_io_stream_get_input_stream
+      (G_IO_STREAM (connection)));
+  peer->cancellable = g_cancellable_new ();
+
+  address = g_socket_connection_get_remote_address (connection, NULL);
+  if (G_IS_INET_SOCKET_ADDRESS (address)) {
+    gchar *host = g_inet_address_to_string (g_inet_socket_address_get_address
+        (G_INET_SOCKET_ADDRESS (address)));
+
+    peer->name = g_strdup_printf ("%s:%u", host,
+        g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address)));
+    g_free (host);
+  } else {
+    peer->name = g_strdup ("unknown");
+  }
+  if (address != NULL)
+    g_object_unref (address);
+
+  play_sync_peer_read (peer);
+
+  return peer;
+}
+
+static void
+play_sync_peer_free (GstPlayModSyncPeer * peer)
+{
+  /* the pending read completes later with G_IO_ERROR_CANCELLED and
+   * doesn't look at the peer anymore */
+  g_cancellable_cancel (peer->cancellable);
+  g_object_unref (peer->cancellable);
+  /* the line being written is freed when the write completes */
+  if (!g_queue_is_empty (&peer->output))
+    g_queue_pop_head (&peer->output);
+  g_queue_foreach (&peer->output, (GFunc) g_free, NULL);
+  g_queue_clear (&peer->output);
+  g_io_stream_close (G_IO_STREAM (peer->connection), NULL, NULL);
+  g_object_unref (peer->input);
+  g_object_unref (peer->connection);
+  g_free (peer->name);
+  g_free (peer);
+}
+
+static void play_sync_peer_write (GstPlayModSyncPeer * peer);
+
+typedef struct
+{
+  GstPlayModSyncPeer *peer;
+  gchar *line;
+} GstPlayModSyncWrite;
+
+static void
+play_sync_peer_written (GObject * source, GAsyncResult * res,
+    gpointer user_data)
+{
+  GstPlayModSyncWrite *write = user_data;
+  GstPlayModSyncPeer *peer = write->peer;
+  GError *err = NULL;
+
+  g_output_stream_write_all_finish (G_OUTPUT_STREAM (source), res, NULL,
+      &err);
+  g_free (write->line);
+  g_free (write);
+
+  /* the peer is gone */
+  if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_clear_error (&err);
+    return;
+  }
+
+  g_queue_pop_head (&peer->output);
+
+  /* a dead peer is noticed and removed by its reader */
+  if (err != NULL) {
+    g_queue_foreach (&peer->output, (GFunc) g_free, NULL);
+    g_queue_clear (&peer->output);
+    g_clear_error (&err);
+    return;
+  }
+
+  play_sync_peer_write (peer);
+}
+
+static void
+play_sync_peer_write (GstPlayModSyncPeer * peer)
+{
+  GstPlayModSyncWrite *write;
+  GOutputStream *output;
+
+  if (g_queue_is_empty (&peer->output))
+    return;
+
+  write = g_new0 (GstPlayModSyncWrite, 1);
+  write->peer = peer;
+  write->line = g_queue_peek_head (&peer->output);
+
+  output = g_io_stream_get_output_stream (G_IO_STREAM (peer->connection));
+  g_output_stream_write_all_async (output, write->line, strlen (write->line),
+      G_PRIORITY_DEFAULT, peer->cancellable, play_sync_peer_written, write);
+}
+
+/* queued and written asynchronously, so a slow peer doesn't hold up the
+ * control thread */
+static void
+play_sync_peer_send (GstPlayModSyncPeer * peer, const gchar * line)
+{
+  if (g_queue_get_length (&peer->output) >= SYNC_MAX_QUEUED) {
+    /* its reader sees the connection end and removes it */
+    GST_WARNING ("sync peer %s is not keeping up, disconnecting", peer->name);
+    g_socket_shutdown (g_socket_connection_get_socket (peer->connection),
+        TRUE, TRUE, NULL);
+    return;
+  }
+
+  g_queue_push_tail (&peer->output, g_strdup (line));
+  if (g_queue_get_length (&peer->output) == 1)
+    play_sync_peer_write (peer);
+}
+
+/* SYNC INDEX POSITION RATE TRICK-MODE BASE-TIME STATE */
+static gchar *
+play_sync_format (const GstPlayModSyncPoint * point)
+{
+  gchar rate[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_ascii_dtostr (rate, sizeof (rate), point->rate);
+
+  return g_strdup_printf ("SYNC %d %" G_GINT64_FORMAT " %s %d %"
+      G_GUINT64_FORMAT " %d\n", point->idx, point->pos, rate, point->mode,
+      point->base, point->state);
+}
+
+/* applied the same way on the master and the slaves: everybody seeks to
+ * the same position while paused, and the first frame after it is shown
+ * at the same time of the shared clock */
+static void
+play_sync_execute (GstPlayMod * play)
+{
+  GstPlayModSync *sync = play->sync;
+
+  sync->pending = FALSE;
+  sync->points++;
+  play->desired_state = sync->point.state;
+
+  play_set_state (play, GST_STATE_PAUSED);
+
+  sync->executing = TRUE;
+  if (!play_do_seek_full (play, sync->point.pos, sync->point.rate,
+          sync->point.mode, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE))
+    gst_print ("\nCould not seek to the sync point.\n");
+  sync->executing = FALSE;
+
+  sync->prerolling = TRUE;
+}
+
+/* on ASYNC_DONE */
+static void
+play_sync_prerolled (GstPlayMod * play)
+{
+  GstPlayModSync *sync = play->sync;
+
+  if (sync == NULL || !sync->prerolling)
+    return;
+
+  sync->prerolling = FALSE;
+
+  /* the pipeline's start time is off, so this stays our base time
+   * through pauses and buffering until the next sync point */
+  gst_element_set_base_time (play->playbin, sync->point.base);
+  if (sync->point.state == GST_STATE_PLAYING && !play->buffering)
+    play_set_state (play, GST_STATE_PLAYING);
+}
+
+static void
+play_sync_apply (GstPlayMod * play)
+{
+  GstPlayModSync *sync = play->sync;
+
+  sync->pending = TRUE;
+
+  /* switch items first, play_sync_item_ready() takes it from there */
+  if (sync->point.idx != g_atomic_int_get (&play->cur_idx)) {
+    if (sync->point.idx < 0 || sync->point.idx >= play->num_uris) {
+      gst_printerr ("Sync point for item %d, but there are only %d\n",
+          sync->point.idx, play->num_uris);
+      sync->pending = FALSE;
+      return;
+    }
+    g_atomic_int_set (&play->cur_idx, sync->point.idx);
+    gst_play_mod_uri (play, play->uris[sync->point.idx]);
+    return;
+  }
+
+  if (!play->start_pending)
+    play_sync_execute (play);
+}
+
+/* master: a new sync point @delay from now, at @pos or the current
+ * position if it's -1 */
+static void
+play_sync_point (GstPlayMod * play, gint64 pos, gdouble rate,
+    GstPlayModTrickMode mode, GstState state)
+{
+  GstPlayModSync *sync = play->sync;
+  gchar *line;
+  GList *l;
+
+  if (pos < 0 && !gst_element_query_position (play->playbin, GST_FORMAT_TIME,
+          &pos))
+    pos = 0;
+
+  sync->point.idx = g_atomic_int_get (&play->cur_idx);
+  sync->point.pos = pos;
+  sync->point.rate = rate;
+  sync->point.mode = mode;
+  sync->point.base = gst_clock_get_time (sync->clock) + sync->delay;
+  sync->point.state = state;
+
+  line = play_sync_format (&sync->point);
+  for (l = sync->peers; l != NULL; l = l->next)
+    play_sync_peer_send (l->data, line);
+  g_free (line);
+
+  play_sync_apply (play);
+}
+
+/* called for flushing seeks: on the master they become sync points, and
+ * TRUE is returned to say the seek was taken care of */
+static gboolean
+play_sync_intercept (GstPlayMod * play, gint64 pos, gdouble rate,
+    GstPlayModTrickMode mode)
+{
+  GstPlayModSync *sync = play->sync;
+
+  if (sync == NULL || !sync->master || sync->executing)
+    return FALSE;
+
+  play->rate = rate;
+  play->trick_mode = mode;
+  play_sync_point (play, pos, rate, mode, play->desired_state);
+  return TRUE;
+}
+
+/* the current item prerolled; TRUE if the sync code takes it from here */
+static gboolean
+play_sync_item_ready (GstPlayMod * play)
+{
+  GstPlayModSync *sync = play->sync;
+
+  if (sync == NULL || sync->master)
+    return FALSE;
+
+  /* slaves wait for the master to tell them where to start */
+  if (sync->pending && sync->point.idx == g_atomic_int_get (&play->cur_idx))
+    play_sync_execute (play);
+
+  return TRUE;
+}
+
+/* master: where the slave at @peer should be at @clock_time */
+static void
+play_sync_handle_position (GstPlayModSyncPeer * peer, gchar ** tokens)
+{
+  GstPlayMod *play = peer->play;
+  GstPlayModSync *sync = play->sync;
+  GstClockTime clock_time, now;
+  gint64 slave_pos, pos;
+  gdouble expected;
+
+  if (g_strv_length (tokens) != 3 ||
+      !gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    return;
+
+  now = gst_clock_get_time (sync->clock);
+  clock_time = g_ascii_strtoull (tokens[1], NULL, 10);
+  slave_pos = g_ascii_strtoll (tokens[2], NULL, 10);
+
+  expected = pos;
+  if (play->desired_state == GST_STATE_PLAYING)
+    expected -= ((gdouble) now - clock_time) * play->rate;
+
+  peer->skew = slave_pos - (gint64) expected;
+  peer->skew_max = MAX (peer->skew_max, ABS (peer->skew));
+  peer->reports++;
+}
+
+/* slave: a sync point from the master */
+static void
+play_sync_handle_point (GstPlayMod * play, gchar ** tokens)
+{
+  GstPlayModSync *sync = play->sync;
+
+  if (g_strv_length (tokens) != 7)
+    return;
+
+  sync->point.idx = g_ascii_strtoll (tokens[1], NULL, 10);
+  sync->point.pos = g_ascii_strtoll (tokens[2], NULL, 10);
+  sync->point.rate = g_ascii_strtod (tokens[3], NULL);
+  sync->point.mode = g_ascii_strtoll (tokens[4], NULL, 10);
+  sync->point.base = g_ascii_strtoull (tokens[5], NULL, 10);
+  sync->point.state = g_ascii_strtoll (tokens[6], NULL, 10);
+
+  if (sync->point.base < gst_clock_get_time (sync->clock))
+    gst_print ("\nSync point arrived %.1f ms late.\n",
+        (gdouble) (gst_clock_get_time (sync->clock) - sync->point.base) /
+        GST_MSECOND);
+
+  play_sync_apply (play);
+}
+
+static void
+play_sync_peer_line (GObject * source, GAsyncResult * res, gpointer user_data)
+{
+  GstPlayModSyncPeer *peer = user_data;
+  GstPlayModSync *sync;
+  GError *err = NULL;
+  gchar *line, **tokens;
+
+  line = g_data_input_stream_read_line_finish_utf8 (G_DATA_INPUT_STREAM
+      (source), res, NULL, &err);
+  if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_clear_error (&err);
+    return;
+  }
+
+  sync = peer->play->sync;
+
+  if (line == NULL) {
+    if (sync->master)
+      gst_print ("\nSync slave %s left.\n", peer->name);
+    else
+      gst_printerr ("\nLost the connection to the sync master.\n");
+    g_clear_error (&err);
+    sync->peers = g_list_remove (sync->peers, peer);
+    play_sync_peer_free (peer);
+    return;
+  }
+
+  tokens = g_strsplit (line, " ", 0);
+  if (sync->master && g_str_equal (tokens[0], "POS"))
+    play_sync_handle_position (peer, tokens);
+  else if (!sync->master && g_str_equal (tokens[0], "SYNC"))
+    play_sync_handle_point (peer->play, tokens);
+  g_strfreev (tokens);
+  g_free (line);
+
+  play_sync_peer_read (peer);
+}
+
+static void
+play_sync_peer_read (GstPlayModSyncPeer * peer)
+{
+  g_data_input_stream_read_line_async (peer->input, G_PRIORITY_DEFAULT,
+      peer->cancellable, play_sync_peer_line, peer);
+}
+
+/* master: a slave connected, bring it in where we are a little later */
+static gboolean
+play_sync_incoming (GSocketService * service, GSocketConnection * connection,
+    GObject * source_object, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModSync *sync = play->sync;
+  GstPlayModSyncPoint point;
+  GstPlayModSyncPeer *peer;
+  gint64 pos;
+  gchar *line;
+
+  peer = play_sync_peer_new (play, connection);
+  sync->peers = g_list_append (sync->peers, peer);
+  gst_print ("\nSync slave %s joined.\n", peer->name);
+
+  if (g_atomic_int_get (&play->cur_idx) < 0 ||
+      !gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    return TRUE;
+
+  point.idx = g_atomic_int_get (&play->cur_idx);
+  point.base = gst_clock_get_time (sync->clock) + sync->delay;
+  point.pos = pos;
+  if (play->desired_state == GST_STATE_PLAYING)
+    point.pos += sync->delay * play->rate;
+  point.rate = play->rate;
+  point.mode = play->trick_mode;
+  point.state = play->desired_state;
+
+  line = play_sync_format (&point);
+  play_sync_peer_send (peer, line);
+  g_free (line);
+
+  return TRUE;
+}
+
+static GstPlayModSync *
+play_sync_new (GstPlayMod * play, GstClock * clock)
+{
+  GstPlayModSync *sync;
+
+  sync = g_new0 (GstPlayModSync, 1);
+  sync->clock = clock;
+  sync->point.idx = -1;
+
+  /* we hand out base times ourselves */
+  gst_pipeline_use_clock (GST_PIPELINE (play->playbin), clock);
+  gst_element_set_start_time (play->playbin, GST_CLOCK_TIME_NONE);
+
+  return sync;
+}
+
+static void
+play_sync_free (GstPlayModSync * sync)
+{
+  g_list_free_full (sync->peers, (GDestroyNotify) play_sync_peer_free);
+  if (sync->service != NULL) {
+    g_socket_service_stop (sync->service);
+    g_socket_listener_close (G_SOCKET_LISTENER (sync->service));
+    g_object_unref (sync->service);
+  }
+  if (sync->provider != NULL)
+    gst_object_unref (sync->provider);
+  gst_object_unref (sync->clock);
+  g_free (sync->address);
+  g_free (sync);
+}
+
+/* called from play_timeout, slaves report their position once a second */
+static void
+play_sync_update (GstPlayMod * play)
+{
+  GstPlayModSync *sync = play->sync;
+  gint64 now, pos;
+  gchar *line;
+
+  if (sync == NULL || sync->master || sync->peers == NULL)
+    return;
+
+  now = g_get_monotonic_time ();
+  if (now - sync->last_report < G_USEC_PER_SEC ||
+      !gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    return;
+  sync->last_report = now;
+
+  line = g_strdup_printf ("POS %" G_GUINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+      gst_clock_get_time (sync->clock), pos);
+  play_sync_peer_send (sync->peers->data, line);
+  g_free (line);
+}
+
+/* slaves leave transport control to the master */
+static gboolean
+play_sync_command (GstPlayMod * play, GstPlayModCommandType type)
+{
+  switch (type) {
+    case GST_PLAY_MOD_COMMAND_QUIT:
+    case GST_PLAY_MOD_COMMAND_CHANGE_AUDIO_TRACK:
+    case GST_PLAY_MOD_COMMAND_CHANGE_VIDEO_TRACK:
+    case GST_PLAY_MOD_COMMAND_CHANGE_SUBTITLE_TRACK:
+    case GST_PLAY_MOD_COMMAND_TOGGLE_MUTE:
+    case GST_PLAY_MOD_COMMAND_INCREASE_VOLUME:
+    case GST_PLAY_MOD_COMMAND_DECREASE_VOLUME:
+    case GST_PLAY_MOD_COMMAND_DUMP_TUNING:
+    case GST_PLAY_MOD_COMMAND_PRINT_STATS:
+    case GST_PLAY_MOD_COMMAND_SELECT_TRACK:
+      return FALSE;
+    default:
+      gst_print ("%s is up to the sync master\n",
+          gst_play_mod_command_get_name (type));
+      return TRUE;
+  }
+}
+
+static void
+play_sync_print (GstPlayMod * play)
+{
+  GstPlayModSync *sync = play->sync;
+  GList *l;
+
+  if (sync == NULL)
+    return;
+
+  if (!sync->master) {
+    gst_print ("Sync: slave of %s, %s, %u sync points\n", sync->address,
+        sync->peers ? "connected" : "disconnected", sync->points);
+    return;
+  }
+
+  gst_print ("Sync: master on %s, %u slaves, %u sync points\n",
+      sync->address, g_list_length (sync->peers), sync->points);
+  for (l = sync->peers; l != NULL; l = l->next) {
+    GstPlayModSyncPeer *peer = l->data;
+
+    if (peer->reports > 0)
+      gst_print ("  %s: skew %+.2f ms, max %.2f ms\n", peer->name,
+          (gdouble) peer->skew / GST_MSECOND,
+          (gdouble) peer->skew_max / GST_MSECOND);
+    else
+      gst_print ("  %s: no position reports yet\n", peer->name);
+  }
+}
+
+gboolean
+gst_play_mod_enable_sync_master (GstPlayMod * play, guint port,
+    GstClockTime delay, GError ** error)
+{
+  GstNetTimeProvider *provider;
+  GSocketService *service;
+  GstClock *clock;
+
+  clock = gst_system_clock_obtain ();
+  provider = gst_net_time_provider_new (clock, NULL, port);
+  if (provider == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "Could not serve the clock on port %u", port);
+    gst_object_unref (clock);
+    return FALSE;
+  }
+
+  service = g_socket_service_new ();
+  if (!g_socket_listener_add_inet_port (G_SOCKET_LISTENER (service), port + 1,
+          NULL, error)) {
+    g_object_unref (service);
+    gst_object_unref (provider);
+    gst_object_unref (clock);
+    return FALSE;
+  }
+
+  play->sync = play_sync_new (play, clock);
+  play->sync->master = TRUE;
+  play->sync->provider = provider;
+  play->sync->service = service;
+  play->sync->delay = delay;
+  play->sync->address = g_strdup_printf ("port %u", port);
+
+  /* connections are handled on the player's context like the commands */
+  g_signal_connect (service, "incoming", G_CALLBACK (play_sync_incoming),
+      play);
+  g_main_context_push_thread_default (play->commands.context);
+  g_socket_service_start (service);
+  g_main_context_pop_thread_default (play->commands.context);
+
+  return TRUE;
+}
+
+gboolean
+gst_play_mod_enable_sync_slave (GstPlayMod * play, const gchar * host,
+    guint port, GError ** error)
+{
+  GSocketConnection *connection;
+  GSocketClient *client;
+  GstClock *clock;
+
+  client = g_socket_client_new ();
+  connection = g_socket_client_connect_to_host (client, host, port + 1, NULL,
+      error);
+  g_object_unref (client);
+  if (connection == NULL)
+    return FALSE;
+
+  clock = gst_net_client_clock_new (NULL, host, port, 0);
+  if (!gst_clock_wait_for_sync (clock, 5 * GST_SECOND))
+    gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+        "Clock of %s:%u not synchronised yet\n", host, port);
+
+  play->sync = play_sync_new (play, clock);
+  play->sync->address = g_strdup_printf ("%s:%u", host, port);
+  g_main_context_push_thread_default (play->commands.context);
+  play->sync->peers = g_list_append (NULL, play_sync_peer_new (play,
+          connection));
+  g_main_context_pop_thread_default (play->commands.context);
+  g_object_unref (connection);
+
+  return TRUE;
+}
+
+static void
+play_frame_stats_reset (GstPlayModFrameStats * stats)
+{
+  memset (stats, 0, sizeof (*stats));
+  stats->first_pts = GST_CLOCK_TIME_NONE;
+}
+
+/* frame size from caps, byte counts and the time span from buffers */
+static GstPadProbeReturn
+play_downscale_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstPlayModDownscale *downscale = user_data;
+  GstPlayModFrameStats *stats;
+
+  /* the scaler's sink pad sees what the decoder made, the filter's source
+   * pad what goes on to the sink */
+  if (GST_PAD_IS_SINK (pad))
+    stats = &downscale->decoded;
+  else
+    stats = &downscale->scaled;
+
+  g_mutex_lock (&downscale->lock);
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+
+    stats->bytes += gst_buffer_get_size (buf);
+    stats->frames++;
+    if (GST_BUFFER_PTS_IS_VALID (buf)) {
+      if (!GST_CLOCK_TIME_IS_VALID (stats->first_pts))
+        stats->first_pts = GST_BUFFER_PTS (buf);
+      stats->last_pts = GST_BUFFER_PTS (buf);
+    }
+  } else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+      GST_EVENT_CAPS) {
+    GstVideoInfo vinfo;
+    GstCaps *caps;
+
+    gst_event_parse_caps (GST_PAD_PROBE_INFO_EVENT (info), &caps);
+    if (gst_video_info_from_caps (&vinfo, caps)) {
+      stats->width = GST_VIDEO_INFO_WIDTH (&vinfo);
+      stats->height = GST_VIDEO_INFO_HEIGHT (&vinfo);
+    }
+  }
+  g_mutex_unlock (&downscale->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+play_downscale_watch (GstPlayModDownscale * downscale, GstElement * element,
+    const gchar * pad_name)
+{
+  GstPad *pad = gst_element_get_static_pad (element, pad_name);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, play_downscale_probe, downscale,
+      NULL);
+  gst_object_unref (pad);
+}
+
+/* Sources are scaled down to fit the window as soon as they leave the
+ * decoder, so colour conversion and the sink only touch as many pixels as
+ * can be shown. The caps give a size range rather than a size, so
+ * videoscale keeps the aspect ratio and passes smaller sources through
+ * untouched. */
+static GstPlayModDownscale *
+play_downscale_new (gint max_width, gint max_height)
+{
+  GstPlayModDownscale *downscale;
+  GstElement *scale, *filter;
+  GstCaps *caps;
+  GstPad *pad;
+
+  scale = gst_element_factory_make ("videoscale", NULL);
+  filter = gst_element_factory_make ("capsfilter", NULL);
+  if (scale == NULL || filter == NULL) {
+    gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+        "videoscale or capsfilter missing, not downscaling\n");
+    if (scale)
+      gst_object_unref (scale);
+    if (filter)
+      gst_object_unref (filter);
+    return NULL;
+  }
+
+  downscale = g_new0 (GstPlayModDownscale, 1);
+  g_mutex_init (&downscale->lock);
+  downscale->max_width = max_width;
+  downscale->max_height = max_height;
+  downscale->idx = -1;
+  play_frame_stats_reset (&downscale->decoded);
+  play_frame_stats_reset (&downscale->scaled);
+
+  caps = gst_caps_new_simple ("video/x-raw",
+      "width", GST_TYPE_INT_RANGE, 1, max_width,
+      "height", GST_TYPE_INT_RANGE, 1, max_height,
+      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  downscale->bin = gst_object_ref_sink (gst_bin_new ("downscale"));
+  gst_bin_add_many (GST_BIN (downscale->bin), scale, filter, NULL);
+  gst_element_link (scale, filter);
+
+  pad = gst_element_get_static_pad (scale, "sink");
+  gst_element_add_pad (downscale->bin, gst_ghost_pad_new ("sink", pad));
+  gst_object_unref (pad);
+  pad = gst_element_get_static_pad (filter, "src");
+  gst_element_add_pad (downscale->bin, gst_ghost_pad_new ("src", pad));
+  gst_object_unref (pad);
+
+  play_downscale_watch (downscale, scale, "sink");
+  play_downscale_watch (downscale, filter, "src");
+
+  return downscale;
+}
+
+static void
+play_downscale_free (GstPlayModDownscale * downscale)
+{
+  gst_object_unref (downscale->bin);
+  g_mutex_clear (&downscale->lock);
+  g_free (downscale);
+}
+
+/* frame bytes per second of content, so pauses don't count */
+static gdouble
+play_frame_stats_rate (const GstPlayModFrameStats * stats)
+{
+  GstClockTime span;
+
+  if (stats->frames < 2 || !GST_CLOCK_TIME_IS_VALID (stats->first_pts) ||
+      stats->last_pts <= stats->first_pts)
+    return 0.0;
+
+  /* the last frame lasts as long as the average one */
+  span = (stats->last_pts - stats->first_pts) * stats->frames /
+      (stats->frames - 1);
+  return (gdouble) stats->bytes * GST_SECOND / span;
+}
+
+static void
+play_downscale_print_locked (GstPlayMod * play)
+{
+  GstPlayModDownscale *downscale = play->downscale;
+  GstPlayModFrameStats *in = &downscale->decoded, *out = &downscale->scaled;
+
+  if (in->frames == 0 || downscale->idx < 0)
+    return;
+
+  gst_print ("Video of item %d: %dx%d decoded, %dx%d shown, %.1f -> %.1f "
+      "MB/s, %" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT " kB/frame\n",
+      downscale->idx, in->width, in->height, out->width, out->height,
+      play_frame_stats_rate (in) / (1024 * 1024),
+      play_frame_stats_rate (out) / (1024 * 1024),
+      in->bytes / in->frames / 1024,
+      out->frames ? out->bytes / out->frames / 1024 : 0);
+}
+
+/* on STREAM_START, report on the item that just finished */
+static void
+play_downscale_item (GstPlayMod * play)
+{
+  GstPlayModDownscale *downscale = play->downscale;
+
+  if (downscale == NULL)
+    return;
+
+  g_mutex_lock (&downscale->lock);
+  play_downscale_print_locked (play);
+  play_frame_stats_reset (&downscale->decoded);
+  play_frame_stats_reset (&downscale->scaled);
+  downscale->idx = play->cur_idx;
+  g_mutex_unlock (&downscale->lock);
+}
+
+static void
+play_downscale_print (GstPlayMod * play)
+{
+  if (play->downscale == NULL)
+    return;
+
+  g_mutex_lock (&play->downscale->lock);
+  play_downscale_print_locked (play);
+  g_mutex_unlock (&play->downscale->lock);
+}
+
+static GstPlayModPacingRate *
+play_pacing_rate (GstPlayModPacing * pacing, gdouble rate)
+{
+  GstPlayModPacingRate *entry;
+  guint i;
+
+  /* the rate ladder steps by 0.1 at least */
+  rate = floor (rate * 100 + 0.5) / 100;
+  for (i = 0; i < pacing->rates->len; i++) {
+    entry = &g_array_index (pacing->rates, GstPlayModPacingRate, i);
+    if (entry->rate == rate)
+      return entry;
+  }
+
+  g_array_set_size (pacing->rates, pacing->rates->len + 1);
+  entry = &g_array_index (pacing->rates, GstPlayModPacingRate,
+      pacing->rates->len - 1);
+  entry->rate = rate;
+  return entry;
+}
+
+static GstPadProbeReturn
+play_pacing_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstPlayModPacing *pacing = play->pacing;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+  /* flushes come from another thread than the frames */
+  g_mutex_lock (&pacing->lock);
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT)
+    gst_event_copy_segment (event, &pacing->segment);
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT ||
+      GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    pacing->last_render = GST_CLOCK_TIME_NONE;
+  g_mutex_unlock (&pacing->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+typedef struct
+{
+  GstPlayMod *play;
+  GstPadChainFunction chain;
+} GstPlayModPacingChain;
+
+static void
+play_pacing_record (GstPlayMod * play, GstClockTime running, gboolean late,
+    GstClockTime render)
+{
+  GstPlayModPacing *pacing = play->pacing;
+  GstPlayModPacingRate *entry;
+
+  g_mutex_lock (&pacing->lock);
+  entry = play_pacing_rate (pacing,
+      pacing->segment.rate * pacing->segment.applied_rate);
+  entry->frames++;
+  pacing->frames++;
+  if (late) {
+    entry->late++;
+    pacing->late++;
+  }
+
+  /* pauses and seeks aren't pacing problems */
+  if (GST_CLOCK_TIME_IS_VALID (pacing->last_render) &&
+      running > pacing->last_running &&
+      render - pacing->last_render < GST_SECOND) {
+    gdouble interval = (gdouble) (render - pacing->last_render) / GST_MSECOND;
+    gdouble expected = (gdouble) (running - pacing->last_running) /
+        GST_MSECOND;
+    gdouble ratio = interval / expected;
+    guint i;
+
+    for (i = 0; i < PACING_BUCKETS - 1; i++) {
+      if (ratio < pacing_bucket_limits[i])
+        break;
+    }
+    entry->histogram[i]++;
+    if (ratio < 0.5)
+      entry->early++;
+
+    entry->intervals++;
+    entry->interval_sum += interval;
+    entry->interval_sumsq += interval * interval;
+    entry->interval_max = MAX (entry->interval_max, interval);
+  }
+
+  pacing->last_render = render;
+  pacing->last_running = running;
+  g_mutex_unlock (&pacing->lock);
+}
+
+/* Wraps the sink's own chain function: a synchronising sink returns from
+ * it once it waited for the frame's time and rendered it, so the clock
+ * at that point is when the frame was actually shown. */
+static GstFlowReturn
+play_pacing_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstPlayModPacingChain *data = GST_PAD_CHAINDATA (pad);
+  GstPlayMod *play = data->play;
+  GstPlayModPacing *pacing = play->pacing;
+  GstClockTime running = GST_CLOCK_TIME_NONE, due = 0, arrival = 0;
+  GstClock *clock = NULL;
+  GstFlowReturn ret;
+
+  if (pacing->segment.format == GST_FORMAT_TIME &&
+      GST_BUFFER_PTS_IS_VALID (buf)) {
+    running = gst_segment_to_running_time (&pacing->segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buf));
+    clock = gst_element_get_clock (play->playbin);
+  }
+  if (GST_CLOCK_TIME_IS_VALID (running) && clock != NULL) {
+    arrival = gst_clock_get_time (clock);
+    due = gst_element_get_base_time (play->playbin) + running +
+        gst_pipeline_get_latency (GST_PIPELINE (play->playbin));
+  }
+
+  ret = data->chain (pad, parent, buf);
+
+  if (clock == NULL)
+    return ret;
+
+  if (GST_CLOCK_TIME_IS_VALID (running) && ret == GST_FLOW_OK)
+    play_pacing_record (play, running, arrival > due,
+        gst_clock_get_time (clock));
+  gst_object_unref (clock);
+
+  return ret;
+}
+
+/* buffer lists would bypass the chain function, so their buffers go
+ * through it one by one */
+static GstFlowReturn
+play_pacing_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i, len = gst_buffer_list_length (list);
+
+  for (i = 0; i < len && ret == GST_FLOW_OK; i++)
+    ret = play_pacing_chain (pad, parent,
+        gst_buffer_ref (gst_buffer_list_get (list, i)));
+  gst_buffer_list_unref (list);
+
+  return ret;
+}
+
+/* called from element-setup for the actual video sink */
+static void
+play_pacing_attach (GstPlayMod * play, GstElement * sink)
+{
+  GstPlayModPacingChain *data;
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  if (pad == NULL)
+    return;
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+      GST_PAD_PROBE_TYPE_EVENT_FLUSH, play_pacing_probe, play, NULL);
+
+  /* the sink isn't streaming yet, element-setup comes before that */
+  data = g_new0 (GstPlayModPacingChain, 1);
+  data->play = play;
+  data->chain = GST_PAD_CHAINFUNC (pad);
+  if (data->chain != NULL && data->chain != play_pacing_chain) {
+    gst_pad_set_chain_function_full (pad, play_pacing_chain, data, g_free);
+    gst_pad_set_chain_list_function (pad, play_pacing_chain_list);
+  } else {
+    g_free (data);
+  }
+  gst_object_unref (pad);
+}
+
+static void
+play_pacing_free (GstPlayModPacing * pacing)
+{
+  g_array_unref (pacing->rates);
+  g_mutex_clear (&pacing->lock);
+  g_free (pacing);
+}
+
+/* called from play_timeout, the frame rate over the last second */
+static void
+play_pacing_update (GstPlayMod * play)
+{
+  GstPlayModPacing *pacing = play->pacing;
+  gint64 now = g_get_monotonic_time ();
+  guint frames;
+
+  if (pacing == NULL || now - pacing->status_time < G_USEC_PER_SEC)
+    return;
+
+  g_mutex_lock (&pacing->lock);
+  frames = pacing->frames;
+  g_mutex_unlock (&pacing->lock);
+
+  if (pacing->status_time != 0)
+    pacing->fps = (gdouble) (frames - pacing->status_frames) *
+        G_USEC_PER_SEC / (now - pacing->status_time);
+  pacing->status_frames = frames;
+  pacing->status_time = now;
+}
+
+gchar *
+gst_play_mod_frame_pacing_report (GstPlayMod * play)
+{
+  GstPlayModPacing *pacing = play->pacing;
+  GString *report;
+  guint i, j;
+
+  if (pacing == NULL)
+    return g_strdup ("Frame pacing: not enabled\n");
+
+  report = g_string_new (NULL);
+  g_mutex_lock (&pacing->lock);
+  g_string_append_printf (report, "Frame pacing: %u frames\n",
+      pacing->frames);
+  for (i = 0; i < pacing->rates->len; i++) {
+    GstPlayModPacingRate *entry =
+        &g_array_index (pacing->rates, GstPlayModPacingRate, i);
+    gdouble mean = 0.0, dev = 0.0;
+
+    if (entry->intervals > 0) {
+      mean = entry->interval_sum / entry->intervals;
+      dev = sqrt (MAX (entry->interval_sumsq / entry->intervals -
+              mean * mean, 0.0));
+    }
+
+    g_string_append_printf (report, "  rate %.2f: %u frames, %.1f fps, "
+        "interval %.2f ms +/- %.2f, max %.2f, %u late, %u early\n",
+        entry->rate, entry->frames, mean > 0.0 ? 1000.0 / mean : 0.0, mean,
+        dev, entry->interval_max, entry->late, entry->early);
+
+    g_string_append (report, "    interval/expected:");
+    for (j = 0; j < PACING_BUCKETS; j++) {
+      if (j == 0)
+        g_string_append_printf (report, " <%.1f", pacing_bucket_limits[0]);
+      else if (j == PACING_BUCKETS - 1)
+        g_string_append_printf (report, " >%.1f",
+            pacing_bucket_limits[j - 1]);
+      else
+        g_string_append_printf (report, " %.1f-%.1f",
+            pacing_bucket_limits[j - 1], pacing_bucket_limits[j]);
+      g_string_append_printf (report, ": %u", entry->histogram[j]);
+    }
+    g_string_append_c (report, '\n');
+  }
+  g_mutex_unlock (&pacing->lock);
+
+  return g_string_free (report, FALSE);
+}
+
+static void
+play_pacing_print (GstPlayMod * play)
+{
+  gchar *report;
+
+  if (play->pacing == NULL)
+    return;
+
+  report = gst_play_mod_frame_pacing_report (play);
+  gst_print ("%s", report);
+  g_free (report);
+}
+
+static void
+play_snapshot_encode (gpointer data, gpointer user_data)
+{
+  GstPlayModSnapshotJob *job = data;
+  GstCaps *caps;
+  GstSample *image;
+  GstMapInfo map;
+  GError *err = NULL;
+  gchar *dir;
+
+  if (g_str_has_suffix (job->path, ".jpg") ||
+      g_str_has_suffix (job->path, ".jpeg"))
+    caps = gst_caps_new_empty_simple ("image/jpeg");
+  else
+    caps = gst_caps_new_empty_simple ("image/png");
+
+  image = gst_video_convert_sample (job->sample, caps, 5 * GST_SECOND, &err);
+  gst_caps_unref (caps);
+
+  if (image != NULL) {
+    dir = g_path_get_dirname (job->path);
+    g_mkdir_with_parents (dir, 0755);
+    g_free (dir);
+
+    gst_buffer_map (gst_sample_get_buffer (image), &map, GST_MAP_READ);
+    g_file_set_contents (job->path, (const gchar *) map.data, map.size, &err);
+    gst_buffer_unmap (gst_sample_get_buffer (image), &map);
+    gst_sample_unref (image);
+  }
+
+  if (err == NULL)
+    g_atomic_int_inc (&job->play->snapshots);
+  else
+    GST_WARNING ("snapshot failed: %s", err->message);
+
+  if (job->func)
+    job->func (job->play, job->path, err, job->user_data);
+
+  g_clear_error (&err);
+  gst_sample_unref (job->sample);
+  g_free (job->path);
+  g_free (job);
+}
+
+/* takes the frame the video sink shows right now; converting and writing
+ * it happens in the snapshot pool */
+void
+gst_play_mod_snapshot (GstPlayMod * play, const gchar * path,
+    GstPlayModSnapshotFunc func, gpointer user_data)
+{
+  GstPlayModSnapshotJob *job;
+  GstSample *sample = NULL;
+  GError *err;
+
+  g_object_get (play->playbin, "sample", &sample, NULL);
+  if (sample == NULL) {
+    err = g_error_new_literal (GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+        "No video frame to take a snapshot of");
+    if (func)
+      func (play, path, err, user_data);
+    g_error_free (err);
+    return;
+  }
+
+  job = g_new0 (GstPlayModSnapshotJob, 1);
+  job->play = play;
+  job->sample = sample;
+  job->func = func;
+  job->user_data = user_data;
+
+  if (path != NULL) {
+    job->path = g_strdup (path);
+  } else {
+    GDateTime *now = g_date_time_new_now_local ();
+    gchar *name = g_date_time_format (now, "snapshot-%Y%m%d-%H%M%S.png");
+
+    job->path = g_build_filename (g_get_user_cache_dir (), PROGRAM_NAME,
+        "snapshots", name, NULL);
+    g_free (name);
+    g_date_time_unref (now);
+  }
+
+  g_thread_pool_push (play->snapshot_pool, job, NULL);
+}
+
+/* the strip of @uri, named after its URI and the tile layout */
+static gchar *
+play_thumbnails_path (GstPlayModThumbnails * thumbnails, const gchar * uri)
+{
+  gchar *key, *name, *path;
+
+  key = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  name = g_strdup_printf ("%s-%" G_GUINT64_FORMAT "-%u.png", key,
+      thumbnails->interval / GST_MSECOND, thumbnails->width);
+  path = g_build_filename (g_get_user_cache_dir (), PROGRAM_NAME,
+      "thumbnails", name, NULL);
+  g_free (name);
+  g_free (key);
+
+  return path;
+}
+
+/* width and height from the IHDR chunk of a strip we wrote before */
+static gboolean
+play_thumbnails_read_size (const gchar * path, guint * width, guint * height)
+{
+  guint8 header[24];
+  gboolean ret = FALSE;
+  FILE *f;
+
+  f = g_fopen (path, "rb");
+  if (f == NULL)
+    return FALSE;
+
+  if (fread (header, 1, sizeof (header), f) == sizeof (header) &&
+      memcmp (header + 12, "IHDR", 4) == 0) {
+    *width = GST_READ_UINT32_BE (header + 16);
+    *height = GST_READ_UINT32_BE (header + 20);
+    ret = TRUE;
+  }
+  fclose (f);
+
+  return ret;
+}
+
+static void
+play_thumbnails_pad_added (GstElement * decodebin, GstPad * pad,
+    gpointer user_data)
+{
+  GstPad *sinkpad = gst_element_get_static_pad (user_data, "sink");
+
+  if (!gst_pad_is_linked (sinkpad))
+    gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+}
+
+static void
+play_thumbnails_element_added (GstBin * bin, GstBin * sub_bin,
+    GstElement * element, gpointer user_data)
+{
+  /* one decoder thread is plenty for a keyframe now and then */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+          "max-threads"))
+    g_object_set (element, "max-threads", 1, NULL);
+}
+
+/* seeks to every interval in turn, decoding only the keyframe before it,
+ * and copies the frames into one row of tiles */
+static gboolean
+play_thumbnails_render (GstPlayModThumbnails * thumbnails,
+    GstPlayModThumbnailJob * job, GstElement * pipeline, GstElement * sink,
+    GstBuffer ** strip, GstVideoInfo * strip_info, guint * tiles)
+{
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GstSample *sample;
+  GstMapInfo map;
+  gint64 dur = -1;
+  guint i, n, row;
+
+  if (gst_element_get_state (pipeline, NULL, NULL, THUMBNAIL_TIMEOUT) !=
+      GST_STATE_CHANGE_SUCCESS ||
+      !gst_element_query_duration (pipeline, GST_FORMAT_TIME, &dur) ||
+      dur <= 0)
+    return FALSE;
+
+  n = MIN ((dur + thumbnails->interval - 1) / thumbnails->interval,
+      THUMBNAIL_MAX_TILES);
+
+  for (i = 0; i < n; i++) {
+    if (g_atomic_int_get (&thumbnails->generation) != job->generation)
+      return FALSE;
+
+    if (!gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+            GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+            GST_SEEK_FLAG_SNAP_BEFORE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS,
+            i * thumbnails->interval) ||
+        gst_element_get_state (pipeline, NULL, NULL, THUMBNAIL_TIMEOUT) !=
+        GST_STATE_CHANGE_SUCCESS)
+      return FALSE;
+
+    sample = NULL;
+    g_object_get (sink, "last-sample", &sample, NULL);
+    if (sample == NULL)
+      return FALSE;
+
+    if (!gst_video_info_from_caps (&info, gst_sample_get_caps (sample)) ||
+        !gst_video_frame_map (&frame, &info, gst_sample_get_buffer (sample),
+            GST_MAP_READ)) {
+      gst_sample_unref (sample);
+      return FALSE;
+    }
+
+    /* the first frame tells the tile height */
+    if (*strip == NULL) {
+      gst_video_info_set_format (strip_info, GST_VIDEO_FORMAT_RGB,
+          n * thumbnails->width, GST_VIDEO_INFO_HEIGHT (&info));
+      *strip = gst_buffer_new_allocate (NULL, strip_info->size, NULL);
+      gst_buffer_memset (*strip, 0, 0, strip_info->size);
+    }
+
+    gst_buffer_map (*strip, &map, GST_MAP_WRITE);
+    for (row = 0; row < MIN (GST_VIDEO_INFO_HEIGHT (&info),
+            GST_VIDEO_INFO_HEIGHT (strip_info)); row++)
+      memcpy (map.data + row * strip_info->stride[0] + i * thumbnails->width *
+          3, (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0) +
+          row * GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+          MIN (GST_VIDEO_INFO_WIDTH (&info), thumbnails->width) * 3);
+    gst_buffer_unmap (*strip, &map);
+
+    gst_video_frame_unmap (&frame);
+    gst_sample_unref (sample);
+  }
+
+  *tiles = n;
+  return TRUE;
+}
+
+static gboolean
+play_thumbnails_write (GstBuffer * strip, GstVideoInfo * info,
+    const gchar * path)
+{
+  GstCaps *caps, *png_caps;
+  GstSample *sample, *image;
+  GstMapInfo map;
+  GError *err = NULL;
+  gchar *dir;
+
+  caps = gst_video_info_to_caps (info);
+  sample = gst_sample_new (strip, caps, NULL, NULL);
+  png_caps = gst_caps_new_empty_simple ("image/png");
+  image = gst_video_convert_sample (sample, png_caps, THUMBNAIL_TIMEOUT,
+      &err);
+  gst_caps_unref (png_caps);
+  gst_caps_unref (caps);
+  gst_sample_unref (sample);
+
+  if (image != NULL) {
+    dir = g_path_get_dirname (path);
+    g_mkdir_with_parents (dir, 0755);
+    g_free (dir);
+
+    gst_buffer_map (gst_sample_get_buffer (image), &map, GST_MAP_READ);
+    g_file_set_contents (path, (const gchar *) map.data, map.size, &err);
+    gst_buffer_unmap (gst_sample_get_buffer (image), &map);
+    gst_sample_unref (image);
+  }
+
+  if (err != NULL) {
+    GST_WARNING ("could not write thumbnails: %s", err->message);
+    g_clear_error (&err);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Streaming threads of the thumbnail pipelines: each task gets a thread
+ * of its own that ends with it. A thread's nice value can't be lowered
+ * again without privileges, so niced threads must not go back to
+ * GStreamer's shared pool, where playback would pick them up. */
+typedef GstTaskPool PlayThumbnailTaskPool;
+typedef GstTaskPoolClass PlayThumbnailTaskPoolClass;
+
+static GType play_thumbnail_task_pool_get_type (void);
+G_DEFINE_TYPE (PlayThumbnailTaskPool, play_thumbnail_task_pool,
+    GST_TYPE_TASK_POOL);
+
+typedef struct
+{
+  GstTaskPoolFunction func;
+  gpointer user_data;
+} PlayThumbnailTask;
+
+static gpointer
+play_thumbnail_task_func (gpointer data)
+{
+  PlayThumbnailTask *task = data;
+
+  /* on Linux this only affects the calling thread */
+  setpriority (PRIO_PROCESS, 0, THUMBNAIL_NICE);
+  task->func (task->user_data);
+  g_free (task);
+
+  return NULL;
+}
+
+static void
+play_thumbnail_task_pool_prepare (GstTaskPool * pool, GError ** error)
+{
+  /* no thread pool to set up */
+}
+
+static void
+play_thumbnail_task_pool_cleanup (GstTaskPool * pool)
+{
+}
+
+static gpointer
+play_thumbnail_task_pool_push (GstTaskPool * pool, GstTaskPoolFunction func,
+    gpointer user_data, GError ** error)
+{
+  PlayThumbnailTask *task;
+  GThread *thread;
+
+  task = g_new0 (PlayThumbnailTask, 1);
+  task->func = func;
+  task->user_data = user_data;
+
+  thread = g_thread_try_new ("thumbnails", play_thumbnail_task_func, task,
+      error);
+  if (thread == NULL)
+    g_free (task);
+
+  return thread;
+}
+
+static void
+play_thumbnail_task_pool_join (GstTaskPool * pool, gpointer id)
+{
+  g_thread_join (id);
+}
+
+static void
+play_thumbnail_task_pool_class_init (PlayThumbnailTaskPoolClass * klass)
+{
+  klass->prepare = play_thumbnail_task_pool_prepare;
+  klass->cleanup = play_thumbnail_task_pool_cleanup;
+  klass->push = play_thumbnail_task_pool_push;
+  klass->join = play_thumbnail_task_pool_join;
+}
+
+static void
+play_thumbnail_task_pool_init (PlayThumbnailTaskPool * pool)
+{
+}
+
+/* called from the thread creating a streaming task, before it starts */
+static GstBusSyncReply
+play_thumbnails_sync_msg (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstPlayModThumbnails *thumbnails = user_data;
+  GstStreamStatusType type;
+  const GValue *val;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS)
+    return GST_BUS_PASS;
+
+  gst_message_parse_stream_status (msg, &type, NULL);
+  val = gst_message_get_stream_status_object (msg);
+  if (type == GST_STREAM_STATUS_TYPE_CREATE && val != NULL &&
+      G_VALUE_TYPE (val) == GST_TYPE_TASK)
+    gst_task_set_pool (g_value_get_object (val), thumbnails->task_pool);
+
+  return GST_BUS_PASS;
+}
+
+/* runs in the thumbnail pool's own thread, at a lower priority than
+ * playback; the streaming threads it starts have their own too */
+static void
+play_thumbnails_generate (gpointer data, gpointer user_data)
+{
+  GstPlayModThumbnailJob *job = data;
+  GstPlayModThumbnails *thumbnails = user_data;
+  GstElement *pipeline, *decodebin, *convert, *scale, *filter, *sink;
+  GstVideoInfo strip_info;
+  GstBuffer *strip = NULL;
+  GstCaps *caps;
+  guint width = 0, height = 0, tiles = 0;
+  gint64 start = g_get_monotonic_time ();
+  gint prio = G_MININT;
+  gchar *path;
+
+  if (g_atomic_int_get (&thumbnails->generation) != job->generation)
+    goto done;
+
+  /* on Linux this only affects the calling thread; going back may take
+   * privileges we don't have, but the thread is ours alone anyway */
+  errno = 0;
+  prio = getpriority (PRIO_PROCESS, 0);
+  if (prio == -1 && errno != 0)
+    prio = 0;
+  setpriority (PRIO_PROCESS, 0, THUMBNAIL_NICE);
+
+  path = play_thumbnails_path (thumbnails, job->uri);
+  if (play_thumbnails_read_size (path, &width, &height)) {
+    g_mutex_lock (&thumbnails->lock);
+    if (g_strcmp0 (thumbnails->uri, job->uri) == 0) {
+      g_free (thumbnails->path);
+      thumbnails->path = path;
+      thumbnails->tile_height = height;
+      thumbnails->tiles = width / thumbnails->width;
+      thumbnails->cached++;
+      path = NULL;
+    }
+    g_mutex_unlock (&thumbnails->lock);
+    g_free (path);
+    goto done;
+  }
+
+  pipeline = gst_pipeline_new ("thumbnails");
+  decodebin = gst_element_factory_make ("uridecodebin", NULL);
+  convert = gst_element_factory_make ("videoconvert", NULL);
+  scale = gst_element_factory_make ("videoscale", NULL);
+  filter = gst_element_factory_make ("capsfilter", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  if (decodebin == NULL || convert == NULL || scale == NULL ||
+      filter == NULL || sink == NULL) {
+    gst_printerr ("Could not create the thumbnail pipeline\n");
+    /* none of these made it into the pipeline yet */
+    if (decodebin != NULL)
+      gst_object_unref (decodebin);
+    if (convert != NULL)
+      gst_object_unref (convert);
+    if (scale != NULL)
+      gst_object_unref (scale);
+    if (filter != NULL)
+      gst_object_unref (filter);
+    if (sink != NULL)
+      gst_object_unref (sink);
+    gst_object_unref (pipeline);
+    g_free (path);
+    goto done;
+  }
+
+  /* leave all but the video undecoded, and unexposed */
+  caps = gst_caps_new_empty_simple ("video/x-raw");
+  g_object_set (decodebin, "uri", job->source_uri, "caps", caps,
+      "expose-all-streams", FALSE, NULL);
+  gst_caps_unref (caps);
+
+  caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "RGB",
+      "width", G_TYPE_INT, thumbnails->width, "pixel-aspect-ratio",
+      GST_TYPE_FRACTION, 1, 1, NULL);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  g_object_set (sink, "sync", FALSE, "enable-last-sample", TRUE, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), decodebin, convert, scale, filter,
+      sink, NULL);
+  gst_element_link_many (convert, scale, filter, sink, NULL);
+  g_signal_connect (decodebin, "pad-added",
+      G_CALLBACK (play_thumbnails_pad_added), convert);
+  g_signal_connect (pipeline, "deep-element-added",
+      G_CALLBACK (play_thumbnails_element_added), NULL);
+  gst_bus_set_sync_handler (GST_ELEMENT_BUS (pipeline),
+      play_thumbnails_sync_msg, thumbnails, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  if (play_thumbnails_render (thumbnails, job, pipeline, sink, &strip,
+          &strip_info, &tiles) &&
+      play_thumbnails_write (strip, &strip_info, path)) {
+    g_mutex_lock (&thumbnails->lock);
+    if (g_strcmp0 (thumbnails->uri, job->uri) == 0) {
+      g_free (thumbnails->path);
+      thumbnails->path = g_strdup (path);
+      thumbnails->tile_height = GST_VIDEO_INFO_HEIGHT (&strip_info);
+      thumbnails->tiles = tiles;
+    }
+    thumbnails->strips++;
+    thumbnails->tiles_total += tiles;
+    thumbnails->time_total += g_get_monotonic_time () - start;
+    g_mutex_unlock (&thumbnails->lock);
+  }
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  if (strip != NULL)
+    gst_buffer_unref (strip);
+  g_free (path);
+
+done:
+  if (prio != G_MININT)
+    setpriority (PRIO_PROCESS, 0, prio);
+  g_free (job->uri);
+  g_free (job->source_uri);
+  g_free (job);
+}
+
+/* called from gst_play_mod_uri(); @source_uri is where @uri is played from,
+ * which is a local copy if the cache has one */
+static void
+play_thumbnails_request (GstPlayMod * play, const gchar * uri,
+    const gchar * source_uri)
+{
+  GstPlayModThumbnails *thumbnails = play->thumbnails;
+  GstPlayModThumbnailJob *job;
+
+  if (thumbnails == NULL)
+    return;
+
+  g_mutex_lock (&thumbnails->lock);
+  if (g_strcmp0 (thumbnails->uri, uri) == 0) {
+    g_mutex_unlock (&thumbnails->lock);
+    return;
+  }
+  g_free (thumbnails->uri);
+  thumbnails->uri = g_strdup (uri);
+  g_clear_pointer (&thumbnails->path, g_free);
+  g_mutex_unlock (&thumbnails->lock);
+
+  job = g_new0 (GstPlayModThumbnailJob, 1);
+  job->generation = g_atomic_int_add (&thumbnails->generation, 1) + 1;
+
+  /* reading a network stream twice costs more than the thumbnails are
+   * worth */
+  if (!gst_uri_has_protocol (source_uri, "file")) {
+    g_free (job);
+    return;
+  }
+
+  job->uri = g_strdup (uri);
+  job->source_uri = g_strdup (source_uri);
+  g_thread_pool_push (thumbnails->pool, job, NULL);
+}
+
+gchar *
+gst_play_mod_thumbnails_report (GstPlayMod * play)
+{
+  GstPlayModThumbnails *thumbnails = play->thumbnails;
+  gchar *report = NULL;
+
+  if (thumbnails == NULL)
+    return NULL;
+
+  g_mutex_lock (&thumbnails->lock);
+  if (thumbnails->path != NULL)
+    report = g_strdup_printf ("path=%s\ninterval=%" G_GUINT64_FORMAT
+        "\ntile-width=%u\ntile-height=%u\ntiles=%u\n", thumbnails->path,
+        thumbnails->interval / GST_MSECOND, thumbnails->width,
+        thumbnails->tile_height, thumbnails->tiles);
+  g_mutex_unlock (&thumbnails->lock);
+
+  return report;
+}
+
+static void
+play_thumbnails_print (GstPlayMod * play)
+{
+  GstPlayModThumbnails *thumbnails = play->thumbnails;
+  guint snapshots = g_atomic_int_get (&play->snapshots);
+
+  if (snapshots > 0)
+    gst_print ("Snapshots: %u\n", snapshots);
+
+  if (thumbnails == NULL)
+    return;
+
+  g_mutex_lock (&thumbnails->lock);
+  gst_print ("Thumbnails: %u strips made, %u from cache, %.1f ms per tile\n",
+      thumbnails->strips, thumbnails->cached, thumbnails->tiles_total ?
+      (gdouble) thumbnails->time_total / thumbnails->tiles_total / 1000 : 0.0);
+  g_mutex_unlock (&thumbnails->lock);
+}
+
+static void
+play_thumbnails_free (GstPlayModThumbnails * thumbnails)
+{
+  /* stop the current strip, then wait for the pool */
+  g_atomic_int_inc (&thumbnails->generation);
+  g_thread_pool_free (thumbnails->pool, TRUE, TRUE);
+  gst_object_unref (thumbnails->task_pool);
+  g_mutex_clear (&thumbnails->lock);
+  g_free (thumbnails->uri);
+  g_free (thumbnails->path);
+  g_free (thumbnails);
+}
+
+/* A due timer joins the command queue rather than running from its
+ * source; it isn't queued again until it has run. */
+static gboolean
+play_timer_fire (gpointer user_data)
+{
+  PlayTimer *timer = user_data;
+  GstPlayModCommand *cmd;
+
+  if (!timer->queued) {
+    timer->queued = TRUE;
+    cmd = play_command_entry_new (PLAY_ENTRY_TIMER);
+    cmd->source = g_source_ref (g_main_current_source ());
+    cmd->timer = timer;
+    play_command_queue_push (&timer->play->commands, cmd);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* timers go on the player's context, which isn't necessarily the
+ * default one g_timeout_add() and g_source_remove() work with */
+static guint
+play_add_timeout (GstPlayMod * play, guint interval, GSourceFunc func)
+{
+  PlayTimer *timer;
+  GSource *source;
+  guint id;
+
+  timer = g_new0 (PlayTimer, 1);
+  timer->play = play;
+  timer->func = func;
+
+  source = g_timeout_source_new (interval);
+  g_source_set_callback (source, play_timer_fire, timer, g_free);
+  id = g_source_attach (source, play->commands.context);
+  g_source_unref (source);
+
+  return id;
+}
+
+static void
+play_remove_source (GstPlayMod * play, guint id)
+{
+  GSource *source;
+
+  source = g_main_context_find_source_by_id (play->commands.context, id);
+  if (source != NULL)
+    g_source_destroy (source);
+}
+
+static guint64
+play_resume_key (const gchar * uri)
+{
+  guint64 hash = 14695981039346656037ULL;
+
+  /* FNV-1a, 0 is taken to mean free */
+  for (; *uri != '\0'; uri++)
+    hash = (hash ^ (guchar) * uri) * 1099511628211ULL;
+  return hash != 0 ? hash : 1;
+}
+
+static GstPlayModResumeSlot *
+play_resume_find (GstPlayModResume * resume, guint64 key, gboolean create)
+{
+  GstPlayModResumeSlot *slot, *victim = NULL;
+  guint i, start = key % RESUME_SLOTS;
+
+  for (i = 0; i < RESUME_PROBE; i++) {
+    slot = &resume->table->slot[(start + i) % RESUME_SLOTS];
+    if (slot->key == key)
+      return slot;
+    /* a free slot, or else the one that was updated longest ago */
+    if (victim == NULL || (victim->key != 0 && (slot->key == 0 ||
+                slot->updated < victim->updated)))
+      victim = slot;
+  }
+
+  if (!create)
+    return NULL;
+
+  victim->key = 0;
+  return victim;
+}
+
+static void
+play_resume_store (GstPlayModResume * resume, const gchar * uri, gint64 pos,
+    gint64 dur)
+{
+  guint64 key = play_resume_key (uri);
+  GstPlayModResumeSlot *slot;
+
+  /* another process may be about to take the same free or old slot */
+  flock (resume->fd, LOCK_EX);
+
+  /* finished, or hardly started: next time starts from the beginning */
+  if (pos < RESUME_MARGIN || (dur > 0 && pos > dur - RESUME_MARGIN)) {
+    slot = play_resume_find (resume, key, FALSE);
+    if (slot != NULL)
+      slot->key = 0;
+  } else {
+    slot = play_resume_find (resume, key, TRUE);
+    slot->position = pos;
+    slot->duration = dur;
+    slot->updated = g_get_real_time () / G_USEC_PER_SEC;
+    slot->key = key;
+  }
+
+  flock (resume->fd, LOCK_UN);
+}
+
+/* Maps the store, creating or resetting it if needed. Several players
+ * and processes can share it, they only ever write their own items and
+ * take a slot under a lock on @fd_out. */
+static GstPlayModResumeTable *
+play_resume_map (const gchar * path, gint * fd_out)
+{
+  GstPlayModResumeTable *table;
+  GStatBuf st;
+  gchar *dir;
+  gint fd;
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+
+  fd = g_open (path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat (fd, &st) != 0 || (st.st_size != sizeof (GstPlayModResumeTable) &&
+          ftruncate (fd, sizeof (GstPlayModResumeTable)) != 0)) {
+    close (fd);
+    return NULL;
+  }
+
+  table = mmap (NULL, sizeof (GstPlayModResumeTable), PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0);
+  if (table == MAP_FAILED) {
+    close (fd);
+    return NULL;
+  }
+
+  flock (fd, LOCK_EX);
+  if (memcmp (table->magic, RESUME_MAGIC, sizeof (table->magic)) != 0 ||
+      table->slots != RESUME_SLOTS) {
+    memset (table, 0, sizeof (GstPlayModResumeTable));
+    memcpy (table->magic, RESUME_MAGIC, sizeof (table->magic));
+    table->slots = RESUME_SLOTS;
+  }
+  flock (fd, LOCK_UN);
+
+  *fd_out = fd;
+  return table;
+}
+
+/* saves where the current item is, called every RESUME_SAVE_INTERVAL
+ * from play_timeout and when the item changes */
+static void
+play_resume_save (GstPlayMod * play, gboolean force)
+{
+  GstPlayModResume *resume = play->resume;
+  gint64 now, pos = -1, dur = -1;
+
+  if (resume == NULL || resume->uri == NULL || play->is_live)
+    return;
+
+  now = g_get_monotonic_time ();
+  if (!force && now - resume->saved < RESUME_SAVE_INTERVAL)
+    return;
+
+  if (!gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    return;
+  gst_element_query_duration (play->playbin, GST_FORMAT_TIME, &dur);
+
+  play_resume_store (resume, resume->uri, pos, dur);
+  resume->saved = now;
+}
+
+/* the current item played to the end, and gapless playback went on with
+ * @next_uri if it isn't NULL */
+static void
+play_resume_finished (GstPlayMod * play, const gchar * next_uri)
+{
+  GstPlayModResume *resume = play->resume;
+
+  if (resume == NULL)
+    return;
+
+  if (resume->uri != NULL)
+    play_resume_store (resume, resume->uri, 0, -1);
+  resume->uri = next_uri;
+}
+
+/* called from gst_play_mod_uri() before @uri is set up */
+static void
+play_resume_prepare (GstPlayMod * play, const gchar * uri)
+{
+  GstPlayModResume *resume = play->resume;
+  GstPlayModResumeSlot *slot;
+
+  if (resume == NULL)
+    return;
+
+  play_resume_save (play, TRUE);
+
+  resume->uri = uri;
+  resume->saved = g_get_monotonic_time ();
+  resume->pending = GST_CLOCK_TIME_NONE;
+  resume->seeked = FALSE;
+  resume->started = resume->saved;
+
+  slot = play_resume_find (resume, play_resume_key (uri), FALSE);
+  if (slot != NULL) {
+    resume->pending = slot->position;
+    gst_print ("Resuming at %" GST_TIME_FORMAT "\n",
+        GST_TIME_ARGS (resume->pending));
+  }
+}
+
+/* Seeks to the saved position, from play_hold_ready() before the first
+ * preroll, or once it's done if that didn't work out. Returns TRUE once
+ * the item was resumed. */
+static gboolean
+play_resume_seek (GstPlayMod * play)
+{
+  GstPlayModResume *resume = play->resume;
+
+  if (resume == NULL)
+    return FALSE;
+
+  if (GST_CLOCK_TIME_IS_VALID (resume->pending) &&
+      play_do_seek_full (play, resume->pending, play->rate, play->trick_mode,
+          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+          GST_SEEK_FLAG_SNAP_BEFORE)) {
+    resume->pending = GST_CLOCK_TIME_NONE;
+    resume->seeked = TRUE;
+  }
+
+  return resume->seeked;
+}
+
+/* preroll is done, the first frame is up */
+static void
+play_resume_prerolled (GstPlayMod * play)
+{
+  GstPlayModResume *resume = play->resume;
+  gint64 elapsed;
+
+  if (resume == NULL || resume->started == 0)
+    return;
+
+  /* the preroll at the start, the resumed one is still to come */
+  if (GST_CLOCK_TIME_IS_VALID (resume->pending) || play_hold_active (play))
+    return;
+
+  elapsed = g_get_monotonic_time () - resume->started;
+  resume->started = 0;
+
+  if (resume->seeked) {
+    resume->resumed++;
+    resume->resumed_total += elapsed;
+    resume->resumed_max = MAX (resume->resumed_max, elapsed);
+  } else {
+    resume->fresh++;
+    resume->fresh_total += elapsed;
+  }
+}
+
+static void
+play_resume_print (GstPlayMod * play)
+{
+  GstPlayModResume *resume = play->resume;
+
+  if (resume == NULL || resume->resumed + resume->fresh == 0)
+    return;
+
+  gst_print ("Resume: %u items resumed, first frame avg %.1f ms, max %.1f ms"
+      "; %u from the start, avg %.1f ms\n", resume->resumed, resume->resumed ?
+      (gdouble) resume->resumed_total / resume->resumed / 1000 : 0.0,
+      (gdouble) resume->resumed_max / 1000, resume->fresh,
+      resume->fresh ? (gdouble) resume->fresh_total / resume->fresh / 1000 :
+      0.0);
+}
+
+static void
+play_resume_free (GstPlayModResume * resume)
+{
+  munmap (resume->table, sizeof (GstPlayModResumeTable));
+  close (resume->fd);
+  g_free (resume);
+}
+
+GstPlayMod *
+gst_play_mod_new (gchar ** uris, const gchar * audio_sink,
+    const gchar * video_sink, gboolean gapless, gdouble initial_volume,
+    gdouble initial_rate, gboolean verbose, const gchar * flags_string,
+    const GstPlayModTuning * tuning)
+{
+  static gsize debug_initialized = 0;
+  GstElement *sink, *playbin;
+  GstPlayMod *play;
+
+  if (g_once_init_enter (&debug_initialized)) {
+    GST_DEBUG_CATEGORY_INIT (play_debug, "play", 0, "gst-play-mod player");
+    g_once_init_leave (&debug_initialized, 1);
+  }
+
+  /* playbin3 switches tracks without reconfiguring, see
+   * play_select_stream() */
+  if (g_getenv ("USE_PLAYBIN3") != NULL)
+    playbin = gst_element_factory_make ("playbin3", "playbin");
+  else
+    playbin = gst_element_factory_make ("playbin", "playbin");
+
+  if (playbin == NULL)
+    return NULL;
+
+  play = g_new0 (GstPlayMod, 1);
+
+  play->uris = uris;
+  play->num_uris = g_strv_length (uris);
+  play->cur_idx = -1;
+  play->item_idx = -1;
+
+  play->default_item.in = GST_CLOCK_TIME_NONE;
+  play->default_item.out = GST_CLOCK_TIME_NONE;
+  play->default_item.loops = 1;
+
+  play->playbin = playbin;
+  play->is_playbin3 = g_str_equal (GST_OBJECT_NAME (gst_element_get_factory
+          (playbin)), "playbin3");
+
+  g_mutex_init (&play->selection_lock);
+  g_mutex_init (&play->index_lock);
+
+  play->snapshot_pool = g_thread_pool_new (play_snapshot_encode, NULL, 1,
+      FALSE, NULL);
+
+  play_command_queue_init (play, g_main_context_ref_thread_default ());
+  play->state_pool = g_thread_pool_new (play_state_func, play, 1, FALSE,
+      NULL);
+
+  if (audio_sink != NULL) {
+    if (strchr (audio_sink, ' ') != NULL)
+      sink = gst_parse_bin_from_description (audio_sink, TRUE, NULL);
+    else
+      sink = gst_element_factory_make (audio_sink, NULL);
+
+    if (sink != NULL)
+      g_object_set (play->playbin, "audio-sink", sink, NULL);
+    else
+      g_warning ("Couldn't create specified audio sink '%s'", audio_sink);
+  }
+  if (video_sink != NULL) {
+    if (strchr (video_sink, ' ') != NULL)
+      sink = gst_parse_bin_from_description (video_sink, TRUE, NULL);
+    else
+      sink = gst_element_factory_make (video_sink, NULL);
+
+    if (sink != NULL)
+      g_object_set (play->playbin, "video-sink", sink, NULL);
+    else
+      g_warning ("Couldn't create specified video sink '%s'", video_sink);
+  }
+
+  if (flags_string != NULL) {
+    GParamSpec *pspec;
+    GValue val = { 0, };
+
+    pspec =
+        g_object_class_find_property (G_OBJECT_GET_CLASS (playbin), "flags");
+    g_value_init (&val, pspec->value_type);
+    if (gst_value_deserialize (&val, flags_string))
+      g_object_set_property (G_OBJECT (play->playbin), "flags", &val);
+    else
+      gst_printerr ("Couldn't convert '%s' to playbin flags!\n", flags_string);
+    g_value_unset (&val);
+  }
+
+  play->tuning = *tuning;
+  play->tuning.properties = g_strdupv (tuning->properties);
+
+  if (play->tuning.buffer_size >= 0)
+    g_object_set (play->playbin, "buffer-size", play->tuning.buffer_size, NULL);
+  if (play->tuning.buffer_duration >= 0)
+    g_object_set (play->playbin, "buffer-duration",
+        play->tuning.buffer_duration, NULL);
+
+  g_signal_connect (play->playbin, "element-setup",
+      G_CALLBACK (play_element_setup), play);
+  g_signal_connect (play->playbin, "source-setup",
+      G_CALLBACK (play_source_setup), play);
+
+  if (play->tuning.low_latency) {
+    guint flags;
+
+    /* a live stream has nothing to buffer ahead of */
+    g_object_get (play->playbin, "flags", &flags, NULL);
+    g_object_set (play->playbin, "flags", flags & ~PLAY_FLAG_BUFFERING, NULL);
+
+    play->latency_timeout = play_add_timeout (play, 1000,
+        play_latency_timeout);
+  }
+
+  if (verbose) {
+    play->deep_notify_id =
+        gst_element_add_property_deep_notify_watch (play->playbin, NULL, TRUE);
+  }
+
+  play->loop = g_main_loop_new (play->commands.context, FALSE);
+
+  gst_bus_set_sync_handler (GST_ELEMENT_BUS (play->playbin), play_bus_sync,
+      play, NULL);
+
+  /* FIXME: make configurable incl. 0 for disable */
+  play->timeout = play_add_timeout (play, 100, play_timeout);
+
+  play->buffering = FALSE;
+  play->is_live = FALSE;
+
+  play->desired_state = GST_STATE_PLAYING;
+
+  play->gapless = gapless;
+  if (gapless) {
+    g_signal_connect (play->playbin, "about-to-finish",
+        G_CALLBACK (play_about_to_finish), play);
+  }
+
+  if (initial_volume != -1)
+    gst_play_mod_set_relative_volume (play, initial_volume - 1.0);
+
+  play->rate = 1.0;
+  play->trick_mode = GST_PLAY_MOD_TRICK_MODE_NONE;
+
+  play->recovery.max_retries = 3;
+  play->recovery.stall_timeout = 10 * GST_SECOND;
+  play->recovery.failures = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+  play->recovery.resume = GST_CLOCK_TIME_NONE;
+
+  if (initial_rate != -1)
+    play->rate = initial_rate;
+
+  return play;
+}
+
+void
+gst_play_mod_free (GstPlayMod * play)
+{
+  /* No need to see all those pad caps going to NULL etc., it's just noise */
+  if (play->deep_notify_id != 0)
+    g_signal_handler_disconnect (play->playbin, play->deep_notify_id);
+
+  play_reset (play);
+  play_resume_save (play, TRUE);
+
+  /* let the state changes asked for so far finish first */
+  g_thread_pool_free (play->state_pool, FALSE, TRUE);
+  gst_element_set_state (play->playbin, GST_STATE_NULL);
+  gst_bus_set_sync_handler (GST_ELEMENT_BUS (play->playbin), NULL, NULL, NULL);
+  gst_object_unref (play->playbin);
+
+  play_remove_source (play, play->timeout);
+  if (play->latency_timeout != 0)
+    play_remove_source (play, play->latency_timeout);
+  if (play->recovery.retry_timeout != 0)
+    play_remove_source (play, play->recovery.retry_timeout);
+  g_hash_table_unref (play->recovery.failures);
+  play_idle_clear (play);
+  g_main_loop_unref (play->loop);
+
+  if (play->items) {
+    guint i;
+
+    for (i = 0; i < play->num_uris; i++)
+      g_free (play->items[i]);
+    g_free (play->items);
+  }
+  g_strfreev (play->uris);
+
+  if (play->collection)
+    gst_object_unref (play->collection);
+  g_free (play->cur_audio_sid);
+  g_free (play->cur_video_sid);
+  g_free (play->cur_text_sid);
+
+  g_strfreev (play->tuning.properties);
+
+  if (play->cache)
+    play_cache_free (play->cache);
+  if (play->prober)
+    play_prober_free (play->prober);
+  if (play->timeshift)
+    play_timeshift_free (play->timeshift);
+  if (play->mosaic)
+    play_mosaic_free (play->mosaic);
+  if (play->sync)
+    play_sync_free (play->sync);
+  if (play->downscale)
+    play_downscale_free (play->downscale);
+  if (play->pacing)
+    play_pacing_free (play->pacing);
+  if (play->resume)
+    play_resume_free (play->resume);
+  if (play->thumbnails)
+    play_thumbnails_free (play->thumbnails);
+  g_thread_pool_free (play->snapshot_pool, FALSE, TRUE);
+
+  if (play->index) {
+    play_index_save (play->index);
+    play_index_unref (play->index);
+  }
+  if (play->setup_index)
+    play_index_unref (play->setup_index);
+
+  play_command_queue_clear (play);
+
+  if (play->window != XCB_WINDOW_NONE) {
+    g_mutex_lock (&display_lock);
+    display_players = g_list_remove (display_players, play);
+    g_mutex_unlock (&display_lock);
+    xcb_destroy_window (display, play->window);
+    xcb_flush (display);
+    play_display_unref ();
+  }
+
+  g_mutex_clear (&play->selection_lock);
+  g_mutex_clear (&play->index_lock);
+
+  if (play->event_notify)
+    play->event_notify (play->event_data);
+
+  g_free (play);
+}
+
+static void play_buffering_stall_end (GstPlayMod * play, gboolean resumed);
+
+/* reset for new file/stream */
+static void
+play_reset (GstPlayMod * play)
+{
+  /* switching items ends a stall, but nothing resumed */
+  play_buffering_stall_end (play, FALSE);
+  play->step_keyframe = GST_CLOCK_TIME_NONE;
+  /* a resumed item never gets to play_item_start() */
+  play->loops_done = 0;
+  play->buffering_stats.download_rate = 0;
+  play->buffering_stats.percent = 0;
+  play->buffering_stats.started = FALSE;
+  play->buffering = FALSE;
+  play->is_live = FALSE;
+  play->tuning_dumped = FALSE;
+  play->qos_dropped = 0;
+  play->qos_jitter = 0;
+  play->shrink_latency = GST_CLOCK_TIME_NONE;
+  play->shrink_done = FALSE;
+  play_hold_release (play);
+  g_atomic_int_set (&play->carry.seqnum, 0);
+  if (play->timeshift)
+    play_timeshift_reset (play->timeshift);
+}
+
+/* a new item, or the same one again, is being set up */
+static void
+play_recovery_cancel (GstPlayMod * play)
+{
+  GstPlayModRecovery *recovery = &play->recovery;
+
+  if (recovery->retry_timeout != 0) {
+    play_remove_source (play, recovery->retry_timeout);
+    recovery->retry_timeout = 0;
+  }
+  recovery->resume = GST_CLOCK_TIME_NONE;
+  recovery->last_pos = -1;
+  recovery->last_progress = g_get_monotonic_time ();
+  recovery->progressed = FALSE;
+}
+
+/* TRUE if @uri failed for good not long ago, so isn't worth trying */
+static gboolean
+play_recovery_is_bad (GstPlayMod * play, const gchar * uri)
+{
+  GstPlayModFailure *failure;
+
+  failure = g_hash_table_lookup (play->recovery.failures, uri);
+  if (failure == NULL || failure->bad_until == 0)
+    return FALSE;
+
+  if (g_get_monotonic_time () >= failure->bad_until) {
+    /* give it a fresh set of retries */
+    g_hash_table_remove (play->recovery.failures, uri);
+    return FALSE;
+  }
+
+  play->recovery.skipped++;
+  return TRUE;
+}
+
+/* a stall, from any source, or an error a network source may well not
+ * run into again; a missing item or one we may not access stays that
+ * way */
+static gboolean
+play_recovery_is_transient (const GError * err, const gchar * uri)
+{
+  if (err == NULL)
+    return TRUE;
+
+  if (gst_uri_has_protocol (uri, "file"))
+    return FALSE;
+
+  if (g_error_matches (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NOT_FOUND)
+      || g_error_matches (err, GST_RESOURCE_ERROR,
+          GST_RESOURCE_ERROR_NOT_AUTHORIZED))
+    return FALSE;
+
+  return err->domain == GST_RESOURCE_ERROR ||
+      g_error_matches (err, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED);
+}
+
+static gboolean
+play_recovery_retry (gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  GstClockTime resume = play->recovery.resume;
+
+  play->recovery.retry_timeout = 0;
+  gst_play_mod_uri (play, play->uris[play->cur_idx]);
+  play->recovery.resume = resume;
+
+  /* we know better where it got to than the last save */
+  if (play->resume && GST_CLOCK_TIME_IS_VALID (resume)) {
+    play->resume->pending = GST_CLOCK_TIME_NONE;
+    play_hold_release (play);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* The current item failed, with @err or by stalling. Transient failures
+ * are retried with exponential backoff, continuing where playback got
+ * to; otherwise, or once the retries are used up, the item is marked bad
+ * and we move on. A local file that stalled is retried too, but once
+ * given up on it is only skipped, not marked bad. */
+static void
+play_recovery_fail (GstPlayMod * play, const GError * err)
+{
+  GstPlayModRecovery *recovery = &play->recovery;
+  const gchar *uri = play->uris[play->cur_idx];
+  GstClockTime resume = GST_CLOCK_TIME_NONE;
+  GstPlayModFailure *failure;
+  GstClockTime delay;
+
+  /* a retry that failed before getting back to where the one before
+   * got to still has that to resume at */
+  if (play->is_live)
+    resume = GST_CLOCK_TIME_NONE;
+  else if (GST_CLOCK_TIME_IS_VALID (recovery->resume))
+    resume = recovery->resume;
+  else if (recovery->last_pos > 0)
+    resume = recovery->last_pos;
+
+  failure = g_hash_table_lookup (recovery->failures, uri);
+  if (failure == NULL) {
+    failure = g_new0 (GstPlayModFailure, 1);
+    g_hash_table_insert (recovery->failures, g_strdup (uri), failure);
+  }
+  failure->failures++;
+
+  if (play_recovery_is_transient (err, uri) &&
+      failure->failures <= recovery->max_retries) {
+    delay = MIN (RECOVERY_BACKOFF_MIN << MIN (failure->failures - 1, 16),
+        RECOVERY_BACKOFF_MAX);
+    gst_print ("Retrying in %.1f s (%u/%u)\n", (gdouble) delay / GST_SECOND,
+        failure->failures, recovery->max_retries);
+    recovery->retries++;
+
+    play_recovery_cancel (play);
+    recovery->resume = resume;
+    recovery->retry_timeout = play_add_timeout (play, delay / GST_MSECOND,
+        play_recovery_retry);
+    return;
+  }
+
+  if (err != NULL || !gst_uri_has_protocol (uri, "file"))
+    failure->bad_until = g_get_monotonic_time () + RECOVERY_BAD_TIME / 1000;
+  recovery->given_up++;
+
+  /* try next item in list then */
+  if (!gst_play_mod_next (play))
+    play_end_of_playlist (play);
+}
+
+/* seek to where a retried or restarted item left off; FALSE if there's
+ * nothing to resume */
+static gboolean
+play_recovery_resume (GstPlayMod * play)
+{
+  GstClockTime resume = play->recovery.resume;
+
+  if (!GST_CLOCK_TIME_IS_VALID (resume))
+    return FALSE;
+
+  play->recovery.resume = GST_CLOCK_TIME_NONE;
+  /* the jump there isn't progress, and is where a retry starts from if
+   * this attempt fails too */
+  play->recovery.last_pos = resume;
+  gst_print ("Resuming at %" GST_TIME_FORMAT "\n", GST_TIME_ARGS (resume));
+  gst_play_mod_do_seek (play, resume, play->rate, play->trick_mode);
+  return TRUE;
+}
+
+/* called from play_timeout: restarts the item if the position hasn't
+ * moved for stall_timeout while we should be playing */
+static void
+play_recovery_watch (GstPlayMod * play, gint64 pos)
+{
+  GstPlayModRecovery *recovery = &play->recovery;
+  gint64 now = g_get_monotonic_time ();
+
+  /* stalls for buffering are expected, and sync slaves wait on purpose */
+  if (recovery->stall_timeout == 0 || play->buffering || play->sync ||
+      play->start_pending || recovery->retry_timeout != 0 ||
+      play->desired_state != GST_STATE_PLAYING ||
+      GST_STATE (play->playbin) != GST_STATE_PLAYING || pos < 0 ||
+      pos != recovery->last_pos) {
+    if (pos >= 0 && recovery->last_pos >= 0 && pos != recovery->last_pos &&
+        !recovery->progressed) {
+      /* it plays, so it's not failing anymore */
+      recovery->progressed = TRUE;
+      g_hash_table_remove (recovery->failures, play->uris[play->cur_idx]);
+    }
+    if (pos >= 0)
+      recovery->last_pos = pos;
+    recovery->last_progress = now;
+    return;
+  }
+
+  if ((now - recovery->last_progress) * 1000 < recovery->stall_timeout)
+    return;
+
+  gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+      "Playback stalled at %" GST_TIME_FORMAT ", restarting\n",
+      GST_TIME_ARGS (pos));
+  recovery->restarts++;
+  play_set_state (play, GST_STATE_NULL);
+  play_recovery_fail (play, NULL);
+}
+
+static void
+play_recovery_print (GstPlayMod * play)
+{
+  GstPlayModRecovery *recovery = &play->recovery;
+
+  if (recovery->retries + recovery->restarts + recovery->given_up +
+      recovery->skipped == 0)
+    return;
+
+  gst_print ("Recovery: %u retries, %u stall restarts, %u items given up, "
+      "%u skipped as recently failed\n", recovery->retries,
+      recovery->restarts, recovery->given_up, recovery->skipped);
+}
+
+/* resident set size in bytes, 0 if unknown */
+static gint64
+play_resident_size (void)
+{
+  gchar *contents = NULL;
+  gint64 pages = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL) &&
+      sscanf (contents, "%*d %" G_GINT64_FORMAT, &pages) != 1)
+    pages = 0;
+  g_free (contents);
+
+  return pages * sysconf (_SC_PAGESIZE);
+}
+
+void
+gst_play_mod_get_resources (GstPlayModResources * resources)
+{
+  gchar *contents = NULL, *line;
+  const gchar *name;
+  GDir *dir;
+
+  memset (resources, 0, sizeof (*resources));
+  resources->resident = play_resident_size ();
+
+  if ((dir = g_dir_open ("/proc/self/fd", 0, NULL)) != NULL) {
+    while ((name = g_dir_read_name (dir)) != NULL)
+      resources->fds++;
+    g_dir_close (dir);
+    /* not counting the one reading the directory */
+    resources->fds = MAX (resources->fds, 1) - 1;
+  }
+
+  if (g_file_get_contents ("/proc/self/status", &contents, NULL, NULL) &&
+      (line = strstr (contents, "\nThreads:")) != NULL)
+    resources->threads = strtoul (line + strlen ("\nThreads:"), NULL, 10);
+  g_free (contents);
+}
+
+static void
+play_state_job_free (GstPlayModStateJob * job)
+{
+  g_free (job->uri);
+  g_free (job);
+}
+
+/* the state thread; the result goes back through the command queue */
+static void
+play_state_func (gpointer data, gpointer user_data)
+{
+  GstPlayModStateJob *job = data;
+  GstPlayMod *play = user_data;
+  GstPlayModCommand *cmd;
+  gint64 before = 0;
+
+  if (job->trim)
+    before = play_resident_size ();
+
+  if (job->uri != NULL) {
+    gst_element_set_state (play->playbin, GST_STATE_READY);
+    /* the old item's streaming threads are gone, and so is whatever
+     * they had to post */
+    play_command_queue_push (&play->commands,
+        play_command_entry_new (PLAY_ENTRY_SWITCHED));
+    play_hold_rearm (play);
+    g_object_set (play->playbin, "uri", job->uri, NULL);
+  }
+
+  job->ret = gst_element_set_state (play->playbin, job->state);
+  if (job->flush)
+    play_command_queue_push (&play->commands,
+        play_command_entry_new (PLAY_ENTRY_SWITCHED));
+
+  if (job->trim) {
+    /* hand what the decoders had back to the system */
+    malloc_trim (0);
+    job->freed = MAX (before - play_resident_size (), 0);
+  }
+
+  if (job->done == NULL) {
+    play_state_job_free (job);
+    return;
+  }
+
+  cmd = play_command_entry_new (PLAY_ENTRY_STATE);
+  cmd->job = job;
+  play_command_queue_push (&play->commands, cmd);
+}
+
+static GstPlayModStateJob *
+play_state_job_new (GstState state, PlayStateDoneFunc done)
+{
+  GstPlayModStateJob *job = g_new0 (GstPlayModStateJob, 1);
+
+  job->state = state;
+  job->done = done;
+  return job;
+}
+
+static void
+play_state_job_push (GstPlayMod * play, GstPlayModStateJob * job)
+{
+  if (job->uri != NULL || job->flush)
+    g_atomic_int_inc (&play->switching);
+  g_thread_pool_push (play->state_pool, job, NULL);
+}
+
+/* changes the playbin's state after the ones asked for before */
+static void
+play_set_state (GstPlayMod * play, GstState state)
+{
+  play_state_job_push (play, play_state_job_new (state, NULL));
+}
+
+/* same, for an item that failed: anything else it posted is dropped */
+static void
+play_set_state_flush (GstPlayMod * play, GstState state)
+{
+  GstPlayModStateJob *job = play_state_job_new (state, NULL);
+
+  job->flush = TRUE;
+  play_state_job_push (play, job);
+}
+
+static void
+play_idle_clear (GstPlayMod * play)
+{
+  GstPlayModIdle *idle = &play->idle;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (idle->sids); i++)
+    g_clear_pointer (&idle->sids[i], g_free);
+  idle->paused_since = 0;
+  idle->released = FALSE;
+  idle->restoring = FALSE;
+  idle->restore_started = 0;
+}
+
+static void
+play_idle_released (GstPlayMod * play, GstPlayModStateJob * job)
+{
+  GstPlayModIdle *idle = &play->idle;
+
+  idle->releases++;
+  idle->freed_total += job->freed;
+
+  gst_print ("Paused for %.0f s, released the pipeline (%.1f MB freed)\n",
+      (gdouble) (g_get_monotonic_time () - idle->paused_since) /
+      G_USEC_PER_SEC, (gdouble) job->freed / (1024 * 1024));
+}
+
+/* drops to READY on the state thread, which frees decoders, buffer
+ * pools and connections, remembering where we were */
+static void
+play_idle_release (GstPlayMod * play)
+{
+  GstPlayModIdle *idle = &play->idle;
+  GstPlayModStateJob *job;
+  gint64 pos = -1;
+
+  if (!gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    return;
+
+  idle->position = pos;
+  if (!gst_element_query_duration (play->playbin, GST_FORMAT_TIME,
+          &idle->duration))
+    idle->duration = -1;
+  if (play->is_playbin3) {
+    g_mutex_lock (&play->selection_lock);
+    idle->sids[0] = g_strdup (play->cur_audio_sid);
+    idle->sids[1] = g_strdup (play->cur_video_sid);
+    idle->sids[2] = g_strdup (play->cur_text_sid);
+    g_mutex_unlock (&play->selection_lock);
+  } else {
+    g_object_get (play->playbin, "current-audio", &idle->tracks[0],
+        "current-video", &idle->tracks[1], "current-text", &idle->tracks[2],
+        NULL);
+  }
+
+  idle->released = TRUE;
+
+  job = play_state_job_new (GST_STATE_READY, play_idle_released);
+  job->trim = TRUE;
+  play_state_job_push (play, job);
+}
+
+/* called from play_timeout */
+static void
+play_idle_check (GstPlayMod * play)
+{
+  GstPlayModIdle *idle = &play->idle;
+  gint64 now;
+
+  if (idle->timeout == 0 || idle->released)
+    return;
+
+  /* live streams can't be paused anyway, nor resumed where they were */
+  if (play->desired_state != GST_STATE_PAUSED ||
+      GST_STATE (play->playbin) != GST_STATE_PAUSED || play->buffering ||
+      play->start_pending || play->is_live || play->sync != NULL) {
+    idle->paused_since = 0;
+    return;
+  }
+
+  now = g_get_monotonic_time ();
+  if (idle->paused_since == 0)
+    idle->paused_since = now;
+  else if ((now - idle->paused_since) * 1000 >= idle->timeout)
+    play_idle_release (play);
+}
+
+/* resuming a released pipeline: it prerolls again, held back for the
+ * seek to where we were, see play_hold_ready() */
+static void
+play_idle_restore (GstPlayMod * play)
+{
+  GstPlayModIdle *idle = &play->idle;
+
+  idle->released = FALSE;
+  idle->restoring = TRUE;
+  idle->restore_started = g_get_monotonic_time ();
+  play->start_pending = TRUE;
+  if (GST_CLOCK_TIME_IS_VALID (idle->position))
+    play_hold_start (play);
+}
+
+/* TRUE if seeks are to be kept for the restore, with where it will
+ * restore to in @pos and the item's duration in @dur */
+static gboolean
+play_idle_position (GstPlayMod * play, gint64 * pos, gint64 * dur)
+{
+  GstPlayModIdle *idle = &play->idle;
+
+  if (!idle->released && !(idle->restoring &&
+          GST_CLOCK_TIME_IS_VALID (idle->position)))
+    return FALSE;
+
+  if (pos != NULL)
+    *pos = GST_CLOCK_TIME_IS_VALID (idle->position) ? idle->position : 0;
+  if (dur != NULL)
+    *dur = idle->duration;
+  return TRUE;
+}
+
+/* playbin3 selects streams before it links them, so ask for the old ones
+ * as soon as the collection is known */
+static void
+play_idle_select_streams (GstPlayMod * play, GstStreamCollection * collection)
+{
+  GstPlayModIdle *idle = &play->idle;
+  GList *selection = NULL;
+  guint i, j, len;
+
+  if (!idle->restoring)
+    return;
+
+  len = gst_stream_collection_get_size (collection);
+  for (i = 0; i < len; i++) {
+    GstStream *stream = gst_stream_collection_get_stream (collection, i);
+    const gchar *sid = gst_stream_get_stream_id (stream);
+
+    for (j = 0; j < G_N_ELEMENTS (idle->sids); j++) {
+      if (g_strcmp0 (sid, idle->sids[j]) == 0)
+        selection = g_list_append (selection, (gpointer) sid);
+    }
+  }
+
+  if (selection != NULL)
+    gst_element_send_event (play->playbin,
+        gst_event_new_select_streams (selection));
+  g_list_free (selection);
+}
+
+/* Seeks back to where we were, or to where seeks while released went,
+ * and with playbin picks the old tracks; done from play_hold_ready()
+ * before the preroll, or failing that once it's done. Returns TRUE once
+ * the position is restored. */
+static gboolean
+play_idle_seek (GstPlayMod * play)
+{
+  GstPlayModIdle *idle = &play->idle;
+  GstClockTime position = idle->position;
+
+  if (!idle->restoring || !GST_CLOCK_TIME_IS_VALID (position))
+    return FALSE;
+
+  /* a real seek now, not one to keep */
+  idle->position = GST_CLOCK_TIME_NONE;
+  if (!gst_play_mod_do_seek (play, position, play->rate, play->trick_mode)) {
+    idle->position = position;
+    return FALSE;
+  }
+
+  if (!play->is_playbin3)
+    g_object_set (play->playbin, "current-audio", idle->tracks[0],
+        "current-video", idle->tracks[1], "current-text", idle->tracks[2],
+        NULL);
+  return TRUE;
+}
+
+/* the start_pending step of a restore, in place of play_item_start() */
+static gboolean
+play_idle_restored (GstPlayMod * play)
+{
+  if (!play->idle.restoring)
+    return FALSE;
+
+  play_idle_seek (play);
+  play->idle.restoring = FALSE;
+  return TRUE;
+}
+
+/* preroll is done, the old frame is up again */
+static void
+play_idle_prerolled (GstPlayMod * play)
+{
+  GstPlayModIdle *idle = &play->idle;
+  gint64 latency;
+
+  if (idle->restore_started == 0)
+    return;
+
+  /* prerolled before the seek back, the restored frame is still to come */
+  if (GST_CLOCK_TIME_IS_VALID (idle->position) || play_hold_active (play))
+    return;
+
+  latency = g_get_monotonic_time () - idle->restore_started;
+  idle->restore_started = 0;
+  idle->restores++;
+  idle->restore_total += latency;
+  idle->restore_max = MAX (idle->restore_max, latency);
+
+  gst_print ("Resumed in %.1f ms\n", (gdouble) latency / 1000);
+}
+
+static void
+play_idle_print (GstPlayMod * play)
+{
+  GstPlayModIdle *idle = &play->idle;
+
+  if (idle->releases == 0)
+    return;
+
+  gst_print ("Idle: %u releases, %.1f MB freed on average, resumed in avg "
+      "%.1f ms, max %.1f ms\n", idle->releases,
+      (gdouble) idle->freed_total / idle->releases / (1024 * 1024),
+      idle->restores ? (gdouble) idle->restore_total / idle->restores / 1000 :
+      0.0, (gdouble) idle->restore_max / 1000);
+}
+
+void
+gst_play_mod_set_relative_volume (GstPlayMod * play, gdouble volume_step)
+{
+  gdouble volume;
+
+  volume = gst_stream_volume_get_volume (GST_STREAM_VOLUME (play->playbin),
+      GST_STREAM_VOLUME_FORMAT_CUBIC);
+
+  volume = round ((volume + volume_step) * VOLUME_STEPS) / VOLUME_STEPS;
+  volume = CLAMP (volume, 0.0, 10.0);
+
+  gst_stream_volume_set_volume (GST_STREAM_VOLUME (play->playbin),
+      GST_STREAM_VOLUME_FORMAT_CUBIC, volume);
+
+  gst_print ("Volume: %.0f%%                  \n", volume * 100);
+  play_emit_volume (play);
+}
+
+void
+gst_play_mod_toggle_audio_mute (GstPlayMod * play)
+{
+  gboolean mute;
+
+  mute = gst_stream_volume_get_mute (GST_STREAM_VOLUME (play->playbin));
+
+  mute = !mute;
+  gst_stream_volume_set_mute (GST_STREAM_VOLUME (play->playbin), mute);
+
+  gst_print ("Mute: %s                  \n", mute ? "on" : "off");
+  play_emit_volume (play);
+}
+
+/* TRUE if the rest of the stream downloads faster than it plays back */
+static gboolean
+play_buffering_can_play (GstPlayMod * play)
+{
+  GstPlayModBufferingStats *stats = &play->buffering_stats;
+  GstQuery *query;
+  gint64 pos = -1, dur = -1, download_left = -1, playback_left;
+
+  if (!gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos) ||
+      !gst_element_query_duration (play->playbin, GST_FORMAT_TIME, &dur) ||
+      dur <= 0 || pos < 0)
+    return FALSE;
+
+  playback_left = (dur - pos) / ABS (play->rate);
+
+  query = gst_query_new_buffering (GST_FORMAT_BYTES);
+  if (gst_element_query (play->playbin, query)) {
+    gint64 start, stop, estimated_total;
+
+    gst_query_parse_buffering_range (query, NULL, &start, &stop,
+        &estimated_total);
+
+    if (estimated_total >= 0) {
+      download_left = estimated_total * GST_MSECOND;
+    } else if (stop >= 0 && stats->download_rate > 0) {
+      gint64 total = -1;
+
+      if (gst_element_query_duration (play->playbin, GST_FORMAT_BYTES, &total)
+          && total > stop)
+        download_left = gst_util_uint64_scale (total - stop, GST_SECOND,
+            stats->download_rate);
+    }
+  }
+  gst_query_unref (query);
+
+  return download_left >= 0 && download_left < playback_left;
+}
+
+static void
+play_buffering_stall_end (GstPlayMod * play, gboolean resumed)
+{
+  GstPlayModBufferingStats *stats = &play->buffering_stats;
+  GstClockTime stalled;
+
+  if (stats->stall_start == 0)
+    return;
+
+  stalled = (g_get_monotonic_time () - stats->stall_start) * GST_USECOND;
+  stats->stall_time += stalled;
+  stats->stall_start = 0;
+
+  if (resumed)
+    gst_print ("\nResumed after %.1f s stall (%u stalls, %.1f s in total)\n",
+      (gdouble) stalled / GST_SECOND, stats->stalls,
+      (gdouble) stats->stall_time / GST_SECOND);
+}
+
+static void
+play_buffering_update (GstPlayMod * play, GstMessage * msg)
+{
+  GstPlayModBufferingStats *stats = &play->buffering_stats;
+  GstBufferingMode mode;
+  gint percent, avg_in, avg_out;
+  gint64 buffering_left;
+
+  gst_message_parse_buffering (msg, &percent);
+  gst_message_parse_buffering_stats (msg, &mode, &avg_in, &avg_out,
+      &buffering_left);
+
+  if (avg_in > 0) {
+    if (stats->download_rate == 0)
+      stats->download_rate = avg_in;
+    else
+      stats->download_rate = (stats->download_rate * 7 + avg_in) / 8;
+  }
+  stats->percent = percent;
+
+  /* no state management needed for live pipelines */
+  if (play->is_live || play->tuning.low_latency)
+    return;
+
+  if (!play->buffering) {
+    if (percent >= (stats->started ? play->tuning.buffer_low_percent :
+            play->tuning.buffer_high_percent))
+      return;
+
+    gst_print ("\n");
+    /* only count it as a stall if we were actually playing */
+    if (GST_STATE (play->playbin) == GST_STATE_PLAYING) {
+      stats->stalls++;
+      stats->stall_start = g_get_monotonic_time ();
+    }
+    play_set_state (play, GST_STATE_PAUSED);
+    play->buffering = TRUE;
+  } else {
+    if (percent < play->tuning.buffer_high_percent &&
+        (!stats->started || percent < play->tuning.buffer_low_percent ||
+            !play_buffering_can_play (play))) {
+      gst_print ("%s %d%% (%" G_GINT64_FORMAT " kB/s)  \r", "Buffering...",
+          percent, stats->download_rate / 1024);
+      return;
+    }
+
+    play->buffering = FALSE;
+    play_buffering_stall_end (play, TRUE);
+    play_set_state (play, play->desired_state);
+  }
+}
+
+/* data reached a sink while the hold was on: seek now, before anything
+ * prerolled */
+static void
+play_hold_ready (GstPlayMod * play, const GstStructure * s)
+{
+  gint seqnum = 0;
+
+  gst_structure_get_int (s, "seqnum", &seqnum);
+  if (seqnum != g_atomic_int_get (&play->hold.seqnum) ||
+      !g_atomic_int_compare_and_exchange (&play->hold.state, PLAY_HOLD_READY,
+          PLAY_HOLD_SEEKING))
+    return;
+
+  if (play->idle.restoring ? !play_idle_seek (play) : !play_resume_seek (play))
+    play_hold_release (play);
+}
+
+static gboolean
+play_bus_msg (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+
+  if (gst_is_video_overlay_prepare_window_handle_message (msg))
+    create_window (play, msg);
+
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_ASYNC_DONE:
+
+      /* dump graph on preroll */
+      GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (play->playbin),
+          GST_DEBUG_GRAPH_SHOW_ALL, "gst-play.async-done");
+
+      gst_print ("Prerolled.\r");
+      play_resume_prerolled (play);
+      play_idle_prerolled (play);
+
+      if (play->tuning.dump && !play->tuning_dumped) {
+        gst_play_mod_tuning_dump (play);
+        play->tuning_dumped = TRUE;
+      }
+
+      play_sync_prerolled (play);
+      break;
+    case GST_MESSAGE_STATE_CHANGED:
+      if (GST_MESSAGE_SRC (msg) == GST_OBJECT (play->playbin)) {
+        GstPlayModEvent event = { GST_PLAY_MOD_EVENT_STATE_CHANGED, };
+        GstState new_state;
+
+        gst_message_parse_state_changed (msg, NULL, &new_state, NULL);
+        event.state = new_state;
+        play_emit (play, &event);
+
+        if (new_state == GST_STATE_PLAYING)
+          play->buffering_stats.started = TRUE;
+
+        if (play->start_pending && new_state >= GST_STATE_PAUSED) {
+          play->start_pending = FALSE;
+          /* prerolled without the hold's seek, seek the usual way */
+          play_hold_release (play);
+          if (!play_sync_item_ready (play) && !play_idle_restored (play) &&
+              !play_recovery_resume (play) && !play_resume_seek (play) &&
+              !play_item_start (play)) {
+            gst_print ("setting playback rate to %f...\r", play->rate);
+            gst_play_mod_set_playback_rate (play, play->rate);
+          }
+        }
+      }
+      break;
+    case GST_MESSAGE_STREAM_START:
+      /* in gapless mode this is where the next item takes over */
+      play_index_activate (play);
+      play_downscale_item (play);
+      if (play->item_idx != play->cur_idx) {
+        play_resume_finished (play, play->uris[play->cur_idx]);
+        play->item_idx = play->cur_idx;
+        play_item_continue (play);
+      }
+      break;
+    case GST_MESSAGE_SEGMENT_DONE:
+      play_item_wrap (play);
+      break;
+    case GST_MESSAGE_BUFFERING:{
+      GstPlayModEvent event = { GST_PLAY_MOD_EVENT_BUFFERING, };
+
+      gst_message_parse_buffering (msg, &event.percent);
+      play_emit (play, &event);
+
+      play_buffering_update (play, msg);
+      break;
+    }
+    case GST_MESSAGE_CLOCK_LOST:{
+      gst_print ("Clock lost, selecting a new one\n");
+      play_set_state (play, GST_STATE_PAUSED);
+      play_set_state (play, GST_STATE_PLAYING);
+      break;
+    }
+    case GST_MESSAGE_LATENCY:
+      gst_print ("Redistribute latency...\n");
+      gst_bin_recalculate_latency (GST_BIN (play->playbin));
+      break;
+    case GST_MESSAGE_APPLICATION:
+      if (play->cache && gst_message_has_name (msg, "gst-play-mod-cache"))
+        play_cache_complete (play, gst_message_get_structure (msg));
+      else if (gst_message_has_name (msg, "gst-play-mod-hold"))
+        play_hold_ready (play, gst_message_get_structure (msg));
+      else if (gst_message_has_name (msg, "gst-play-mod-wrap") ||
+          gst_message_has_name (msg, "gst-play-mod-boundary"))
+        play_wrap_report (play, msg);
+      break;
+    case GST_MESSAGE_QOS:{
+      GstClockTimeDiff jitter;
+
+      /* sinks post these when they drop a late buffer */
+      gst_message_parse_qos_values (msg, &jitter, NULL, NULL);
+      play->qos_jitter = MAX (play->qos_jitter, jitter);
+      play->qos_dropped++;
+      break;
+    }
+    case GST_MESSAGE_REQUEST_STATE:{
+      GstState state;
+      gchar *name;
+
+      name = gst_object_get_path_string (GST_MESSAGE_SRC (msg));
+
+      gst_message_parse_request_state (msg, &state);
+
+      gst_print ("Setting state to %s as requested by %s...\n",
+          gst_element_state_get_name (state), name);
+
+      play_set_state (play, state);
+      g_free (name);
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      /* print final position at end */
+      play_timeout (play);
+      gst_print ("\n");
+      play_resume_finished (play, NULL);
+      /* and switch to next item in list */
+      if (!gst_play_mod_next (play))
+        play_end_of_playlist (play);
+      break;
+    case GST_MESSAGE_WARNING:{
+      GError *err;
+      gchar *dbg = NULL;
+
+      /* dump graph on warning */
+      GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (play->playbin),
+          GST_DEBUG_GRAPH_SHOW_ALL, "gst-play.warning");
+
+      gst_message_parse_warning (msg, &err, &dbg);
+      play_emit_error (play, GST_PLAY_MOD_EVENT_WARNING, err);
+      gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING, "WARNING %s\n", err->message);
+      if (dbg != NULL)
+        gst_play_mod_log (GST_PLAY_MOD_LOG_WARNING,
+            "WARNING debug information: %s\n", dbg);
+      g_clear_error (&err);
+      g_free (dbg);
+      break;
+    }
+    case GST_MESSAGE_ERROR:{
+      GError *err;
+      gchar *dbg;
+
+      /* dump graph on error */
+      GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (play->playbin),
+          GST_DEBUG_GRAPH_SHOW_ALL, "gst-play.error");
+
+      gst_message_parse_error (msg, &err, &dbg);
+      play_emit_error (play, GST_PLAY_MOD_EVENT_ERROR, err);
+      gst_printerr ("ERROR %s for %s\n", err->message,
+          play->uris[play->cur_idx]);
+      if (dbg != NULL)
+        gst_printerr ("ERROR debug information: %s\n", dbg);
+
+      /* drop any other error messages and clean up */
+      play_set_state (play, GST_STATE_NULL);
+
+      /* retry, or try next item in list then */
+      play_recovery_fail (play, err);
+      g_clear_error (&err);
+      g_free (dbg);
+      break;
+    }
+
+    case GST_MESSAGE_PROPERTY_NOTIFY:{
+      const GValue *val;
+      const gchar *name;
+      GstObject *obj;
+      gchar *val_str = NULL;
+      gchar *obj_name;
+
+      gst_message_parse_property_notify (msg, &obj, &name, &val);
+
+      obj_name = gst_object_get_path_string (GST_OBJECT (obj));
+      if (val != NULL) {
+        if (G_VALUE_HOLDS_STRING (val))
+          val_str = g_value_dup_string (val);
+        else if (G_VALUE_TYPE (val) == GST_TYPE_CAPS)
+          val_str = gst_caps_to_string (g_value_get_boxed (val));
+        else if (G_VALUE_TYPE (val) == GST_TYPE_TAG_LIST)
+          val_str = gst_tag_list_to_string (g_value_get_boxed (val));
+        else
+          val_str = gst_value_serialize (val);
+      } else {
+        val_str = g_strdup ("(no value)");
+      }
+
+      gst_play_mod_log (GST_PLAY_MOD_LOG_DEBUG, "%s: %s = %s\n", obj_name, name,
+          val_str);
+      g_free (obj_name);
+      g_free (val_str);
+      break;
+    }
+    case GST_MESSAGE_STREAM_COLLECTION:
+    {
+      GstStreamCollection *collection = NULL;
+      gst_message_parse_stream_collection (msg, &collection);
+
+      if (collection) {
+        g_mutex_lock (&play->selection_lock);
+        gst_object_replace ((GstObject **) & play->collection,
+            (GstObject *) collection);
+        g_mutex_unlock (&play->selection_lock);
+        play_idle_select_streams (play, collection);
+        gst_object_unref (collection);
+      }
+      break;
+    }
+    case GST_MESSAGE_STREAMS_SELECTED:
+    {
+      GstStreamCollection *collection = NULL;
+      guint i, len;
+
+      gst_message_parse_streams_selected (msg, &collection);
+      if (collection) {
+        g_mutex_lock (&play->selection_lock);
+        gst_object_replace ((GstObject **) & play->collection,
+            (GstObject *) collection);
+
+        /* Free all last stream-ids */
+        g_free (play->cur_audio_sid);
+        g_free (play->cur_video_sid);
+        g_free (play->cur_text_sid);
+        play->cur_audio_sid = NULL;
+        play->cur_video_sid = NULL;
+        play->cur_text_sid = NULL;
+
+        len = gst_message_streams_selected_get_size (msg);
+        for (i = 0; i < len; i++) {
+          GstStream *stream = gst_message_streams_selected_get_stream (msg, i);
+          if (stream) {
+            GstStreamType type = gst_stream_get_stream_type (stream);
+            const gchar *stream_id = gst_stream_get_stream_id (stream);
+
+            if (type & GST_STREAM_TYPE_AUDIO) {
+              play->cur_audio_sid = g_strdup (stream_id);
+            } else if (type & GST_STREAM_TYPE_VIDEO) {
+              play->cur_video_sid = g_strdup (stream_id);
+            } else if (type & GST_STREAM_TYPE_TEXT) {
+              play->cur_text_sid = g_strdup (stream_id);
+            } else {
+              gst_print ("Unknown stream type with stream-id %s\n",
+                  stream_id);
+            }
+            gst_object_unref (stream);
+          }
+        }
+
+        gst_object_unref (collection);
+        g_mutex_unlock (&play->selection_lock);
+        play_emit_tracks (play);
+      }
+
+      if (play->select_started != 0) {
+        gint64 latency = g_get_monotonic_time () - play->select_started;
+
+        play->select_started = 0;
+        play->switches++;
+        play->switch_total += latency;
+        play->switch_max = MAX (play->switch_max, latency);
+        gst_print ("Track switched in %.1f ms.\n", (gdouble) latency / 1000);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+play_timeout (gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  gint64 pos = -1, dur = -1;
+  const gchar *paused = "Paused";
+  gchar *status, pacing[64] = "";
+
+  play_visibility_update (play);
+
+  if (play->mosaic) {
+    play_mosaic_update (play);
+    return TRUE;
+  }
+
+  play_idle_check (play);
+  if (play->idle.released)
+    return TRUE;
+
+  if (play->buffering) {
+    play_recovery_watch (play, -1);
+    return TRUE;
+  }
+
+  gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos);
+  gst_element_query_duration (play->playbin, GST_FORMAT_TIME, &dur);
+
+  play_recovery_watch (play, pos);
+  play_resume_save (play, FALSE);
+
+  play_timeshift_update (play, pos, dur);
+  play_sync_update (play);
+  play_emit_position (play, pos, dur);
+
+  gint len = g_utf8_strlen (paused, -1);
+  status = g_newa (gchar, len + 1);
+  memset (status, ' ', len);
+  status[len] = '\0';
+
+  if (play->pacing != NULL) {
+    guint late;
+
+    play_pacing_update (play);
+    g_mutex_lock (&play->pacing->lock);
+    late = play->pacing->late;
+    g_mutex_unlock (&play->pacing->lock);
+    g_snprintf (pacing, sizeof (pacing), " %.1f fps, %u late",
+        play->pacing->fps, late);
+  }
+
+  if (pos >= 0 && dur > 0) {
+    gchar dstr[32], pstr[32];
+
+    /* FIXME: pretty print in nicer format */
+    g_snprintf (pstr, 32, "%" GST_TIME_FORMAT, GST_TIME_ARGS (pos));
+    pstr[9] = '\0';
+    g_snprintf (dstr, 32, "%" GST_TIME_FORMAT, GST_TIME_ARGS (dur));
+    dstr[9] = '\0';
+    gst_play_mod_log (GST_PLAY_MOD_LOG_STATUS, "%s / %s%s %s\r", pstr, dstr,
+        pacing, status);
+  } else if (pos >= 0 && play->timeshift && play->timeshift->active) {
+    gchar pstr[32];
+
+    g_snprintf (pstr, 32, "%" GST_TIME_FORMAT, GST_TIME_ARGS (pos));
+    pstr[9] = '\0';
+    gst_play_mod_log (GST_PLAY_MOD_LOG_STATUS, "%s (-%.1f s)%s %s\r", pstr,
+        (gdouble) play->timeshift->delay / GST_SECOND, pacing, status);
+  }
+
+  return TRUE;
+}
+
+void
+gst_play_mod_print_stats (GstPlayMod * play)
+{
+  GstPlayModBufferingStats *stats = &play->buffering_stats;
+
+  gst_print ("\nBuffering: %u stalls, %.1f s stalled, %" G_GINT64_FORMAT
+      " kB/s download rate\n", stats->stalls,
+      (gdouble) stats->stall_time / GST_SECOND, stats->download_rate / 1024);
+
+  if (play->cache) {
+    GstPlayModCache *cache = play->cache;
+    guint lookups = cache->hits + cache->misses;
+
+    gst_print ("Cache: %u/%u hits (%.0f%%), %" G_GUINT64_FORMAT
+        " kB saved, %" G_GUINT64_FORMAT " kB in use\n", cache->hits, lookups,
+        lookups ? 100.0 * cache->hits / lookups : 0.0,
+        cache->bytes_saved / 1024, cache->size / 1024);
+  }
+
+  if (play->index) {
+    g_mutex_lock (&play->index->lock);
+    gst_print ("Keyframe index: %u keyframes, %u keyframe steps\n",
+        play->index->keyframes->len, play->index_seeks);
+    g_mutex_unlock (&play->index->lock);
+  }
+
+  play_timeshift_print (play);
+  play_mosaic_print (play);
+  play_visibility_print (play);
+  play_downscale_print (play);
+  play_pacing_print (play);
+  play_sync_print (play);
+  play_recovery_print (play);
+  play_resume_print (play);
+  play_thumbnails_print (play);
+  play_idle_print (play);
+  play_command_print_stats (play);
+
+  if (play->switches > 0)
+    gst_print ("Track switches: %u, latency avg %.1f ms, max %.1f ms\n",
+        play->switches, (gdouble) play->switch_total / play->switches / 1000,
+        (gdouble) play->switch_max / 1000);
+
+  if (play->wraps > 0)
+    gst_print ("Loops: %u wraps, largest gap %.2f ms\n", play->wraps,
+        (gdouble) play->wrap_gap_max / GST_MSECOND);
+
+  if (play->boundaries > 0)
+    gst_print ("Gapless: %u stream boundaries, largest gap %.2f ms, rate "
+        "carried over %u times\n", play->boundaries,
+        (gdouble) play->boundary_gap_max / GST_MSECOND, play->rate_carried);
+}
+
+static gchar *
+play_uri_get_display_name (GstPlayMod * play, const gchar * uri)
+{
+  gchar *loc;
+
+  if (gst_uri_has_protocol (uri, "file")) {
+    loc = g_filename_from_uri (uri, NULL, NULL);
+  } else if (gst_uri_has_protocol (uri, "pushfile")) {
+    loc = g_filename_from_uri (uri + 4, NULL, NULL);
+  } else {
+    loc = g_strdup (uri);
+  }
+
+  /* Maybe additionally use glib's filename to display name function */
+  return loc;
+}
+
+/* the item's first state change is done */
+static void
+play_uri_started (GstPlayMod * play, GstPlayModStateJob * job)
+{
+  switch (job->ret) {
+    case GST_STATE_CHANGE_FAILURE:
+      /* ignore, we should get an error message posted on the bus */
+      break;
+    case GST_STATE_CHANGE_NO_PREROLL:
+      gst_print ("Pipeline is live.\n");
+      play->is_live = TRUE;
+      /* live sources that don't go through queue2 (RTSP, UDP) */
+      if (play->timeshift && !g_atomic_int_get (&play->timeshift->available))
+        gst_print ("Time-shift is not available for this source.\n");
+      break;
+    case GST_STATE_CHANGE_ASYNC:
+      gst_print ("Prerolling...\r");
+      break;
+    default:
+      break;
+  }
+}
+
+void
+gst_play_mod_uri (GstPlayMod * play, const gchar * next_uri)
+{
+  GstPlayModEvent event = { GST_PLAY_MOD_EVENT_ITEM_STARTED, };
+  GstPlayModStateJob *job;
+  gchar *loc, *cached_uri;
+
+  play_resume_prepare (play, next_uri);
+  play_reset (play);
+  play_recovery_cancel (play);
+  play_idle_clear (play);
+  if (play->resume && GST_CLOCK_TIME_IS_VALID (play->resume->pending))
+    play_hold_start (play);
+
+  loc = play_uri_get_display_name (play, next_uri);
+  gst_print ("Now playing %s\n", loc);
+  g_free (loc);
+
+  event.index = play->cur_idx;
+  event.uri = next_uri;
+  play_emit (play, &event);
+  play_probe_print (play, next_uri);
+
+  /* the state thread goes to READY, sets the uri and prerolls it */
+  job = play_state_job_new (GST_STATE_PAUSED, play_uri_started);
+
+  cached_uri = play_cache_lookup (play, next_uri);
+  if (cached_uri != NULL)
+    gst_print ("Playing from cache.\n");
+  job->uri = g_strdup (cached_uri ? cached_uri : next_uri);
+  play_index_prepare (play, cached_uri ? cached_uri : next_uri);
+  play_index_activate (play);
+  play_thumbnails_request (play, next_uri, cached_uri ? cached_uri : next_uri);
+  g_free (cached_uri);
+
+  if (play->cache) {
+    /* refresh our copy of this one if it's old, and fetch the next one */
+    play_cache_prefetch (play, next_uri, TRUE);
+    if (play->cur_idx + 1 < play->num_uris)
+      play_cache_prefetch (play, play->uris[play->cur_idx + 1], FALSE);
+  }
+
+  play_probe_upcoming (play);
+
+  play_state_job_push (play, job);
+
+  /* in sync mode the sync point starts playback, see play_sync_execute */
+  if (play->sync == NULL)
+    play_set_state (play, GST_STATE_PLAYING);
+
+  /* the rate and in point are applied once we get to PAUSED, see
+   * play_bus_msg, rather than blocking the control thread until then */
+  play->item_idx = play->cur_idx;
+  play->start_pending = TRUE;
+}
+
+/* returns FALSE if we have reached the end of the playlist */
+gboolean
+gst_play_mod_next (GstPlayMod * play)
+{
+  gint next_idx = g_atomic_int_get (&play->cur_idx) + 1;
+
+  /* don't even try what we already know won't play */
+  while (next_idx < play->num_uris &&
+      (!play_probe_is_playable (play, play->uris[next_idx]) ||
+          play_recovery_is_bad (play, play->uris[next_idx]))) {
+    gst_print ("Skipping unplayable %s\n", play->uris[next_idx]);
+    next_idx++;
+  }
+
+  if (next_idx >= play->num_uris)
+    return FALSE;
+
+  g_atomic_int_set (&play->cur_idx, next_idx);
+  gst_play_mod_uri (play, play->uris[next_idx]);
+  return TRUE;
+}
+
+/* returns FALSE if we have reached the beginning of the playlist */
+gboolean
+gst_play_mod_prev (GstPlayMod * play)
+{
+  gint prev_idx = g_atomic_int_get (&play->cur_idx) - 1;
+
+  if (prev_idx < 0 || play->num_uris <= 1)
+    return FALSE;
+
+  while (prev_idx >= 0 &&
+      (!play_probe_is_playable (play, play->uris[prev_idx]) ||
+          play_recovery_is_bad (play, play->uris[prev_idx]))) {
+    gst_print ("Skipping unplayable %s\n", play->uris[prev_idx]);
+    prev_idx--;
+  }
+
+  if (prev_idx < 0)
+    return FALSE;
+
+  g_atomic_int_set (&play->cur_idx, prev_idx);
+  gst_play_mod_uri (play, play->uris[prev_idx]);
+  return TRUE;
+}
+
+static void
+play_about_to_finish (GstElement * playbin, gpointer user_data)
+{
+  GstPlayMod *play = user_data;
+  const gchar *next_uri;
+  gchar *loc, *cached_uri;
+  guint next_idx;
+
+  /* the control thread is switching items already */
+  if (!play->gapless || g_atomic_int_get (&play->switching) > 0)
+    return;
+
+  /* streaming thread, cur_idx is shared with the control thread */
+  next_idx = g_atomic_int_get (&play->cur_idx) + 1;
+  while (next_idx < play->num_uris &&
+      !play_probe_is_playable (play, play->uris[next_idx]))
+    next_idx++;
+  if (next_idx >= play->num_uris)
+    return;
+
+  /* otherwise it starts once the current one has ended */
+  if (!play_carry_prepare (play, next_idx))
+    return;
+
+  next_uri = play->uris[next_idx];
+  loc = play_uri_get_display_name (play, next_uri);
+  gst_print ("About to finish, preparing next title: %s\n", loc);
+  g_free (loc);
+
+  cached_uri = play_cache_lookup (play, next_uri);
+  g_object_set (play->playbin, "uri", cached_uri ? cached_uri : next_uri, NULL);
+  play_index_prepare (play, cached_uri ? cached_uri : next_uri);
+  g_free (cached_uri);
+  g_atomic_int_set (&play->cur_idx, next_idx);
+}
+
+void
+gst_play_mod_set_event_callback (GstPlayMod * play, GstPlayModEventFunc func,
+    gpointer user_data, GDestroyNotify notify)
+{
+  if (play->event_notify)
+    play->event_notify (play->event_data);
+
+  play->event_func = func;
+  play->event_data = user_data;
+  play->event_notify = notify;
+}
+
+/* takes ownership of @items, which has an entry per uri */
+void
+gst_play_mod_set_items (GstPlayMod * play, GstPlayModItem ** items,
+    const GstPlayModItem * default_item)
+{
+  play->items = items;
+  play->default_item = *default_item;
+}
+
+void
+gst_play_mod_enable_cache (GstPlayMod * play, const gchar * dir,
+    guint64 max_size, gint64 max_age)
+{
+  gchar *default_dir = NULL;
+
+  if (dir == NULL)
+    dir = default_dir = g_build_filename (g_get_user_cache_dir (),
+        PROGRAM_NAME, NULL);
+
+  play->cache = play_cache_new (dir, max_size, max_age);
+  g_free (default_dir);
+}
+
+void
+gst_play_mod_set_region (GstPlayMod * play, const GstPlayModRegion * region)
+{
+  play->region = *region;
+}
+
+void
+gst_play_mod_enable_thumbnails (GstPlayMod * play, guint interval, guint width)
+{
+  GstPlayModThumbnails *thumbnails;
+
+  thumbnails = g_new0 (GstPlayModThumbnails, 1);
+  thumbnails->interval = MAX (interval, 1) * GST_MSECOND;
+  /* even, for the sake of subsampled formats along the way */
+  thumbnails->width = GST_ROUND_UP_2 (MAX (width, 16));
+  g_mutex_init (&thumbnails->lock);
+  thumbnails->task_pool =
+      gst_object_ref_sink (g_object_new (play_thumbnail_task_pool_get_type (),
+          NULL));
+  thumbnails->pool = g_thread_pool_new (play_thumbnails_generate, thumbnails,
+      1, TRUE, NULL);
+  play->thumbnails = thumbnails;
+}
+
+gboolean
+gst_play_mod_enable_resume (GstPlayMod * play, const gchar * path,
+    GError ** err)
+{
+  GstPlayModResumeTable *table;
+  gchar *default_path = NULL;
+  gint fd = -1;
+
+  if (path == NULL)
+    path = default_path = g_build_filename (g_get_user_cache_dir (),
+        PROGRAM_NAME, "positions", NULL);
+
+  table = play_resume_map (path, &fd);
+  if (table == NULL) {
+    g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Could not map %s: %s", path, g_strerror (errno));
+    g_free (default_path);
+    return FALSE;
+  }
+  g_free (default_path);
+
+  play->resume = g_new0 (GstPlayModResume, 1);
+  play->resume->table = table;
+  play->resume->fd = fd;
+  play->resume->pending = GST_CLOCK_TIME_NONE;
+  return TRUE;
+}
+
+void
+gst_play_mod_enable_frame_pacing (GstPlayMod * play)
+{
+  GstPlayModPacing *pacing;
+
+  pacing = g_new0 (GstPlayModPacing, 1);
+  g_mutex_init (&pacing->lock);
+  pacing->rates = g_array_new (FALSE, TRUE, sizeof (GstPlayModPacingRate));
+  gst_segment_init (&pacing->segment, GST_FORMAT_UNDEFINED);
+  pacing->last_render = GST_CLOCK_TIME_NONE;
+  play->pacing = pacing;
+}
+
+void
+gst_play_mod_enable_downscale (GstPlayMod * play)
+{
+  GstPlayModRegion region = play->region;
+  xcb_connection_t *connection;
+
+  /* the mosaic scales every tile to its size already */
+  if (play->mosaic != NULL)
+    return;
+
+  /* same size the window will get, without touching play->region, which
+   * create_window() looks at to tell outputs from full screen */
+  if (region.width == 0 || region.height == 0) {
+    connection = play_display_ref ();
+    if (connection == NULL)
+      return;
+    region.width = xcb_setup_roots_iterator (xcb_get_setup (connection))
+        .data->width_in_pixels;
+    region.height = xcb_setup_roots_iterator (xcb_get_setup (connection))
+        .data->height_in_pixels;
+    play_display_unref ();
+  }
+
+  play->downscale = play_downscale_new (region.width, region.height);
+  if (play->downscale != NULL)
+    g_object_set (play->playbin, "video-filter", play->downscale->bin, NULL);
+}
+
+void
+gst_play_mod_set_recovery (GstPlayMod * play, guint max_retries,
+    guint stall_timeout)
+{
+  play->recovery.max_retries = max_retries;
+  play->recovery.stall_timeout = stall_timeout * GST_MSECOND;
+}
+
+void
+gst_play_mod_set_idle_release (GstPlayMod * play, guint timeout)
+{
+  play->idle.timeout = timeout * GST_MSECOND;
+}
+
+void
+gst_play_mod_set_fade (GstPlayMod * play, guint duration)
+{
+  play->fade = duration * GST_MSECOND;
+}
+
+void
+gst_play_mod_set_position_interval (GstPlayMod * play, guint interval)
+{
+  play->position_interval = interval;
+}
+
+void
+gst_play_mod_set_hidden_video (GstPlayMod * play, GstPlayModHiddenVideo mode)
+{
+  play->hidden_video = mode;
+}
+
+void
+gst_play_mod_enable_probing (GstPlayMod * play, guint depth)
+{
+  play->prober = play_prober_new (play, depth);
+}
+
+void
+gst_play_mod_enable_timeshift (GstPlayMod * play, guint64 size,
+    const gchar * dir, gdouble catchup_rate)
+{
+  play->timeshift = play_timeshift_new (play, size, dir, catchup_rate);
+}
+
+void
+gst_play_mod_enable_mosaic (GstPlayMod * play, guint columns)
+{
+  play->mosaic = play_mosaic_new (play, columns);
+}
+
+gboolean
+gst_play_mod_start (GstPlayMod * play)
+{
+  gint i;
+
+  /* dump playlist */
+  for (i = 0; i < play->num_uris; ++i)
+    GST_INFO ("%4u : %s", i, play->uris[i]);
+
+  if (play->mosaic)
+    return play_mosaic_start (play);
+
+  return gst_play_mod_next (play);
+}
+
+void
+gst_play_mod_run (GstPlayMod * play)
+{
+  if (!gst_play_mod_start (play))
+    return;
+
+  g_main_loop_run (play->loop);
+
+  gst_play_mod_print_stats (play);
+}
+
+void
+gst_play_mod_quit (GstPlayMod * play)
+{
+  GstPlayModEvent event = { GST_PLAY_MOD_EVENT_STOPPED, };
+
+  g_main_loop_quit (play->loop);
+
+  if (!play->stopped) {
+    play->stopped = TRUE;
+    play_emit (play, &event);
+  }
+}
+
+void
+gst_play_mod_toggle_paused (GstPlayMod * play)
+{
+  if (play->desired_state == GST_STATE_PLAYING)
+    play->desired_state = GST_STATE_PAUSED;
+  else
+    play->desired_state = GST_STATE_PLAYING;
+
+  if (play->sync != NULL && play->sync->master) {
+    play_sync_point (play, -1, play->rate, play->trick_mode,
+        play->desired_state);
+    return;
+  }
+
+  if (!play->buffering) {
+    if (play->desired_state == GST_STATE_PLAYING && play->idle.released)
+      play_idle_restore (play);
+    play_set_state (play, play->desired_state);
+  } else if (play->desired_state == GST_STATE_PLAYING) {
+    gst_print ("\nWill play as soon as buffering finishes)\n");
+  }
+}
+
+void
+gst_play_mod_relative_seek (GstPlayMod * play, gdouble percent)
+{
+  GstQuery *query;
+  gboolean seekable = FALSE;
+  gint64 dur = -1, pos = -1, step, target;
+
+  g_return_if_fail (percent >= -1.0 && percent <= 1.0);
+
+  if (play_idle_position (play, &pos, &dur)) {
+    seekable = TRUE;
+    goto seek;
+  }
+
+  if (!gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    goto seek_failed;
+
+  /* a live stream has no duration, step through what's buffered */
+  if (play->timeshift && play->timeshift->active) {
+    step = (play_timeshift_live_edge (play) - play_timeshift_oldest (play)) *
+        percent;
+    if (ABS (step) < GST_SECOND)
+      step = (percent < 0) ? -GST_SECOND : GST_SECOND;
+
+    gst_play_mod_do_seek (play, play_timeshift_clamp (play, pos + step),
+        play->rate, play->trick_mode);
+    return;
+  }
+
+  query = gst_query_new_seeking (GST_FORMAT_TIME);
+  if (!gst_element_query (play->playbin, query)) {
+    gst_query_unref (query);
+    goto seek_failed;
+  }
+
+  gst_query_parse_seeking (query, NULL, &seekable, NULL, &dur);
+  gst_query_unref (query);
+
+seek:
+  if (!seekable || dur <= 0)
+    goto seek_failed;
+
+  if (GST_CLOCK_TIME_IS_VALID (play_current_item (play)->out))
+    dur = MIN (dur, play_current_item (play)->out);
+
+  step = dur * percent;
+  if (ABS (step) < GST_SECOND)
+    step = (percent < 0) ? -GST_SECOND : GST_SECOND;
+
+  /* accurate, the keyframe before the target could be seconds back,
+   * behind where we are now */
+  target = pos + step;
+  if (target > dur) {
+    if (!gst_play_mod_next (play))
+      play_end_of_playlist (play);
+  } else {
+    if (target < (gint64) play_item_in (play))
+      target = play_item_in (play);
+    gst_play_mod_do_seek (play, target, play->rate, play->trick_mode);
+  }
+
+  return;
+
+seek_failed:
+  {
+    gst_print ("\nCould not seek.\n");
+  }
+}
+
+static gboolean
+play_set_rate_and_trick_mode (GstPlayMod * play, gdouble rate,
+    GstPlayModTrickMode mode)
+{
+  gint64 pos = -1;
+
+  g_return_val_if_fail (rate != 0, FALSE);
+
+  if (!play_idle_position (play, &pos, NULL) &&
+      !gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+    return FALSE;
+
+  return gst_play_mod_do_seek (play, pos, rate, mode);
+}
+
+gboolean
+gst_play_mod_do_seek (GstPlayMod * play, gint64 pos, gdouble rate,
+    GstPlayModTrickMode mode)
+{
+  return play_do_seek_full (play, pos, rate, mode,
+      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE);
+}
+
+static gboolean
+play_do_seek_full (GstPlayMod * play, gint64 pos, gdouble rate,
+    GstPlayModTrickMode mode, GstSeekFlags extra_flags)
+{
+  const GstPlayModItem *item = play_current_item (play);
+  GstSeekFlags seek_flags;
+  GstQuery *query;
+  GstEvent *seek;
+  gboolean seekable = FALSE;
+
+  /* anything but a keyframe step moves away from the last one */
+  if (extra_flags & GST_SEEK_FLAG_FLUSH)
+    play->step_keyframe = GST_CLOCK_TIME_NONE;
+
+  /* released while paused: the restore seeks there */
+  if (play_idle_position (play, NULL, NULL)) {
+    play->idle.position = pos;
+    if (play->rate != rate || play->trick_mode != mode) {
+      play->rate = rate;
+      play->trick_mode = mode;
+      play_emit_rate (play);
+    }
+    return TRUE;
+  }
+
+  /* the state thread hasn't switched to the new item yet */
+  if (g_atomic_int_get (&play->switching) > 0)
+    return FALSE;
+
+  /* loops don't flush and stay in step without the master's help */
+  if ((extra_flags & GST_SEEK_FLAG_FLUSH) &&
+      play_sync_intercept (play, pos, rate, mode))
+    return TRUE;
+
+  if (play_hold_active (play)) {
+    /* nothing prerolled to answer the query yet; if the seek fails, the
+     * hold is let go and the item starts from where it starts */
+    seekable = TRUE;
+  } else {
+    query = gst_query_new_seeking (GST_FORMAT_TIME);
+    if (!gst_element_query (play->playbin, query)) {
+      gst_query_unref (query);
+      return FALSE;
+    }
+
+    gst_query_parse_seeking (query, NULL, &seekable, NULL, NULL);
+    gst_query_unref (query);
+  }
+
+  /* the ring buffer is seekable even if the live source behind it isn't */
+  if (!seekable && !(play->timeshift && play->timeshift->active))
+    return FALSE;
+
+  seek_flags = extra_flags;
+
+  /* end with SEGMENT_DONE instead of EOS if we're going to loop */
+  if (play_item_loops_left (play))
+    seek_flags |= GST_SEEK_FLAG_SEGMENT;
+
+  switch (mode) {
+    case GST_PLAY_MOD_TRICK_MODE_DEFAULT:
+      seek_flags |= GST_SEEK_FLAG_TRICKMODE;
+      break;
+    case GST_PLAY_MOD_TRICK_MODE_DEFAULT_NO_AUDIO:
+      seek_flags |= GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
+      break;
+    case GST_PLAY_MOD_TRICK_MODE_KEY_UNITS:
+      seek_flags |= GST_SEEK_FLAG_TRICKMODE_KEY_UNITS;
+      break;
+    case GST_PLAY_MOD_TRICK_MODE_KEY_UNITS_NO_AUDIO:
+      seek_flags |=
+          GST_SEEK_FLAG_TRICKMODE_KEY_UNITS | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
+      break;
+    case GST_PLAY_MOD_TRICK_MODE_NONE:
+    default:
+      break;
+  }
+
+  if (rate >= 0)
+    seek = gst_event_new_seek (rate, GST_FORMAT_TIME, seek_flags,
+        /* start */ GST_SEEK_TYPE_SET, pos,
+        /* stop */ GST_SEEK_TYPE_SET, item->out);
+  else
+    seek = gst_event_new_seek (rate, GST_FORMAT_TIME, seek_flags,
+        /* start */ GST_SEEK_TYPE_SET, play_item_in (play),
+        /* stop */ GST_SEEK_TYPE_SET, pos);
+
+  if (!gst_element_send_event (play->playbin, seek))
+    return FALSE;
+
+  if (play->rate != rate || play->trick_mode != mode) {
+    play->rate = rate;
+    play->trick_mode = mode;
+    play_emit_rate (play);
+  }
+  return TRUE;
+}
+
+/* jump to the next or previous keyframe we have indexed */
+static void
+play_step_keyframe (GstPlayMod * play, gboolean forward)
+{
+  GstClockTime keyframe;
+  gint64 pos = -1;
+
+  if ((!play_idle_position (play, &pos, NULL) &&
+          !gst_element_query_position (play->playbin, GST_FORMAT_TIME, &pos))
+      || play->index == NULL) {
+    gst_print ("\nNo keyframes indexed yet.\n");
+    return;
+  }
+
+  /* Right after a step the position may not have caught up yet, so
+   * count from the last step too. Backwards, the keyframe we just
+   * landed on doesn't count. */
+  if (GST_CLOCK_TIME_IS_VALID (play->step_keyframe))
+    pos = forward ? MAX (pos, (gint64) play->step_keyframe) :
+        MIN (pos, (gint64) play->step_keyframe);
+  if (!forward)
+    pos = MAX (pos - (gint64) INDEX_STEP_BACK_MARGIN, 0);
+
+  if (!play_index_step (play->index, pos, forward, &keyframe)) {
+    gst_print ("\nNo %s keyframe indexed yet.\n",
+        forward ? "next" : "previous");
+    return;
+  }
+
+  /* repeated steps must never stand still or go the wrong way */
+  if (forward ? (gint64) keyframe <= pos : (gint64) keyframe >= pos) {
+    GST_WARNING ("keyframe step from %" GST_TIME_FORMAT " went to %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (pos), GST_TIME_ARGS (keyframe));
+    return;
+  }
+
+  if (play_do_seek_full (play, keyframe, play->rate, play->trick_mode,
+          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+          GST_SEEK_FLAG_SNAP_BEFORE)) {
+    play->index_seeks++;
+    play->step_keyframe = keyframe;
+    gst_print ("Keyframe at %" GST_TIME_FORMAT "\n", GST_TIME_ARGS (keyframe));
+  }
+}
+
+void
+gst_play_mod_set_playback_rate (GstPlayMod * play, gdouble rate)
+{
+  if (play_set_rate_and_trick_mode (play, rate, play->trick_mode))
+    gst_print ("Playback rate: %.2f                               \n", rate);
+  else
+    gst_print ("\nCould not change playback rate to %.2f.\n", rate);
+}
+
+void
+gst_play_mod_set_relative_playback_rate (GstPlayMod * play, gdouble rate_step,
+    gboolean reverse_direction)
+{
+  gdouble new_rate = play->rate + rate_step;
+
+  if (reverse_direction)
+    new_rate *= -1.0;
+
+  gst_play_mod_set_playback_rate (play, new_rate);
+}
+
+static const gchar *
+trick_mode_get_description (GstPlayModTrickMode mode)
+{
+  switch (mode) {
+    case GST_PLAY_MOD_TRICK_MODE_NONE:
+      return "normal playback, trick modes disabled";
+    case GST_PLAY_MOD_TRICK_MODE_DEFAULT:
+      return "trick mode: default";
+    case GST_PLAY_MOD_TRICK_MODE_DEFAULT_NO_AUDIO:
+      return "trick mode: default, no audio";
+    case GST_PLAY_MOD_TRICK_MODE_KEY_UNITS:
+      return "trick mode: key frames only";
+    case GST_PLAY_MOD_TRICK_MODE_KEY_UNITS_NO_AUDIO:
+      return "trick mode: key frames only, no audio";
+    default:
+      break;
+  }
+  return "unknown trick mode";
+}
+
+static GstPlayModTrickMode
+play_next_trick_mode (GstPlayModTrickMode trick_mode)
+{
+  switch (trick_mode) {
+  case GST_PLAY_MOD_TRICK_MODE_NONE:
+    return GST_PLAY_MOD_TRICK_MODE_DEFAULT;
+  case GST_PLAY_MOD_TRICK_MODE_DEFAULT:
+    return GST_PLAY_MOD_TRICK_MODE_DEFAULT_NO_AUDIO;
+  case GST_PLAY_MOD_TRICK_MODE_DEFAULT_NO_AUDIO:
+    return GST_PLAY_MOD_TRICK_MODE_KEY_UNITS;
+  case GST_PLAY_MOD_TRICK_MODE_KEY_UNITS:
+    return GST_PLAY_MOD_TRICK_MODE_KEY_UNITS_NO_AUDIO;
+  case GST_PLAY_MOD_TRICK_MODE_KEY_UNITS_NO_AUDIO:
+    return GST_PLAY_MOD_TRICK_MODE_LAST;
+  case GST_PLAY_MOD_TRICK_MODE_LAST:
+    break;
+  }
+  return GST_PLAY_MOD_TRICK_MODE_NONE;
+}
+
+void
+gst_play_mod_switch_trick_mode (GstPlayMod * play)
+{
+  GstPlayModTrickMode new_mode;
+  const gchar *mode_desc;
+
+  play->trick_mode = play_next_trick_mode( play->trick_mode );
+  new_mode = play->trick_mode;
+
+  if (new_mode == GST_PLAY_MOD_TRICK_MODE_LAST)
+    new_mode = GST_PLAY_MOD_TRICK_MODE_NONE;
+
+  mode_desc = trick_mode_get_description (new_mode);
+
+  if (play_set_rate_and_trick_mode (play, play->rate, new_mode)) {
+    gst_print ("Rate: %.2f (%s)                      \n", play->rate,
+        mode_desc);
+  } else {
+    gst_print ("\nCould not change trick mode to %s.\n", mode_desc);
+  }
+}
+
+static GstStreamType
+play_track_stream_type (GstPlayModTrackType track_type)
+{
+  switch (track_type) {
+    case GST_PLAY_MOD_TRACK_TYPE_AUDIO:
+      return GST_STREAM_TYPE_AUDIO;
+    case GST_PLAY_MOD_TRACK_TYPE_VIDEO:
+      return GST_STREAM_TYPE_VIDEO;
+    case GST_PLAY_MOD_TRACK_TYPE_SUBTITLE:
+      return GST_STREAM_TYPE_TEXT;
+    default:
+      return GST_STREAM_TYPE_UNKNOWN;
+  }
+}
+
+static const gchar *
+play_track_type_get_name (GstPlayModTrackType track_type)
+{
+  switch (track_type) {
+    case GST_PLAY_MOD_TRACK_TYPE_AUDIO:
+      return "audio";
+    case GST_PLAY_MOD_TRACK_TYPE_VIDEO:
+      return "video";
+    case GST_PLAY_MOD_TRACK_TYPE_SUBTITLE:
+      return "subtitle";
+    default:
+      return "unknown";
+  }
+}
+
+/* playbin3: select track @index of @track_type, -1 for none, and keep the
+ * other types as they are. G_MAXINT cycles to the next track, through
+ * "none" except for video. decodebin3 swaps the streams in place, without
+ * a flush. */
+static gboolean
+play_select_stream (GstPlayMod * play, GstPlayModTrackType track_type,
+    gint index)
+{
+  GstStreamType stream_type = play_track_stream_type (track_type);
+  const gchar *name = play_track_type_get_name (track_type);
+  GList *selection = NULL;
+  GstStream *selected = NULL;
+  GstEvent *event;
+  gchar *cur_sid;
+  gint cur = -1, n = 0;
+  guint i, len;
+
+  g_mutex_lock (&play->selection_lock);
+  if (play->collection == NULL) {
+    g_mutex_unlock (&play->selection_lock);
+    gst_print ("No streams yet.\n");
+    return FALSE;
+  }
+
+  switch (track_type) {
+    case GST_PLAY_MOD_TRACK_TYPE_AUDIO:
+      cur_sid = play->cur_audio_sid;
+      break;
+    case GST_PLAY_MOD_TRACK_TYPE_VIDEO:
+      cur_sid = play->cur_video_sid;
+      break;
+    default:
+      cur_sid = play->cur_text_sid;
+      break;
+  }
+
+  len = gst_stream_collection_get_size (play->collection);
+  for (i = 0; i < len; i++) {
+    GstStream *stream = gst_stream_collection_get_stream (play->collection, i);
+
+    if (!(gst_stream_get_stream_type (stream) & stream_type))
+      continue;
+    if (g_strcmp0 (gst_stream_get_stream_id (stream), cur_sid) == 0)
+      cur = n;
+    n++;
+  }
+
+  if (n == 0) {
+    g_mutex_unlock (&play->selection_lock);
+    gst_print ("No %s tracks.\n", name);
+    return FALSE;
+  }
+
+  if (index == G_MAXINT) {
+    /* cycle: next track, then none, then the first one again */
+    index = cur + 1;
+    if (index >= n)
+      index = track_type == GST_PLAY_MOD_TRACK_TYPE_VIDEO ? 0 : -1;
+  } else if (index >= n) {
+    g_mutex_unlock (&play->selection_lock);
+    gst_print ("No %s track %d, there are %d.\n", name, index + 1, n);
+    return FALSE;
+  }
+
+  /* what stays selected of the other types, plus the new one */
+  for (i = 0, n = 0; i < len; i++) {
+    GstStream *stream = gst_stream_collection_get_stream (play->collection, i);
+    const gchar *sid = gst_stream_get_stream_id (stream);
+
+    if (gst_stream_get_stream_type (stream) & stream_type) {
+      if (n++ == index) {
+        selection = g_list_append (selection, (gpointer) sid);
+        selected = stream;
+      }
+    } else if (g_strcmp0 (sid, play->cur_audio_sid) == 0 ||
+        g_strcmp0 (sid, play->cur_video_sid) == 0 ||
+        g_strcmp0 (sid, play->cur_text_sid) == 0) {
+      selection = g_list_append (selection, (gpointer) sid);
+    }
+  }
+
+  if (selected != NULL) {
+    GstTagList *tags = gst_stream_get_tags (selected);
+    gchar *lang = NULL;
+
+    if (tags != NULL) {
+      gst_tag_list_get_string (tags, GST_TAG_LANGUAGE_NAME, &lang);
+      gst_tag_list_unref (tags);
+    }
+    if (lang != NULL)
+      gst_print ("Switching to %s track %d (%s).\n", name, index + 1, lang);
+    else
+      gst_print ("Switching to %s track %d.\n", name, index + 1);
+    g_free (lang);
+  } else {
+    gst_print ("Disabling %s.\n", name);
+  }
+
+  /* the event copies the stream ids */
+  event = gst_event_new_select_streams (selection);
+  g_list_free (selection);
+  g_mutex_unlock (&play->selection_lock);
+
+  play->select_started = g_get_monotonic_time ();
+  return gst_element_send_event (play->playbin, event);
+}
+
+void
+gst_play_mod_cycle_track_selection (GstPlayMod * play,
+    GstPlayModTrackType track_type)
+{
+  const gchar *prop_cur, *prop_n, *prop_get, *name;
+  gint cur = -1, n = -1;
+  guint flag, cur_flags;
+
+  if (play->is_playbin3) {
+    play_select_stream (play, track_type, G_MAXINT);
+    return;
+  }
+
+  switch (track_type) {
+    case GST_PLAY_MOD_TRACK_TYPE_AUDIO:
+      prop_get = "get-audio-tags";
+      prop_cur = "current-audio";
+      prop_n = "n-audio";
+      name = "audio";
+      flag = 0x2;
+      break;
+    case GST_PLAY_MOD_TRACK_TYPE_VIDEO:
+      prop_get = "get-video-tags";
+      prop_cur = "current-video";
+      prop_n = "n-video";
+      name = "video";
+      flag = 0x1;
+      break;
+    case GST_PLAY_MOD_TRACK_TYPE_SUBTITLE:
+      prop_get = "get-text-tags";
+      prop_cur = "current-text";
+      prop_n = "n-text";
+      name = "subtitle";
+      flag = 0x4;
+      break;
+    default:
+      return;
+  }
+
+  g_object_get (play->playbin, prop_cur, &cur, prop_n, &n, "flags",
+      &cur_flags, NULL);
+
+  if (!(cur_flags & flag))
+    cur = 0;
+  else
+    cur = (cur + 1) % (n + 1);
+
+  if (n < 1) {
+    gst_print ("No %s tracks.\n", name);
+  } else {
+    gchar *lcode = NULL, *lname = NULL;
+    const gchar *lang = NULL;
+    GstTagList *tags = NULL;
+
+    if (cur >= n && track_type != GST_PLAY_MOD_TRACK_TYPE_VIDEO) {
+      cur = -1;
+      gst_print ("Disabling %s.           \n", name);
+      if (cur_flags & flag) {
+        cur_flags &= ~flag;
+        g_object_set (play->playbin, "flags", cur_flags, NULL);
+      }
+    } else {
+      /* For video we only want to switch between streams, not disable it altogether */
+      if (cur >= n)
+        cur = 0;
+
+      if (!(cur_flags & flag) && track_type != GST_PLAY_MOD_TRACK_TYPE_VIDEO) {
+        cur_flags |= flag;
+        g_object_set (play->playbin, "flags", cur_flags, NULL);
+      }
+      g_signal_emit_by_name (play->playbin, prop_get, cur, &tags);
+
+      if (tags != NULL) {
+        if (gst_tag_list_get_string (tags, GST_TAG_LANGUAGE_NAME, &lname))
+          lang = lname;
+        gst_tag_list_unref (tags);
+      }
+      if (lang != NULL)
+        gst_print ("Switching to %s track %d of %d (%s).\n", name, cur + 1, n,
+            lang);
+      else
+        gst_print ("Switching to %s track %d of %d.\n", name, cur + 1, n);
+    }
+    g_free (lcode);
+    g_free (lname);
+
+    g_object_set (play->playbin, prop_cur, cur, NULL);
+    play_emit_tracks (play);
+  }
+}
+
+/* @id is a track number counting from 1, a stream id (playbin3 only), or
+ * "none" to turn the track type off */
+gboolean
+gst_play_mod_select_track (GstPlayMod * play, GstPlayModTrackType track_type,
+    const gchar * id)
+{
+  const gchar *prop_cur, *prop_n;
+  gchar *end;
+  gint index, n = 0;
+  guint flag, cur_flags;
+
+  if (g_str_equal (id, "none")) {
+    index = -1;
+  } else {
+    index = strtol (id, &end, 10) - 1;
+    if (*end != '\0' || end == id || index < 0) {
+      /* a stream id then, look up its position among its type */
+      GstStreamType stream_type = play_track_stream_type (track_type);
+      guint i, len;
+      gint n = 0;
+
+      index = G_MININT;
+      g_mutex_lock (&play->selection_lock);
+      len = play->collection ?
+          gst_stream_collection_get_size (play->collection) : 0;
+      for (i = 0; i < len; i++) {
+        GstStream *stream =
+            gst_stream_collection_get_stream (play->collection, i);
+
+        if (!(gst_stream_get_stream_type (stream) & stream_type))
+          continue;
+        if (g_str_equal (gst_stream_get_stream_id (stream), id))
+          index = n;
+        n++;
+      }
+      g_mutex_unlock (&play->selection_lock);
+
+      if (index == G_MININT) {
+        gst_print ("No %s stream %s.\n", play_track_type_get_name
+            (track_type), id);
+        return FALSE;
+      }
+    }
+  }
+
+  if (play->is_playbin3)
+    return play_select_stream (play, track_type, index);
+
+  switch (track_type) {
+    case GST_PLAY_MOD_TRACK_TYPE_AUDIO:
+      prop_cur = "current-audio";
+      prop_n = "n-audio";
+      flag = 0x2;
+      break;
+    case GST_PLAY_MOD_TRACK_TYPE_VIDEO:
+      prop_cur = "current-video";
+      prop_n = "n-video";
+      flag = 0x1;
+      break;
+    case GST_PLAY_MOD_TRACK_TYPE_SUBTITLE:
+      prop_cur = "current-text";
+      prop_n = "n-text";
+      flag = 0x4;
+      break;
+    default:
+      return FALSE;
+  }
+
+  if (index >= 0) {
+    g_object_get (play->playbin, prop_n, &n, NULL);
+    if (n == 0) {
+      gst_print ("No %s tracks.\n", play_track_type_get_name (track_type));
+      return FALSE;
+    } else if (index >= n) {
+      gst_print ("No %s track %d, there are %d.\n",
+          play_track_type_get_name (track_type), index + 1, n);
+      return FALSE;
+    }
+  }
+
+  /* playbin only turns a whole track type on or off through its flags */
+  g_object_get (play->playbin, "flags", &cur_flags, NULL);
+  if (index < 0)
+    cur_flags &= ~flag;
+  else
+    cur_flags |= flag;
+  g_object_set (play->playbin, "flags", cur_flags, NULL);
+  if (index >= 0)
+    g_object_set (play->playbin, prop_cur, index, NULL);
+  play_emit_tracks (play);
+
+  return TRUE;
+}
+
+/* SelectTrack's argument is "TYPE ID", TYPE being audio, video or
+ * subtitle */
+static void
+play_select_track_command (GstPlayMod * play, const gchar * arg)
+{
+  gchar **args;
+
+  args = g_strsplit (arg ? arg : "", " ", 2);
+  if (g_strv_length (args) != 2)
+    gst_print ("SelectTrack needs a track type and a track\n");
+  else if (g_str_equal (args[0], "audio"))
+    gst_play_mod_select_track (play, GST_PLAY_MOD_TRACK_TYPE_AUDIO, args[1]);
+  else if (g_str_equal (args[0], "video"))
+    gst_play_mod_select_track (play, GST_PLAY_MOD_TRACK_TYPE_VIDEO, args[1]);
+  else if (g_str_equal (args[0], "subtitle"))
+    gst_play_mod_select_track (play, GST_PLAY_MOD_TRACK_TYPE_SUBTITLE, args[1]);
+  else
+    gst_print ("Unknown track type %s\n", args[0]);
+  g_strfreev (args);
+}
@@ -0,0 +1,334 @@
+/* libgstplaymod: playbin based player core of gst-play-mod
+ *
+ * Copyright (C) 2013-2014 Tim-Philipp Müller <tim centricular net>
+ * Copyright (C) 2013 Collabora Ltd.
+ * Copyright (C) 2015 Centricular Ltd
+ * Copyright (C) 2021 No Isolation AS
+ *
+ * This application is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_PLAY_MOD_H__
+#define __GST_PLAY_MOD_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstPlayMod GstPlayMod;
+
+typedef enum
+{
+  GST_PLAY_MOD_TRICK_MODE_NONE = 0,
+  GST_PLAY_MOD_TRICK_MODE_DEFAULT,
+  GST_PLAY_MOD_TRICK_MODE_DEFAULT_NO_AUDIO,
+  GST_PLAY_MOD_TRICK_MODE_KEY_UNITS,
+  GST_PLAY_MOD_TRICK_MODE_KEY_UNITS_NO_AUDIO,
+  GST_PLAY_MOD_TRICK_MODE_LAST
+} GstPlayModTrickMode;
+
+typedef enum
+{
+  GST_PLAY_MOD_TRACK_TYPE_INVALID = 0,
+  GST_PLAY_MOD_TRACK_TYPE_AUDIO,
+  GST_PLAY_MOD_TRACK_TYPE_VIDEO,
+  GST_PLAY_MOD_TRACK_TYPE_SUBTITLE
+} GstPlayModTrackType;
+
+/* what video decoding does while the output window is fully covered or
+ * unmapped; audio and the clock carry on either way */
+typedef enum
+{
+  GST_PLAY_MOD_HIDDEN_VIDEO_DECODE = 0,
+  GST_PLAY_MOD_HIDDEN_VIDEO_KEYFRAMES,
+  GST_PLAY_MOD_HIDDEN_VIDEO_OFF
+} GstPlayModHiddenVideo;
+
+/* everything the player prints goes through its log, see gst_play_mod_log() */
+typedef enum
+{
+  GST_PLAY_MOD_LOG_ERROR = 0,
+  GST_PLAY_MOD_LOG_WARNING,
+  GST_PLAY_MOD_LOG_INFO,
+  GST_PLAY_MOD_LOG_STATUS,      /* the position line, several times a second */
+  GST_PLAY_MOD_LOG_DEBUG
+} GstPlayModLogLevel;
+
+/* Commands from D-Bus and stdin, run on the control thread: the thread
+ * running the player's main context. They share its queue with the
+ * pipeline's messages and the timers, in the order they came in; state
+ * changes are made on a thread of their own, so none of them blocks. */
+typedef enum
+{
+  GST_PLAY_MOD_COMMAND_QUIT = 0,
+  GST_PLAY_MOD_COMMAND_TOGGLE_PAUSED,
+  GST_PLAY_MOD_COMMAND_PLAY_NEXT,
+  GST_PLAY_MOD_COMMAND_PLAY_PREVIOUS,
+  GST_PLAY_MOD_COMMAND_INCREASE_RATE,
+  GST_PLAY_MOD_COMMAND_DECREASE_RATE,
+  GST_PLAY_MOD_COMMAND_CHANGE_DIRECTION,
+  GST_PLAY_MOD_COMMAND_TOGGLE_TRICK_MODE,
+  GST_PLAY_MOD_COMMAND_CHANGE_AUDIO_TRACK,
+  GST_PLAY_MOD_COMMAND_CHANGE_VIDEO_TRACK,
+  GST_PLAY_MOD_COMMAND_CHANGE_SUBTITLE_TRACK,
+  GST_PLAY_MOD_COMMAND_SEEK_TO_BEGINNING,
+  GST_PLAY_MOD_COMMAND_TOGGLE_MUTE,
+  GST_PLAY_MOD_COMMAND_INCREASE_VOLUME,
+  GST_PLAY_MOD_COMMAND_DECREASE_VOLUME,
+  GST_PLAY_MOD_COMMAND_SEEK_RIGHT,
+  GST_PLAY_MOD_COMMAND_SEEK_LEFT,
+  GST_PLAY_MOD_COMMAND_CATCH_UP,
+  GST_PLAY_MOD_COMMAND_NEXT_KEYFRAME,
+  GST_PLAY_MOD_COMMAND_PREVIOUS_KEYFRAME,
+  GST_PLAY_MOD_COMMAND_DUMP_TUNING,
+  GST_PLAY_MOD_COMMAND_PRINT_STATS,
+  GST_PLAY_MOD_COMMAND_SELECT_TRACK
+} GstPlayModCommandType;
+
+/* Element tuning applied from the playbin 'element-setup' signal,
+ * -1 means leave the element's own default alone */
+typedef struct
+{
+  gint decoder_max_threads;
+  gboolean decoder_low_latency;
+
+  gint queue_max_buffers;
+  gint queue_max_bytes;
+  gint64 queue_max_time;
+
+  gint buffer_size;
+  gint64 buffer_duration;
+
+  /* FACTORY.PROPERTY=VALUE overrides */
+  gchar **properties;
+
+  gboolean dump;
+
+  /* buffering hysteresis: pause below low, always resume at high */
+  gint buffer_low_percent;
+  gint buffer_high_percent;
+
+  /* live mode: small jitterbuffers, no buffering, frame dropping */
+  gboolean low_latency;
+  GstClockTime latency_target;
+} GstPlayModTuning;
+
+/* per-item section and loop count, from the playlist or command line */
+typedef struct
+{
+  GstClockTime in;
+  GstClockTime out;
+  gint loops;                   /* passes through in..out, 0 loops forever */
+} GstPlayModItem;
+
+typedef enum
+{
+  GST_PLAY_MOD_EVENT_ITEM_STARTED,      /* index, uri */
+  GST_PLAY_MOD_EVENT_STATE_CHANGED,     /* state */
+  GST_PLAY_MOD_EVENT_BUFFERING, /* percent */
+  GST_PLAY_MOD_EVENT_WARNING,   /* index, uri, error */
+  GST_PLAY_MOD_EVENT_ERROR,     /* index, uri, error */
+  GST_PLAY_MOD_EVENT_END_OF_PLAYLIST,
+  GST_PLAY_MOD_EVENT_STOPPED,   /* end of playlist or gst_play_mod_quit() */
+  GST_PLAY_MOD_EVENT_RATE_CHANGED,      /* rate, trick_mode */
+  GST_PLAY_MOD_EVENT_VOLUME_CHANGED,    /* volume, mute */
+  GST_PLAY_MOD_EVENT_TRACKS_CHANGED,    /* audio, video, subtitle track */
+  GST_PLAY_MOD_EVENT_POSITION   /* position, duration */
+} GstPlayModEventType;
+
+typedef struct
+{
+  GstPlayModEventType type;
+  gint index;
+  const gchar *uri;
+  GstState state;
+  gint percent;
+  const GError *error;
+  gdouble rate;
+  GstPlayModTrickMode trick_mode;
+  gdouble volume;
+  gboolean mute;
+  gint audio_track;             /* counting from 0, -1 when off */
+  gint video_track;
+  gint subtitle_track;
+  gint64 position;              /* -1 when unknown */
+  gint64 duration;
+} GstPlayModEvent;
+
+/* where the video window goes, in root window coordinates; a width or
+ * height of 0 covers the whole screen */
+typedef struct
+{
+  gint x;
+  gint y;
+  guint width;
+  guint height;
+} GstPlayModRegion;
+
+/* Events are delivered on the thread that runs the main context the
+ * player was created in; the event and its fields are only valid for
+ * the duration of the call. */
+typedef void (*GstPlayModEventFunc) (GstPlayMod * play,
+    const GstPlayModEvent * event, gpointer user_data);
+
+/* Called from an encoder thread once the snapshot was written to @path,
+ * or with @error if it couldn't be taken */
+typedef void (*GstPlayModSnapshotFunc) (GstPlayMod * play, const gchar * path,
+    const GError * error, gpointer user_data);
+
+/* what the whole process holds, to tell leaks from a long run */
+typedef struct
+{
+  gint64 resident;              /* bytes */
+  guint fds;
+  guint threads;                /* X connections of the sinks are fds too */
+} GstPlayModResources;
+
+/* Creating a player: gst_init() must have been called. The player takes
+ * ownership of @uris and attaches its bus watch and timers to the
+ * thread-default main context of the calling thread. */
+GstPlayMod *gst_play_mod_new (gchar ** uris, const gchar * audio_sink,
+    const gchar * video_sink, gboolean gapless, gdouble initial_volume,
+    gdouble initial_rate, gboolean verbose, const gchar * flags_string,
+    const GstPlayModTuning * tuning);
+void gst_play_mod_free (GstPlayMod * play);
+
+void gst_play_mod_set_event_callback (GstPlayMod * play,
+    GstPlayModEventFunc func, gpointer user_data, GDestroyNotify notify);
+void gst_play_mod_set_quiet (gboolean quiet);
+
+/* Logging, shared by all players in the process */
+/* *INDENT-OFF* */
+void gst_play_mod_log (GstPlayModLogLevel level, const gchar * format, ...)
+    G_GNUC_PRINTF (2, 3);
+/* *INDENT-ON* */
+void gst_play_mod_log_set_level (GstPlayModLogLevel level);
+void gst_play_mod_log_set_json (gboolean json);
+void gst_play_mod_log_flush (void);
+
+/* may be called from any thread */
+void gst_play_mod_get_resources (GstPlayModResources * resources);
+
+/* Optional features, to be enabled before gst_play_mod_start() */
+void gst_play_mod_set_items (GstPlayMod * play, GstPlayModItem ** items,
+    const GstPlayModItem * default_item);
+void gst_play_mod_set_region (GstPlayMod * play,
+    const GstPlayModRegion * region);
+/* how often a failing network item is retried before it's skipped for a
+ * while (default 3), and after how many ms without progress while playing
+ * an item is restarted (default 10000, 0 never) */
+void gst_play_mod_set_recovery (GstPlayMod * play, guint max_retries,
+    guint stall_timeout);
+/* after @timeout ms paused, drop to READY to free decoders and buffers;
+ * resuming restores position, rate and tracks. 0 (the default) never */
+void gst_play_mod_set_idle_release (GstPlayMod * play, guint timeout);
+/* fade every item in and out over @duration ms, so in gapless mode one
+ * dips into the next. 0 (the default) plays them as they are */
+void gst_play_mod_set_fade (GstPlayMod * play, guint duration);
+/* GST_PLAY_MOD_EVENT_POSITION every @interval ms, 0 (the default) for never */
+void gst_play_mod_set_position_interval (GstPlayMod * play, guint interval);
+void gst_play_mod_enable_cache (GstPlayMod * play, const gchar * dir,
+    guint64 max_size, gint64 max_age);
+void gst_play_mod_set_hidden_video (GstPlayMod * play,
+    GstPlayModHiddenVideo mode);
+/* scale video down to the window size right after decoding; call after
+ * gst_play_mod_set_region() */
+void gst_play_mod_enable_downscale (GstPlayMod * play);
+/* render timing at the video sink, see gst_play_mod_frame_pacing_report() */
+void gst_play_mod_enable_frame_pacing (GstPlayMod * play);
+/* start every item where it was left off, remembered in the file @path
+ * (NULL for the default in the user cache directory) */
+gboolean gst_play_mod_enable_resume (GstPlayMod * play, const gchar * path,
+    GError ** err);
+/* a strip of @width pixel wide keyframe thumbnails, every @interval ms,
+ * for every local item, see gst_play_mod_thumbnails_report() */
+void gst_play_mod_enable_thumbnails (GstPlayMod * play, guint interval,
+    guint width);
+void gst_play_mod_enable_probing (GstPlayMod * play, guint depth);
+void gst_play_mod_enable_timeshift (GstPlayMod * play, guint64 size,
+    const gchar * dir, gdouble catchup_rate);
+/* play all entries at once, tiled in @columns columns (0 picks a square
+ * layout) in a single window, instead of one after the other */
+void gst_play_mod_enable_mosaic (GstPlayMod * play, guint columns);
+/* Lock-step playback across processes and machines. The master serves
+ * its clock on UDP @port and sync points on TCP @port + 1, @delay ahead
+ * of time; slaves follow the master at @host. */
+gboolean gst_play_mod_enable_sync_master (GstPlayMod * play, guint port,
+    GstClockTime delay, GError ** error);
+gboolean gst_play_mod_enable_sync_slave (GstPlayMod * play, const gchar * host,
+    guint port, GError ** error);
+
+/* gst_play_mod_start() starts the first playlist entry and returns, for
+ * applications running their own main loop; gst_play_mod_run() also runs the
+ * player's main loop until the end of the playlist or gst_play_mod_quit(). */
+gboolean gst_play_mod_start (GstPlayMod * play);
+void gst_play_mod_run (GstPlayMod * play);
+void gst_play_mod_quit (GstPlayMod * play);
+
+/* Direct calls, from the thread the player runs in */
+void gst_play_mod_uri (GstPlayMod * play, const gchar * next_uri);
+gboolean gst_play_mod_next (GstPlayMod * play);
+gboolean gst_play_mod_prev (GstPlayMod * play);
+void gst_play_mod_toggle_paused (GstPlayMod * play);
+void gst_play_mod_relative_seek (GstPlayMod * play, gdouble percent);
+gboolean gst_play_mod_do_seek (GstPlayMod * play, gint64 pos, gdouble rate,
+    GstPlayModTrickMode mode);
+void gst_play_mod_set_playback_rate (GstPlayMod * play, gdouble rate);
+void gst_play_mod_set_relative_playback_rate (GstPlayMod * play,
+    gdouble rate_step, gboolean reverse_direction);
+void gst_play_mod_switch_trick_mode (GstPlayMod * play);
+void gst_play_mod_cycle_track_selection (GstPlayMod * play,
+    GstPlayModTrackType track_type);
+gboolean gst_play_mod_select_track (GstPlayMod * play,
+    GstPlayModTrackType track_type, const gchar * id);
+void gst_play_mod_set_relative_volume (GstPlayMod * play, gdouble volume_step);
+void gst_play_mod_toggle_audio_mute (GstPlayMod * play);
+void gst_play_mod_tuning_dump (GstPlayMod * play);
+void gst_play_mod_print_stats (GstPlayMod * play);
+/* may be called from any thread, free with g_free() */
+gchar *gst_play_mod_frame_pacing_report (GstPlayMod * play);
+/* Saves the frame on screen to @path, a PNG, or JPEG if it ends in .jpg,
+ * NULL for one in the user cache directory. May be called from any
+ * thread, encoding happens in the background. */
+void gst_play_mod_snapshot (GstPlayMod * play, const gchar * path,
+    GstPlayModSnapshotFunc func, gpointer user_data);
+/* path, interval, tile size and number of tiles of the thumbnail strip of
+ * the current item, one key=value per line; NULL until it's ready. May
+ * be called from any thread, free with g_free() */
+gchar *gst_play_mod_thumbnails_report (GstPlayMod * play);
+
+/* Commands, safe to push from any thread */
+gboolean gst_play_mod_command_lookup (const gchar * name,
+    GstPlayModCommandType * type);
+const gchar *gst_play_mod_command_get_name (GstPlayModCommandType type);
+void gst_play_mod_command_push (GstPlayMod * play, GstPlayModCommandType type);
+void gst_play_mod_command_push_full (GstPlayMod * play,
+    GstPlayModCommandType type, const gchar * arg);
+
+/* Tuning and playlist option helpers */
+void gst_play_mod_tuning_init (GstPlayModTuning * tuning);
+void gst_play_mod_tuning_add_property (GstPlayModTuning * tuning,
+    const gchar * assignment);
+gboolean gst_play_mod_tuning_load (GstPlayModTuning * tuning,
+    const gchar * filename, GError ** error);
+gboolean gst_play_mod_parse_time (const gchar * str, GstClockTime * time);
+gboolean gst_play_mod_item_parse (GstPlayModItem * item, const gchar * options);
+gboolean gst_play_mod_parse_region (const gchar * spec,
+    GstPlayModRegion * region);
+
+G_END_DECLS
+
+#endif /* __GST_PLAY_MOD_H__ */